@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_CONTAINER_BOUNDED_MPMC_QUEUE_H_
+#define ACORN_CONTAINER_BOUNDED_MPMC_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace acorn {
+
+/**
+ * A lock-free, fixed capacity, multi-producer multi-consumer FIFO queue.
+ *
+ * This is Dmitry Vyukov's bounded MPMC queue. Each cell in the ring buffer
+ * holds a sequence number alongside its value, which tells producers and
+ * consumers whether the cell is ready to be written or read on the current lap
+ * of the ring. Producers and consumers only contend on their own position
+ * counter, and each counter is kept on its own cache line so that producers do
+ * not invalidate the consumers' cache line and vice versa.
+ *
+ * @tparam T Value type stored in the queue. Must be default constructible and
+ *         move assignable.
+ */
+template <typename T>
+struct BoundedMpmcQueue {
+ private:
+  static constexpr size_t CacheLineSize = 64;
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  /** A position counter aligned to, and filling, a whole cache line. */
+  struct alignas(CacheLineSize) PaddedPosition {
+    std::atomic<size_t> value{0};
+  };
+  static_assert(sizeof(PaddedPosition) == CacheLineSize,
+                "Position counters must each fill one cache line.");
+
+ public:
+  /**
+   * Construct a queue able to hold @p capacity values.
+   *
+   * @param capacity [in] Maximum number of values stored at once. Must be a
+   *        power of two, and at least 2.
+   */
+  explicit BoundedMpmcQueue(size_t capacity)
+      : buffer_{new Cell[capacity]}, mask_{capacity - 1} {
+    static_assert(offsetof(BoundedMpmcQueue, enqueue_pos_) >= CacheLineSize &&
+                      offsetof(BoundedMpmcQueue, dequeue_pos_) ==
+                          offsetof(BoundedMpmcQueue, enqueue_pos_) +
+                              CacheLineSize,
+                  "Position counters must not share a cache line with each "
+                  "other or with the buffer.");
+    assert(capacity >= 2 && (capacity & (capacity - 1)) == 0 &&
+           "BoundedMpmcQueue capacity must be a power of two.");
+    for (size_t i = 0; i < capacity; ++i) {
+      buffer_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  BoundedMpmcQueue(BoundedMpmcQueue const&) = delete;
+  BoundedMpmcQueue& operator=(BoundedMpmcQueue const&) = delete;
+
+  /**
+   * Try to push a value onto the back of the queue.
+   *
+   * @param value [in] The value to push. This is only moved from if the push
+   *        succeeds.
+   * @return Whether the value was pushed, which fails if the queue is full.
+   */
+  bool try_push(T&& value) {
+    Cell* cell;
+    size_t pos = enqueue_pos_.value.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &buffer_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq) -
+                  static_cast<std::ptrdiff_t>(pos);
+      if (diff == 0) {
+        // The cell is free on this lap, so try to claim it.
+        if (enqueue_pos_.value.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // The cell still holds a value from the previous lap.
+        return false;
+      } else {
+        // Another producer claimed this cell, so try the next.
+        pos = enqueue_pos_.value.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Try to pop a value from the front of the queue.
+   *
+   * @param value [out] Assigned the popped value if the pop succeeds.
+   * @return Whether a value was popped, which fails if the queue is empty.
+   */
+  bool try_pop(T& value) {
+    Cell* cell;
+    size_t pos = dequeue_pos_.value.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &buffer_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq) -
+                  static_cast<std::ptrdiff_t>(pos + 1);
+      if (diff == 0) {
+        // The cell has been filled on this lap, so try to claim it.
+        if (dequeue_pos_.value.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // The cell has not been filled yet.
+        return false;
+      } else {
+        // Another consumer claimed this cell, so try the next.
+        pos = dequeue_pos_.value.load(std::memory_order_relaxed);
+      }
+    }
+    value = std::move(cell->value);
+    // Leave the cell holding a fresh value, so that any resources owned by the
+    // popped value are not kept alive by the queue.
+    cell->value = T{};
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Whether the queue currently has no values to pop.
+   *
+   * With concurrent pushes and pops this is only a snapshot, which may be
+   * stale by the time it is returned.
+   */
+  bool empty() const noexcept {
+    size_t pos = dequeue_pos_.value.load(std::memory_order_relaxed);
+    size_t seq = buffer_[pos & mask_].sequence.load(std::memory_order_acquire);
+    return static_cast<std::ptrdiff_t>(seq) -
+               static_cast<std::ptrdiff_t>(pos + 1) <
+           0;
+  }
+
+  /**
+   * Whether the queue currently has no space to push a value.
+   *
+   * With concurrent pushes and pops this is only a snapshot, which may be
+   * stale by the time it is returned.
+   */
+  bool full() const noexcept {
+    size_t pos = enqueue_pos_.value.load(std::memory_order_relaxed);
+    size_t seq = buffer_[pos & mask_].sequence.load(std::memory_order_acquire);
+    return static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos) <
+           0;
+  }
+
+  /**
+   * The number of values currently in the queue, counting any whose push or
+   * pop is still in progress.
+   *
+   * As for empty, with concurrent pushes and pops this is only a snapshot.
+   */
+  size_t size() const noexcept {
+    size_t dequeued = dequeue_pos_.value.load(std::memory_order_relaxed);
+    size_t enqueued = enqueue_pos_.value.load(std::memory_order_relaxed);
+    auto n_values = static_cast<std::ptrdiff_t>(enqueued - dequeued);
+    return n_values < 0 ? 0
+                        : std::min(static_cast<size_t>(n_values), capacity());
+  }
+
+  /** The maximum number of values the queue can hold. */
+  size_t capacity() const noexcept { return mask_ + 1; }
+
+ private:
+  /**
+   * The ring buffer of cells. The queue is aligned to a cache line by its
+   * position counters, so this starts a line that no prior data shares.
+   */
+  std::unique_ptr<Cell[]> const buffer_;
+  /** Mask to convert a position into an index into the buffer. */
+  size_t const mask_;
+  /** Position of the next cell to be written by a producer. */
+  PaddedPosition enqueue_pos_;
+  /** Position of the next cell to be read by a consumer. */
+  PaddedPosition dequeue_pos_;
+};
+
+}  // namespace acorn
+
+#endif  // ACORN_CONTAINER_BOUNDED_MPMC_QUEUE_H_
@@ -54,4 +54,18 @@
 #define ACORN_MAYBE_UNUSED
 #endif
 
+/**
+ * @def ACORN_HAS_COROUTINES
+ * Whether the compiler supports C++20 coroutines, including the @c <coroutine>
+ * header.
+ */
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define ACORN_HAS_COROUTINES 1
+#endif
+#endif
+#ifndef ACORN_HAS_COROUTINES
+#define ACORN_HAS_COROUTINES 0
+#endif
+
 #endif  // ACORN_MACROS_H_
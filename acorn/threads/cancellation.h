@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_CANCELLATION_H_
+#define ACORN_THREADS_CANCELLATION_H_
+
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace acorn {
+
+/**
+ * A cooperative cancellation flag shared between the code that cancels a
+ * piece of work, such as a request, and the tasks doing that work.
+ *
+ * Copies share the same flag. Tasks submitted to a thread pool with a token
+ * are dropped without running if the token is cancelled before a worker takes
+ * them, storing TaskCancelled in their futures, while tasks that are already
+ * running can check is_cancelled to stop early. Cancelling is constant time
+ * however many tasks were submitted with the token, as queued tasks are only
+ * checked as workers reach them.
+ */
+struct CancellationToken {
+  CancellationToken()
+      : cancelled_{std::make_shared<std::atomic<bool>>(false)} {}
+
+  /** Cancel all work sharing this token. */
+  void cancel() noexcept { cancelled_->store(true, std::memory_order_release); }
+
+  /** Whether the token has been cancelled. */
+  bool is_cancelled() const noexcept {
+    return cancelled_->load(std::memory_order_acquire);
+  }
+
+ private:
+  std::shared_ptr<std::atomic<bool>> cancelled_;
+};
+
+/**
+ * The error stored in the future of a task which a thread pool drops without
+ * running, as its CancellationToken was cancelled or the pool was shut down
+ * with ShutdownMode::discard.
+ */
+struct TaskCancelled : std::exception {
+  char const* what() const noexcept override { return "acorn::TaskCancelled"; }
+};
+
+}  // namespace acorn
+
+#endif  // ACORN_THREADS_CANCELLATION_H_
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_COROUTINE_H_
+#define ACORN_THREADS_COROUTINE_H_
+
+#include "acorn/macros.h"
+
+#if ACORN_HAS_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+#include "acorn/threads/future.h"
+
+namespace acorn {
+
+template <typename T = void>
+struct task;
+
+/** Parts of a task's promise that do not depend on its result type. */
+struct TaskPromiseBase {
+  /** Resumes whoever awaited the task once the task finishes. */
+  struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Promise> finished) noexcept {
+      return finished.promise().continuation;
+    }
+
+    void await_resume() const noexcept {}
+  };
+
+  /** Tasks are lazy, and only start running once awaited. */
+  std::suspend_always initial_suspend() const noexcept { return {}; }
+
+  FinalAwaiter final_suspend() const noexcept { return {}; }
+
+  void unhandled_exception() noexcept { error = std::current_exception(); }
+
+  /** The coroutine awaiting this task, resumed once the task finishes. */
+  std::coroutine_handle<> continuation = std::noop_coroutine();
+  /** Any exception thrown by the task's body. */
+  std::exception_ptr error;
+};
+
+/** Promise type of a task returning a @c T. */
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+  task<T> get_return_object() noexcept;
+
+  template <typename Value>
+  void return_value(Value&& value) {
+    value_.emplace(std::forward<Value>(value));
+  }
+
+  /** The task's result, or its exception. */
+  T result() {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return value_.take();
+  }
+
+ private:
+  FutureStorage<T> value_;
+};
+
+/** Promise type of a task returning nothing. */
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+  task<void> get_return_object() noexcept;
+
+  void return_void() noexcept {}
+
+  void result() {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+};
+
+/**
+ * A lazily started C++20 coroutine returning a @c T.
+ *
+ * The coroutine starts once it is awaited, and when it finishes it resumes
+ * its awaiter directly, on whichever thread it finished on. Combined with
+ * @c co_await pool.schedule() and awaiting Futures or TaskGraph tasks, this
+ * lets many logical operations wait on each other while only occupying a
+ * thread when there is work to do.
+ *
+ * A task which is never awaited never runs. Use spawn to start a task from
+ * outside a coroutine.
+ */
+template <typename T>
+struct task {
+  using promise_type = TaskPromise<T>;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  explicit task(Handle handle) noexcept : handle_{handle} {}
+
+  task(task&& other) noexcept : handle_{std::exchange(other.handle_, {})} {}
+  task& operator=(task&& other) noexcept {
+    if (this != &other) {
+      destroy();
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+  task(task const&) = delete;
+  task& operator=(task const&) = delete;
+
+  ~task() { destroy(); }
+
+  bool await_ready() const noexcept { return false; }
+
+  /** Start the task, resuming @p awaiting once it finishes. */
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<> awaiting) noexcept {
+    handle_.promise().continuation = awaiting;
+    return handle_;
+  }
+
+  /** The task's result, or rethrow its exception. */
+  T await_resume() { return handle_.promise().result(); }
+
+ private:
+  void destroy() noexcept {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  Handle handle_;
+};
+
+template <typename T>
+task<T> TaskPromise<T>::get_return_object() noexcept {
+  return task<T>{task<T>::Handle::from_promise(*this)};
+}
+
+inline task<void> TaskPromise<void>::get_return_object() noexcept {
+  return task<void>{task<void>::Handle::from_promise(*this)};
+}
+
+/** A coroutine which starts straight away and frees itself once finished. */
+struct DetachedCoroutine {
+  struct promise_type {
+    DetachedCoroutine get_return_object() const noexcept { return {}; }
+    std::suspend_never initial_suspend() const noexcept { return {}; }
+    std::suspend_never final_suspend() const noexcept { return {}; }
+    void return_void() const noexcept {}
+    void unhandled_exception() const noexcept { std::terminate(); }
+  };
+};
+
+/** Run @p work to completion, storing its result in @p promise. */
+template <typename T>
+DetachedCoroutine run_detached(task<T> work, Promise<T> promise) {
+  try {
+    if constexpr (std::is_void_v<T>) {
+      co_await work;
+      promise.set_value();
+    } else {
+      promise.set_value(co_await work);
+    }
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+  }
+}
+
+/**
+ * Start @p work from outside a coroutine.
+ *
+ * The task runs on the calling thread until it first suspends, for example
+ * on @c co_await pool.schedule().
+ *
+ * @return A Future for the task's result.
+ */
+template <typename T>
+Future<T> spawn(task<T> work) {
+  Promise<T> promise;
+  auto future = promise.get_future();
+  run_detached(std::move(work), std::move(promise));
+  return future;
+}
+
+}  // namespace acorn
+
+#endif  // ACORN_HAS_COROUTINES
+
+#endif  // ACORN_THREADS_COROUTINE_H_
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_CPU_TOPOLOGY_H_
+#define ACORN_THREADS_CPU_TOPOLOGY_H_
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace acorn {
+
+/** A set of logical CPU indices, sorted in ascending order. */
+using CpuSet = std::vector<unsigned>;
+
+/**
+ * Parse a CPU list in the format used by the Linux kernel, such as
+ * "0-3,8,10-11".
+ *
+ * @return The listed CPUs, or an empty set if the list is malformed.
+ */
+inline CpuSet parse_cpu_list(std::string const& list) {
+  CpuSet cpus;
+  char const* pos = list.c_str();
+  while (*pos != '\0' && *pos != '\n') {
+    char* end = nullptr;
+    unsigned long first = std::strtoul(pos, &end, 10);
+    if (end == pos) {
+      return {};
+    }
+    unsigned long last = first;
+    pos = end;
+    if (*pos == '-') {
+      ++pos;
+      last = std::strtoul(pos, &end, 10);
+      if (end == pos || last < first) {
+        return {};
+      }
+      pos = end;
+    }
+    for (unsigned long cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(static_cast<unsigned>(cpu));
+    }
+    if (*pos == ',') {
+      ++pos;
+    }
+  }
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+/** The CPUs that the calling thread is allowed to run on. */
+inline CpuSet available_cpus() {
+  CpuSet cpus;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+    return cpus;
+  }
+#endif
+  unsigned n_cpus = std::max(std::thread::hardware_concurrency(), 1u);
+  for (unsigned cpu = 0; cpu < n_cpus; ++cpu) {
+    cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+/**
+ * Pin the calling thread to the given CPUs.
+ *
+ * @return Whether the thread's affinity was changed. This fails if none of
+ * the CPUs are available, or on platforms without thread affinity.
+ */
+inline bool pin_current_thread(CpuSet const& cpus) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (unsigned cpu : cpus) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return CPU_COUNT(&set) > 0 &&
+         pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  static_cast<void>(cpus);
+  return false;
+#endif
+}
+
+/** The CPU the calling thread is currently running on, or -1 if unknown. */
+inline int current_cpu() noexcept {
+#ifdef __linux__
+  return sched_getcpu();
+#else
+  return -1;
+#endif
+}
+
+/** The CPUs available to this process, grouped by NUMA node. */
+struct CpuTopology {
+  /**
+   * The available CPUs on each NUMA node. Nodes without any available CPUs
+   * are left out, so there is always at least one node.
+   */
+  std::vector<CpuSet> nodes;
+
+  /**
+   * Find the available CPUs with sched_getaffinity, and group them using the
+   * NUMA nodes listed in /sys/devices/system/node. If the NUMA layout cannot
+   * be read then all available CPUs are treated as a single node.
+   */
+  static CpuTopology discover() {
+    static char const* const node_root = "/sys/devices/system/node/";
+    CpuSet available = available_cpus();
+    CpuTopology topology;
+
+    std::string line;
+    std::ifstream online{std::string{node_root} + "online"};
+    std::getline(online, line);
+    for (unsigned node : parse_cpu_list(line)) {
+      line.clear();
+      std::ifstream cpulist{std::string{node_root} + "node" +
+                            std::to_string(node) + "/cpulist"};
+      std::getline(cpulist, line);
+      CpuSet node_cpus;
+      for (unsigned cpu : parse_cpu_list(line)) {
+        if (std::binary_search(available.begin(), available.end(), cpu)) {
+          node_cpus.push_back(cpu);
+        }
+      }
+      if (!node_cpus.empty()) {
+        topology.nodes.push_back(std::move(node_cpus));
+      }
+    }
+    if (topology.nodes.empty()) {
+      topology.nodes.push_back(std::move(available));
+    }
+    return topology;
+  }
+
+  /** All the CPUs in the topology, sorted in ascending order. */
+  CpuSet cpus() const {
+    CpuSet all;
+    for (auto const& node : nodes) {
+      all.insert(all.end(), node.begin(), node.end());
+    }
+    std::sort(all.begin(), all.end());
+    return all;
+  }
+};
+
+/**
+ * Worker affinity pinning each worker to a single CPU. CPUs are listed node
+ * by node, so a pool smaller than the machine is packed onto as few nodes as
+ * possible.
+ */
+inline std::vector<CpuSet> per_cpu_affinity(CpuTopology const& topology) {
+  std::vector<CpuSet> affinity;
+  for (auto const& node : topology.nodes) {
+    for (unsigned cpu : node) {
+      affinity.push_back(CpuSet{cpu});
+    }
+  }
+  return affinity;
+}
+
+/**
+ * Worker affinity allowing each worker to run on any CPU of one NUMA node.
+ * Workers are assigned to the nodes in turn, so are spread evenly across them.
+ */
+inline std::vector<CpuSet> per_node_affinity(CpuTopology const& topology) {
+  return topology.nodes;
+}
+
+}  // namespace acorn
+
+#endif  // ACORN_THREADS_CPU_TOPOLOGY_H_
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_EVENT_COUNT_H_
+#define ACORN_THREADS_EVENT_COUNT_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace acorn {
+
+/**
+ * A condition variable for lock-free conditions.
+ *
+ * A thread waiting for some condition first calls prepare_wait, then checks
+ * the condition again. If the condition now holds it calls cancel_wait,
+ * otherwise it calls commit_wait to sleep until notified. A thread making the
+ * condition true calls notify afterwards.
+ *
+ * The waiter count and an epoch are packed into a single atomic, so that
+ * notify only needs a fence and a load when no thread is waiting. The mutex
+ * and condition variable are only touched when a thread actually needs to
+ * sleep or be woken.
+ */
+struct EventCount {
+ private:
+  using Mutex = absl::Mutex;
+  using Lock = absl::MutexLock;
+  using CondVar = absl::CondVar;
+
+  static constexpr uint64_t WaiterIncrement = 1;
+  static constexpr uint64_t WaiterMask = (uint64_t{1} << 32) - 1;
+  static constexpr int EpochShift = 32;
+  static constexpr uint64_t EpochIncrement = uint64_t{1} << EpochShift;
+
+ public:
+  /** Token returned by prepare_wait, to be passed to commit_wait. */
+  struct Key {
+    uint32_t epoch;
+  };
+
+  EventCount() = default;
+  EventCount(EventCount const&) = delete;
+  EventCount& operator=(EventCount const&) = delete;
+
+  /**
+   * Register the calling thread as a waiter. The caller must re-check its
+   * condition after this, then call either cancel_wait or commit_wait.
+   */
+  Key prepare_wait() noexcept {
+    uint64_t prev = state_.fetch_add(WaiterIncrement);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return Key{static_cast<uint32_t>(prev >> EpochShift)};
+  }
+
+  /** Deregister the calling thread as a waiter without sleeping. */
+  void cancel_wait() noexcept { state_.fetch_sub(WaiterIncrement); }
+
+  /**
+   * Sleep until notify is called after the matching prepare_wait, then
+   * deregister the calling thread as a waiter.
+   */
+  void commit_wait(Key key) ABSL_LOCKS_EXCLUDED(mutex_) {
+    {
+      Lock lock{&mutex_};
+      while (epoch() == key.epoch) {
+        cv_.Wait(&mutex_);
+      }
+    }
+    state_.fetch_sub(WaiterIncrement);
+  }
+
+  /**
+   * As commit_wait, but give up waiting once @p timeout has passed.
+   *
+   * @return Whether the thread was notified, rather than timing out.
+   */
+  bool commit_wait_for(Key key, std::chrono::nanoseconds timeout)
+      ABSL_LOCKS_EXCLUDED(mutex_) {
+    bool notified = true;
+    {
+      auto deadline = absl::Now() + absl::FromChrono(timeout);
+      Lock lock{&mutex_};
+      while (epoch() == key.epoch) {
+        if (cv_.WaitWithDeadline(&mutex_, deadline)) {
+          notified = epoch() != key.epoch;
+          break;
+        }
+      }
+    }
+    state_.fetch_sub(WaiterIncrement);
+    return notified;
+  }
+
+  /**
+   * Wake up to @p n_waiters waiting threads. This only takes the mutex if some
+   * thread has called prepare_wait without yet being woken.
+   */
+  void notify(size_t n_waiters = 1) ABSL_LOCKS_EXCLUDED(mutex_) {
+    if (n_waiters == 0) {
+      return;
+    }
+    // Pairs with the fence in prepare_wait, so that either the waiter sees the
+    // caller's change to the condition or the caller sees the waiter.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t state = state_.load(std::memory_order_relaxed);
+    size_t n_waiting = state & WaiterMask;
+    if (n_waiting == 0) {
+      return;
+    }
+    state_.fetch_add(EpochIncrement, std::memory_order_acq_rel);
+    Lock lock{&mutex_};
+    if (n_waiters >= n_waiting) {
+      cv_.SignalAll();
+      return;
+    }
+    for (size_t count = 0; count < n_waiters; ++count) {
+      cv_.Signal();
+    }
+  }
+
+  /** Wake all waiting threads. */
+  void notify_all() ABSL_LOCKS_EXCLUDED(mutex_) {
+    notify(static_cast<size_t>(WaiterMask));
+  }
+
+ private:
+  uint32_t epoch() const noexcept {
+    return static_cast<uint32_t>(state_.load(std::memory_order_acquire) >>
+                                 EpochShift);
+  }
+
+  /** Number of waiters in the low bits, and the epoch in the high bits. */
+  std::atomic<uint64_t> state_{0};
+  /** Mutex used only to sleep and to wake sleeping threads. */
+  Mutex mutex_;
+  /** Condition variable that waiting threads sleep on. */
+  CondVar cv_;
+};
+
+}  // namespace acorn
+
+#endif  // ACORN_THREADS_EVENT_COUNT_H_
@@ -0,0 +1,781 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_FUTURE_H_
+#define ACORN_THREADS_FUTURE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+#include "acorn/threads/event_count.h"
+#include "acorn/threads/unique_task.h"
+
+namespace acorn {
+
+/**
+ * Hook letting a thread that waits on a Future do other useful work instead
+ * of blocking.
+ *
+ * Thread pool workers install a helper for the duration of their loop, so
+ * that a task waiting on the result of another task runs queued tasks until
+ * that result is ready. This avoids both idling the worker and deadlocking a
+ * pool whose workers are all waiting on tasks still in its queue.
+ */
+struct FutureWaitHelper {
+  /** Run one piece of queued work, returning false if there was none. */
+  virtual bool try_run_one() = 0;
+  /** Cheap check for whether try_run_one might find work. */
+  virtual bool has_work() = 0;
+  /** Event notified whenever new work becomes available. */
+  virtual EventCount& work_event() = 0;
+
+  /** The helper installed for the calling thread, if any. */
+  static FutureWaitHelper*& current() noexcept {
+    static thread_local FutureWaitHelper* helper = nullptr;
+    return helper;
+  }
+
+ protected:
+  ~FutureWaitHelper() = default;
+};
+
+/** Installs a FutureWaitHelper for the calling thread within a scope. */
+struct FutureWaitHelperScope {
+  explicit FutureWaitHelperScope(FutureWaitHelper* helper) noexcept
+      : previous_{FutureWaitHelper::current()} {
+    FutureWaitHelper::current() = helper;
+  }
+  FutureWaitHelperScope(FutureWaitHelperScope const&) = delete;
+  FutureWaitHelperScope& operator=(FutureWaitHelperScope const&) = delete;
+  ~FutureWaitHelperScope() { FutureWaitHelper::current() = previous_; }
+
+ private:
+  FutureWaitHelper* const previous_;
+};
+
+/** Storage for the value held in a future's shared state. */
+template <typename T>
+struct FutureStorage {
+  static_assert(!std::is_reference<T>::value,
+                "acorn::Future does not support reference types.");
+
+  FutureStorage() noexcept = default;
+  FutureStorage(FutureStorage const&) = delete;
+  FutureStorage& operator=(FutureStorage const&) = delete;
+  ~FutureStorage() {
+    if (has_value_) {
+      reinterpret_cast<T*>(&storage_)->~T();
+    }
+  }
+
+  template <typename... Args>
+  void emplace(Args&&... args) {
+    new (&storage_) T(std::forward<Args>(args)...);
+    has_value_ = true;
+  }
+
+  T take() { return std::move(*reinterpret_cast<T*>(&storage_)); }
+
+  T copy() const { return *reinterpret_cast<T const*>(&storage_); }
+
+ private:
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_;
+  bool has_value_ = false;
+};
+
+template <>
+struct FutureStorage<void> {
+  void emplace() noexcept {}
+  void take() noexcept {}
+  void copy() const noexcept {}
+};
+
+/**
+ * The state shared between a Promise and its Future.
+ *
+ * The value or exception is written before the state is marked ready, after
+ * which it is only read by the future.
+ */
+template <typename T>
+struct FutureState {
+ private:
+  using Mutex = absl::Mutex;
+  using Lock = absl::MutexLock;
+  using CondVar = absl::CondVar;
+
+ public:
+  /** Store the result and wake any waiters. Must only be called once. */
+  template <typename... Args>
+  void set_value(Args&&... args) ABSL_LOCKS_EXCLUDED(mutex_) {
+    value_.emplace(std::forward<Args>(args)...);
+    mark_ready();
+  }
+
+  /** Store an exception and wake any waiters. Must only be called once. */
+  void set_exception(std::exception_ptr error) ABSL_LOCKS_EXCLUDED(mutex_) {
+    error_ = std::move(error);
+    mark_ready();
+  }
+
+  /** Whether a value or exception has been stored. */
+  bool is_ready() const noexcept {
+    return ready_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Wait until the state is ready. If the calling thread has a
+   * FutureWaitHelper, run other work through it while waiting.
+   */
+  void wait() ABSL_LOCKS_EXCLUDED(mutex_) {
+    if (is_ready()) {
+      return;
+    }
+    auto* helper = FutureWaitHelper::current();
+    if (helper != nullptr) {
+      help_while_waiting(*helper);
+      return;
+    }
+    Lock lock{&mutex_};
+    while (!is_ready()) {
+      ready_cv_.Wait(&mutex_);
+    }
+  }
+
+  /**
+   * Wait until the state is ready or @p timeout has passed, without running
+   * other work.
+   *
+   * @return Whether the state is ready.
+   */
+  bool wait_for(std::chrono::nanoseconds timeout) ABSL_LOCKS_EXCLUDED(mutex_) {
+    if (is_ready()) {
+      return true;
+    }
+    auto deadline = absl::Now() + absl::FromChrono(timeout);
+    Lock lock{&mutex_};
+    while (!is_ready()) {
+      if (ready_cv_.WaitWithDeadline(&mutex_, deadline)) {
+        return is_ready();
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Register @p continuation to be called on the thread that makes the state
+   * ready, once it is. The continuation must not throw.
+   *
+   * @return Whether the continuation was registered, or false if the state is
+   * already ready, in which case the caller should run it directly.
+   */
+  bool add_continuation(UniqueTask&& continuation)
+      ABSL_LOCKS_EXCLUDED(mutex_) {
+    Lock lock{&mutex_};
+    if (is_ready()) {
+      return false;
+    }
+    continuations_.push_back(std::move(continuation));
+    return true;
+  }
+
+  /** Move the result out of a ready state, or throw its exception. */
+  T take() {
+    assert(is_ready());
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    return value_.take();
+  }
+
+ private:
+  void mark_ready() ABSL_LOCKS_EXCLUDED(mutex_) {
+    std::vector<UniqueTask> continuations;
+    {
+      Lock lock{&mutex_};
+      ready_.store(true, std::memory_order_release);
+      // Helpers' events are notified under the mutex, so that a helping
+      // waiter cannot return, and let its event be destroyed, during the
+      // notify.
+      for (auto* event : helper_events_) {
+        event->notify_all();
+      }
+      ready_cv_.SignalAll();
+      continuations.swap(continuations_);
+    }
+    for (auto& continuation : continuations) {
+      continuation();
+    }
+  }
+
+  /** Run work through @p helper until the state is ready. */
+  void help_while_waiting(FutureWaitHelper& helper)
+      ABSL_LOCKS_EXCLUDED(mutex_) {
+    auto& event = helper.work_event();
+    {
+      Lock lock{&mutex_};
+      helper_events_.push_back(&event);
+    }
+    while (!is_ready()) {
+      if (helper.try_run_one()) {
+        continue;
+      }
+      auto key = event.prepare_wait();
+      if (is_ready() || helper.has_work()) {
+        event.cancel_wait();
+        continue;
+      }
+      event.commit_wait(key);
+    }
+    Lock lock{&mutex_};
+    helper_events_.erase(
+        std::find(helper_events_.begin(), helper_events_.end(), &event));
+  }
+
+  /** Set once the value or exception has been stored. */
+  std::atomic<bool> ready_{false};
+  /** The stored value, if any. */
+  FutureStorage<T> value_;
+  /** The stored exception, if any. */
+  std::exception_ptr error_;
+  /** Mutex guarding the waiters. */
+  Mutex mutex_;
+  /** Signalled when the state becomes ready. */
+  CondVar ready_cv_;
+  /** Events of helping waiters to notify when the state becomes ready. */
+  std::vector<EventCount*> helper_events_ ABSL_GUARDED_BY(mutex_);
+  /** Callbacks to run once the state becomes ready. */
+  std::vector<UniqueTask> continuations_ ABSL_GUARDED_BY(mutex_);
+};
+
+template <typename T>
+struct Promise;
+
+/** The result type of a continuation @p Function of a Future<T>. */
+template <typename T, typename Function>
+struct ContinuationResultOf {
+  using type = decltype(std::declval<Function&>()(std::declval<T>()));
+};
+
+template <typename Function>
+struct ContinuationResultOf<void, Function> {
+  using type = decltype(std::declval<Function&>()());
+};
+
+/** @copydoc ContinuationResultOf */
+template <typename T, typename Function>
+using ContinuationResult =
+    typename ContinuationResultOf<T, typename std::decay<Function>::type>::type;
+
+/**
+ * The result of an asynchronous operation, returned by pool submissions.
+ *
+ * Unlike @c std::future, waiting on an acorn::Future from a thread pool worker
+ * runs other queued tasks from the worker's pool until the result is ready,
+ * so that tasks can wait on tasks they submit without blocking the worker or
+ * deadlocking the pool.
+ *
+ * A future can also be awaited with @c co_await from a C++20 coroutine, which
+ * is suspended until the result is ready and then resumed on the thread that
+ * made it ready, or chained with then, when_all and when_any, which never
+ * block a thread.
+ */
+template <typename T>
+struct Future {
+  Future() noexcept = default;
+  explicit Future(std::shared_ptr<FutureState<T>> state) noexcept
+      : state_{std::move(state)} {}
+
+  Future(Future&&) noexcept = default;
+  Future& operator=(Future&&) noexcept = default;
+  Future(Future const&) = delete;
+  Future& operator=(Future const&) = delete;
+
+  /** Whether the future refers to a shared state. */
+  bool valid() const noexcept { return static_cast<bool>(state_); }
+
+  /** Whether the result is available, so get will not wait. */
+  bool is_ready() const noexcept {
+    assert(valid());
+    return state_->is_ready();
+  }
+
+  /**
+   * Wait for the result to be available. On a thread pool worker this runs
+   * other queued tasks while waiting.
+   */
+  void wait() const {
+    assert(valid());
+    state_->wait();
+  }
+
+  /**
+   * Wait for the result to be available for at most @p timeout. This blocks
+   * without running other tasks.
+   */
+  template <typename Rep, typename Period>
+  std::future_status wait_for(
+      std::chrono::duration<Rep, Period> const& timeout) const {
+    assert(valid());
+    return state_->wait_for(
+               std::chrono::duration_cast<std::chrono::nanoseconds>(timeout))
+               ? std::future_status::ready
+               : std::future_status::timeout;
+  }
+
+  /**
+   * Wait for the result as for wait, then return it, or throw the exception
+   * stored in its place. The future is no longer valid afterwards.
+   */
+  T get() {
+    wait();
+    auto state = std::move(state_);
+    return state->take();
+  }
+
+  /**
+   * Register @p continuation to be called once the result is ready, on the
+   * thread that makes it ready. The continuation must not throw.
+   *
+   * @return Whether the continuation was registered, or false if the result
+   * is already available, in which case the caller should run it directly.
+   */
+  bool add_continuation(UniqueTask&& continuation) {
+    assert(valid());
+    return state_->add_continuation(std::move(continuation));
+  }
+
+  /**
+   * Chain @p func to be called with the result once it is ready, without
+   * blocking.
+   *
+   * @p func is called with the value, or with no arguments for a
+   * Future<void>, on the thread that makes the result ready, or on the
+   * calling thread if it already is ready, so it should be short. Use
+   * then(executor, func) to queue longer continuations on a pool instead. If
+   * the result is an exception, @p func is not called and the exception is
+   * passed on to the returned future.
+   *
+   * This future is no longer valid afterwards.
+   *
+   * @return A future for the value returned by @p func.
+   */
+  template <typename Function>
+  auto then(Function&& func) -> Future<ContinuationResult<T, Function>> {
+    using Return = ContinuationResult<T, Function>;
+    assert(valid());
+    Promise<Return> promise;
+    auto result = promise.get_future();
+    auto state = std::move(state_);
+    UniqueTask continuation{[state, promise = std::move(promise),
+                             func = std::forward<Function>(func)]() mutable {
+      continue_with(*state, promise, func);
+    }};
+    if (!state->add_continuation(std::move(continuation))) {
+      continuation();
+    }
+    return result;
+  }
+
+  /**
+   * Chain @p func to be called with the result as for then(func), but queue
+   * it on @p executor, such as a thread pool, once the result is ready rather
+   * than calling it inline.
+   *
+   * @param executor [in] Executor with an @c execute(UniqueTask&&) member,
+   *        which must outlive the returned future being made ready.
+   */
+  template <typename Executor, typename Function>
+  auto then(Executor& executor, Function&& func)
+      -> Future<ContinuationResult<T, Function>> {
+    using Return = ContinuationResult<T, Function>;
+    assert(valid());
+    Promise<Return> promise;
+    auto result = promise.get_future();
+    auto state = std::move(state_);
+    UniqueTask work{[state, promise = std::move(promise),
+                     func = std::forward<Function>(func)]() mutable {
+      continue_with(*state, promise, func);
+    }};
+    UniqueTask continuation{[&executor, work = std::move(work)]() mutable {
+      executor.execute(std::move(work));
+    }};
+    if (!state->add_continuation(std::move(continuation))) {
+      continuation();
+    }
+    return result;
+  }
+
+  /** Coroutine support: whether the result is ready without suspending. */
+  bool await_ready() const noexcept { return is_ready(); }
+
+  /**
+   * Coroutine support: resume @p awaiting once the result is ready, or
+   * straight away if it already is.
+   */
+  template <typename Handle>
+  bool await_suspend(Handle awaiting) {
+    return add_continuation(
+        UniqueTask{[awaiting]() mutable { awaiting.resume(); }});
+  }
+
+  /** Coroutine support: the result, as returned by get. */
+  T await_resume() { return get(); }
+
+ private:
+  std::shared_ptr<FutureState<T>> state_;
+};
+
+/**
+ * The producing side of a Future.
+ *
+ * Destroying a promise without setting a value or exception stores a
+ * @c std::future_error with @c std::future_errc::broken_promise.
+ */
+template <typename T>
+struct Promise {
+  Promise() : state_{std::make_shared<FutureState<T>>()} {}
+
+  Promise(Promise&&) noexcept = default;
+  Promise& operator=(Promise&& other) noexcept {
+    abandon();
+    state_ = std::move(other.state_);
+    future_retrieved_ = other.future_retrieved_;
+    satisfied_ = other.satisfied_;
+    return *this;
+  }
+  Promise(Promise const&) = delete;
+  Promise& operator=(Promise const&) = delete;
+
+  ~Promise() { abandon(); }
+
+  /** The future sharing this promise's state. Must only be called once. */
+  Future<T> get_future() {
+    assert(state_ && !future_retrieved_);
+    future_retrieved_ = true;
+    return Future<T>{state_};
+  }
+
+  /**
+   * Store the result, making the future ready. Must only be called once,
+   * along with set_exception.
+   */
+  template <typename... Args>
+  void set_value(Args&&... args) {
+    // Continuations run by the state may destroy this promise, so the state
+    // is kept alive by a local reference.
+    auto state = claim();
+    state->set_value(std::forward<Args>(args)...);
+  }
+
+  /** Store an exception, making the future ready. */
+  void set_exception(std::exception_ptr error) {
+    auto state = claim();
+    state->set_exception(std::move(error));
+  }
+
+ private:
+  /** Mark the promise as satisfied, returning its state. */
+  std::shared_ptr<FutureState<T>> claim() noexcept {
+    assert(state_ && !satisfied_);
+    satisfied_ = true;
+    return state_;
+  }
+
+  void abandon() {
+    if (state_ && !satisfied_) {
+      set_exception(std::make_exception_ptr(
+          std::future_error{std::future_errc::broken_promise}));
+    }
+  }
+
+  std::shared_ptr<FutureState<T>> state_;
+  bool future_retrieved_ = false;
+  bool satisfied_ = false;
+};
+
+/** Fulfil @p promise with the result of calling @p func, or its exception. */
+template <typename T, typename Function>
+void fulfil_promise(Promise<T>& promise, Function& func) {
+  try {
+    promise.set_value(func());
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+  }
+}
+
+/** @copydoc fulfil_promise */
+template <typename Function>
+void fulfil_promise(Promise<void>& promise, Function& func) {
+  try {
+    func();
+    promise.set_value();
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+  }
+}
+
+/** Call @p func with the value held in a ready @p state. */
+template <typename T, typename Function>
+auto call_with_result(FutureState<T>& state, Function& func)
+    -> decltype(func(state.take())) {
+  return func(state.take());
+}
+
+/** @copydoc call_with_result */
+template <typename Function>
+auto call_with_result(FutureState<void>& state, Function& func)
+    -> decltype(func()) {
+  state.take();
+  return func();
+}
+
+/**
+ * Fulfil @p promise with the result of calling the continuation @p func with
+ * the value in @p state, or with the exception in @p state or thrown by
+ * @p func.
+ */
+template <typename T, typename Return, typename Function>
+void continue_with(FutureState<T>& state, Promise<Return>& promise,
+                   Function& func) {
+  auto call = [&state, &func] { return call_with_result(state, func); };
+  fulfil_promise(promise, call);
+}
+
+/** Whether @p T is an acorn::Future. */
+template <typename T>
+struct IsFuture : std::false_type {};
+
+template <typename T>
+struct IsFuture<Future<T>> : std::true_type {};
+
+/** The number of futures held in a vector or tuple of futures. */
+template <typename T>
+size_t future_count(std::vector<Future<T>> const& futures) noexcept {
+  return futures.size();
+}
+
+/** @copydoc future_count */
+template <typename... Ts>
+constexpr size_t future_count(std::tuple<Future<Ts>...> const&) noexcept {
+  return sizeof...(Ts);
+}
+
+/** Call @p func with each future in a vector, along with its index. */
+template <typename T, typename Function>
+void for_each_future(std::vector<Future<T>>& futures, Function&& func) {
+  for (size_t index = 0; index < futures.size(); ++index) {
+    func(futures[index], index);
+  }
+}
+
+template <typename Tuple, typename Function, size_t... Indices>
+void for_each_future(Tuple& futures, Function& func,
+                     std::index_sequence<Indices...>) {
+  using Expand = int[];
+  static_cast<void>(
+      Expand{0, (func(std::get<Indices>(futures), Indices), 0)...});
+}
+
+/** Call @p func with each future in a tuple, along with its index. */
+template <typename... Ts, typename Function>
+void for_each_future(std::tuple<Future<Ts>...>& futures, Function&& func) {
+  for_each_future(futures, func, std::index_sequence_for<Ts...>{});
+}
+
+/** Shared state of a when_all, completed once every future is ready. */
+template <typename Sequence>
+struct WhenAllState {
+  explicit WhenAllState(Sequence&& futures)
+      : futures{std::move(futures)}, pending{future_count(this->futures) + 1} {}
+
+  /** Mark one more future, or the registration of continuations, as done. */
+  void done_one() {
+    if (pending.fetch_sub(1) == 1) {
+      promise.set_value(std::move(futures));
+    }
+  }
+
+  Sequence futures;
+  /** Futures still pending, plus one until every continuation is added. */
+  std::atomic<size_t> pending;
+  Promise<Sequence> promise;
+};
+
+/** Future for when every future in @p futures is ready. */
+template <typename Sequence>
+Future<Sequence> when_all_of(Sequence&& futures) {
+  auto state = std::make_shared<WhenAllState<Sequence>>(std::move(futures));
+  auto result = state->promise.get_future();
+  for_each_future(state->futures, [&state](auto& future, size_t) {
+    if (!future.add_continuation(UniqueTask{[state] { state->done_one(); }})) {
+      state->done_one();
+    }
+  });
+  state->done_one();
+  return result;
+}
+
+/**
+ * The result of when_any: the futures passed in, along with the index of one
+ * that is ready.
+ */
+template <typename Sequence>
+struct WhenAnyResult {
+  /** Index of a ready future, or @c size_t(-1) if there were no futures. */
+  size_t index;
+  /** The futures passed to when_any. */
+  Sequence futures;
+};
+
+/** Shared state of a when_any, completed once one future is ready. */
+template <typename Sequence>
+struct WhenAnyState {
+  static constexpr size_t NoIndex = static_cast<size_t>(-1);
+
+  explicit WhenAnyState(Sequence&& futures) : futures{std::move(futures)} {}
+
+  /** Record that the future at @p i is ready, if it is the first. */
+  void ready(size_t i) {
+    size_t none = NoIndex;
+    if (index.compare_exchange_strong(none, i)) {
+      done_one();
+    }
+  }
+
+  /**
+   * Mark either the first ready future or the registration of continuations
+   * as done, as the futures cannot be moved out until both are.
+   */
+  void done_one() {
+    if (pending.fetch_sub(1) == 1) {
+      promise.set_value(
+          WhenAnyResult<Sequence>{index.load(), std::move(futures)});
+    }
+  }
+
+  Sequence futures;
+  std::atomic<size_t> index{NoIndex};
+  std::atomic<int> pending{2};
+  Promise<WhenAnyResult<Sequence>> promise;
+};
+
+/** Future for when any future in @p futures is ready. */
+template <typename Sequence>
+Future<WhenAnyResult<Sequence>> when_any_of(Sequence&& futures) {
+  auto state = std::make_shared<WhenAnyState<Sequence>>(std::move(futures));
+  auto result = state->promise.get_future();
+  if (future_count(state->futures) == 0) {
+    state->ready(WhenAnyState<Sequence>::NoIndex);
+  }
+  for_each_future(state->futures, [&state](auto& future, size_t index) {
+    if (!future.add_continuation(
+            UniqueTask{[state, index] { state->ready(index); }})) {
+      state->ready(index);
+    }
+  });
+  state->done_one();
+  return result;
+}
+
+/**
+ * Combine the futures in [first, last) into one which is ready once all of
+ * them are, without blocking. The futures are moved out of the range.
+ *
+ * @return A future for a vector of the futures, all of them ready, so that
+ * each value or exception can be taken with get.
+ */
+template <typename Iterator,
+          typename std::enable_if<!IsFuture<Iterator>::value, int>::type = 0>
+auto when_all(Iterator first, Iterator last) -> Future<
+    std::vector<typename std::iterator_traits<Iterator>::value_type>> {
+  using Sequence =
+      std::vector<typename std::iterator_traits<Iterator>::value_type>;
+  return when_all_of(
+      Sequence(std::make_move_iterator(first), std::make_move_iterator(last)));
+}
+
+/**
+ * Combine @p futures into one which is ready once all of them are, without
+ * blocking.
+ *
+ * @return A future for a tuple of the futures, all of them ready.
+ */
+template <typename... Ts>
+auto when_all(Future<Ts>... futures) -> Future<std::tuple<Future<Ts>...>> {
+  return when_all_of(std::tuple<Future<Ts>...>{std::move(futures)...});
+}
+
+/**
+ * Combine the futures in [first, last) into one which is ready once any of
+ * them is, without blocking. The futures are moved out of the range.
+ *
+ * @return A future for the futures along with the index of one that is ready.
+ */
+template <typename Iterator,
+          typename std::enable_if<!IsFuture<Iterator>::value, int>::type = 0>
+auto when_any(Iterator first, Iterator last) -> Future<WhenAnyResult<
+    std::vector<typename std::iterator_traits<Iterator>::value_type>>> {
+  using Sequence =
+      std::vector<typename std::iterator_traits<Iterator>::value_type>;
+  return when_any_of(
+      Sequence(std::make_move_iterator(first), std::make_move_iterator(last)));
+}
+
+/**
+ * Combine @p futures into one which is ready once any of them is, without
+ * blocking.
+ *
+ * @return A future for the futures along with the index of one that is ready.
+ */
+template <typename... Ts>
+auto when_any(Future<Ts>... futures)
+    -> Future<WhenAnyResult<std::tuple<Future<Ts>...>>> {
+  return when_any_of(std::tuple<Future<Ts>...>{std::move(futures)...});
+}
+
+}  // namespace acorn
+
+#endif  // ACORN_THREADS_FUTURE_H_
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_IDLE_POLICY_H_
+#define ACORN_THREADS_IDLE_POLICY_H_
+
+#include <chrono>
+#include <thread>
+#include <utility>
+
+#include "acorn/threads/event_count.h"
+
+namespace acorn {
+
+/**
+ * How an idle worker waits for new work.
+ *
+ * The worker first spins, checking for work between short CPU pauses, then
+ * checks for work between yields of its time slice, and finally parks on an
+ * EventCount until a new task is submitted. Spinning and yielding let a worker
+ * pick up a task submitted shortly after it went idle without the submitter
+ * paying for a wake up or the worker for a context switch, at the cost of
+ * burning CPU while idle.
+ */
+struct IdlePolicy {
+  /** Number of times to check for work between CPU pauses. */
+  unsigned spin_count = 0;
+  /** Number of times to check for work between yields. */
+  unsigned yield_count = 0;
+
+  /** Park as soon as there is no work, without spinning or yielding. */
+  static constexpr IdlePolicy park() noexcept { return IdlePolicy{0, 0}; }
+
+  /** Spin and yield for a while before parking, to reduce latency. */
+  static constexpr IdlePolicy spin_then_park() noexcept {
+    return IdlePolicy{1024, 16};
+  }
+};
+
+/** Hint to the CPU that the calling thread is in a spin wait loop. */
+inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
+/**
+ * Wait for work following the given idle policy, giving up once parked for
+ * @p timeout.
+ *
+ * @param policy [in] How to wait before parking.
+ * @param event [in] Event count that is notified whenever new work is added.
+ * @param is_available [in] Callable returning whether work may be available,
+ *        which must be cheap and must not block.
+ * @param try_take [in] Callable which tries to take some work, returning
+ *        whether it succeeded.
+ * @param timeout [in] How long to stay parked before giving up. A maximal
+ *        timeout waits indefinitely.
+ * @return Whether some work was taken, rather than timing out.
+ */
+template <typename IsAvailable, typename TryTake>
+bool idle_wait_for(IdlePolicy const& policy, EventCount& event,
+                   IsAvailable&& is_available, TryTake&& try_take,
+                   std::chrono::nanoseconds timeout) {
+  using Clock = std::chrono::steady_clock;
+
+  for (unsigned count = 0; count < policy.spin_count; ++count) {
+    if (is_available() && try_take()) {
+      return true;
+    }
+    cpu_relax();
+  }
+  for (unsigned count = 0; count < policy.yield_count; ++count) {
+    if (is_available() && try_take()) {
+      return true;
+    }
+    std::this_thread::yield();
+  }
+  bool const timed = timeout != std::chrono::nanoseconds::max();
+  auto const deadline = timed ? Clock::now() + timeout : Clock::time_point{};
+  while (true) {
+    auto key = event.prepare_wait();
+    if (try_take()) {
+      event.cancel_wait();
+      return true;
+    }
+    if (!timed) {
+      event.commit_wait(key);
+    } else {
+      auto remaining = deadline - Clock::now();
+      if (remaining <= Clock::duration::zero()) {
+        event.cancel_wait();
+        return try_take();
+      }
+      if (!event.commit_wait_for(
+              key, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       remaining))) {
+        return try_take();
+      }
+    }
+    if (try_take()) {
+      return true;
+    }
+  }
+}
+
+/**
+ * Wait for work following the given idle policy.
+ *
+ * @param policy [in] How to wait before parking.
+ * @param event [in] Event count that is notified whenever new work is added.
+ * @param is_available [in] Callable returning whether work may be available,
+ *        which must be cheap and must not block.
+ * @param try_take [in] Callable which tries to take some work, returning
+ *        whether it succeeded.
+ */
+template <typename IsAvailable, typename TryTake>
+void idle_wait(IdlePolicy const& policy, EventCount& event,
+               IsAvailable&& is_available, TryTake&& try_take) {
+  idle_wait_for(policy, event, std::forward<IsAvailable>(is_available),
+                std::forward<TryTake>(try_take),
+                std::chrono::nanoseconds::max());
+}
+
+}  // namespace acorn
+
+#endif  // ACORN_THREADS_IDLE_POLICY_H_
@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_PARALLEL_FOR_H_
+#define ACORN_THREADS_PARALLEL_FOR_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+
+namespace acorn {
+
+/**
+ * Shared state of a parallel loop, split into fixed size chunks of indices.
+ *
+ * Chunks are claimed one at a time from an atomic counter by the calling
+ * thread and any pool workers helping it, so threads which get cheap chunks
+ * simply claim more of them. This keeps all threads busy even when the cost of
+ * each index is very uneven.
+ *
+ * @tparam Index Integral type of the loop indices.
+ * @tparam ChunkFunction Callable taking the chunk number and the first and
+ *         one past last indices in the chunk.
+ */
+template <typename Index, typename ChunkFunction>
+struct ParallelChunkState {
+ private:
+  using Mutex = absl::Mutex;
+  using Lock = absl::MutexLock;
+
+ public:
+  ParallelChunkState(Index begin, Index end, Index grain, size_t n_chunks,
+                     ChunkFunction* func)
+      : begin_{begin},
+        end_{end},
+        grain_{grain},
+        n_chunks_{n_chunks},
+        func_{func} {}
+
+  /**
+   * Claim and run chunks until there are none left.
+   *
+   * This may be called after the loop has completed, in which case no chunks
+   * are claimed and the chunk function is never touched.
+   */
+  void run_chunks() {
+    size_t chunk;
+    while ((chunk = next_chunk_.fetch_add(1, std::memory_order_relaxed)) <
+           n_chunks_) {
+      Index first = begin_ + static_cast<Index>(chunk) * grain_;
+      Index last = end_ - first > grain_ ? first + grain_ : end_;
+      try {
+        (*func_)(chunk, first, last);
+      } catch (...) {
+        Lock lock{&mutex_};
+        if (!error_) {
+          error_ = std::current_exception();
+        }
+      }
+      if (n_done_.fetch_add(1, std::memory_order_acq_rel) + 1 == n_chunks_) {
+        done_.Notify();
+      }
+    }
+  }
+
+  /**
+   * Wait for all chunks to complete, then rethrow the first exception thrown
+   * by any chunk.
+   */
+  void wait() {
+    done_.WaitForNotification();
+    Lock lock{&mutex_};
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+ private:
+  Index const begin_;
+  Index const end_;
+  Index const grain_;
+  size_t const n_chunks_;
+  /** The loop body. Only valid until the last chunk completes. */
+  ChunkFunction* const func_;
+  /** The next chunk to be claimed. */
+  std::atomic<size_t> next_chunk_{0};
+  /** The number of chunks completed. */
+  std::atomic<size_t> n_done_{0};
+  /** Notified once all chunks are complete. */
+  absl::Notification done_;
+  /** Mutex guarding the stored exception. */
+  Mutex mutex_;
+  /** The first exception thrown by a chunk, if any. */
+  std::exception_ptr error_ ABSL_GUARDED_BY(mutex_);
+};
+
+/**
+ * Default number of indices in each chunk of a parallel loop.
+ *
+ * This gives each worker several chunks, so that the load can be rebalanced
+ * if some chunks take longer than others.
+ */
+template <typename Index>
+Index default_parallel_grain(Index n_indices, size_t n_threads) {
+  constexpr size_t ChunksPerThread = 8;
+  auto n_chunks = static_cast<Index>(std::max<size_t>(n_threads, 1) *
+                                     ChunksPerThread);
+  return std::max<Index>(n_indices / n_chunks, 1);
+}
+
+/**
+ * Run @p func on every chunk of the range [begin, end) using the calling
+ * thread and workers from @p pool.
+ *
+ * The calling thread runs chunks itself, so this makes progress even if all
+ * of the pool's workers are busy, and can safely be called from a task running
+ * on the pool.
+ *
+ * @tparam Pool Thread pool providing @c size() and @c execute_tasks.
+ */
+template <typename Pool, typename Index, typename ChunkFunction>
+void parallel_chunks(Pool& pool, Index begin, Index end, Index grain,
+                     ChunkFunction& func) {
+  static_assert(std::is_integral<Index>::value,
+                "Parallel loops need integral indices.");
+  if (!(begin < end)) {
+    return;
+  }
+  grain = std::max<Index>(grain, 1);
+  auto n_indices = end - begin;
+  auto n_chunks = static_cast<size_t>(n_indices / grain) +
+                  static_cast<size_t>(n_indices % grain != 0);
+  if (n_chunks == 1) {
+    func(size_t{0}, begin, end);
+    return;
+  }
+
+  // Workers may only get to a helper task after the loop is finished, so the
+  // helpers share ownership of the state.
+  using State = ParallelChunkState<Index, ChunkFunction>;
+  auto state = std::make_shared<State>(begin, end, grain, n_chunks, &func);
+  auto helper = [state] { state->run_chunks(); };
+  size_t n_helpers = std::min(pool.size(), n_chunks - 1);
+  std::vector<decltype(helper)> helpers(n_helpers, helper);
+  pool.execute_tasks(helpers.begin(), helpers.end());
+
+  state->run_chunks();
+  state->wait();
+}
+
+/**
+ * Call @p body with each index in [begin, end) in parallel, using the calling
+ * thread and workers from @p pool.
+ *
+ * The range is split into chunks of @p grain indices which are handed out to
+ * threads as they become free. The call blocks until every index has been
+ * processed. If any call to @p body throws, the first exception is rethrown
+ * once all chunks are complete.
+ *
+ * @param pool [in] Thread pool providing extra threads to run the loop.
+ * @param begin [in] First index in the range.
+ * @param end [in] One past the last index in the range.
+ * @param grain [in] Number of consecutive indices processed in one chunk.
+ * @param body [in] Callable taking a single index.
+ */
+template <typename Pool, typename Index, typename Body>
+void parallel_for(Pool& pool, Index begin, Index end, Index grain,
+                  Body&& body) {
+  auto chunk_func = [&body](size_t, Index first, Index last) {
+    for (Index index = first; index < last; ++index) {
+      body(index);
+    }
+  };
+  parallel_chunks(pool, begin, end, grain, chunk_func);
+}
+
+/**
+ * Call @p body with each index in [begin, end) in parallel, with a grain size
+ * chosen from the size of the range and the number of threads in the pool.
+ */
+template <typename Pool, typename Index, typename Body>
+void parallel_for(Pool& pool, Index begin, Index end, Body&& body) {
+  Index grain = begin < end ? default_parallel_grain(end - begin, pool.size())
+                            : Index{1};
+  parallel_for(pool, begin, end, grain, std::forward<Body>(body));
+}
+
+/** A single partial result of a parallel reduction. */
+template <typename T>
+struct ParallelReducePartial {
+  T value;
+};
+
+/**
+ * Map each index in [begin, end) to a value and combine all the values in
+ * parallel, using the calling thread and workers from @p pool.
+ *
+ * Each chunk of @p grain indices is reduced to a partial result starting from
+ * @p identity, then the partial results are combined in index order on the
+ * calling thread. As such @p combine need only be associative, not
+ * commutative.
+ *
+ * @param pool [in] Thread pool providing extra threads to run the loop.
+ * @param begin [in] First index in the range.
+ * @param end [in] One past the last index in the range.
+ * @param grain [in] Number of consecutive indices processed in one chunk.
+ * @param identity [in] Identity value for @p combine.
+ * @param map [in] Callable taking an index and returning a value.
+ * @param combine [in] Callable taking two values and returning their
+ *        combination.
+ * @return The combination of the mapped values of every index.
+ */
+template <typename Pool, typename Index, typename T, typename Map,
+          typename Combine>
+T parallel_reduce(Pool& pool, Index begin, Index end, Index grain, T identity,
+                  Map&& map, Combine&& combine) {
+  if (!(begin < end)) {
+    return identity;
+  }
+  grain = std::max<Index>(grain, 1);
+  auto n_indices = end - begin;
+  auto n_chunks = static_cast<size_t>(n_indices / grain) +
+                  static_cast<size_t>(n_indices % grain != 0);
+
+  std::vector<ParallelReducePartial<T>> partials(
+      n_chunks, ParallelReducePartial<T>{identity});
+  auto chunk_func = [&](size_t chunk, Index first, Index last) {
+    T value = identity;
+    for (Index index = first; index < last; ++index) {
+      value = combine(std::move(value), map(index));
+    }
+    partials[chunk].value = std::move(value);
+  };
+  parallel_chunks(pool, begin, end, grain, chunk_func);
+
+  T result = std::move(identity);
+  for (auto& partial : partials) {
+    result = combine(std::move(result), std::move(partial.value));
+  }
+  return result;
+}
+
+/**
+ * Map and combine each index in [begin, end) in parallel, with a grain size
+ * chosen from the size of the range and the number of threads in the pool.
+ */
+template <typename Pool, typename Index, typename T, typename Map,
+          typename Combine>
+T parallel_reduce(Pool& pool, Index begin, Index end, T identity, Map&& map,
+                  Combine&& combine) {
+  Index grain = begin < end ? default_parallel_grain(end - begin, pool.size())
+                            : Index{1};
+  return parallel_reduce(pool, begin, end, grain, std::move(identity),
+                         std::forward<Map>(map),
+                         std::forward<Combine>(combine));
+}
+
+}  // namespace acorn
+
+#endif  // ACORN_THREADS_PARALLEL_FOR_H_
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_POOL_OPTIONS_H_
+#define ACORN_THREADS_POOL_OPTIONS_H_
+
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <vector>
+
+#include "acorn/threads/cpu_topology.h"
+#include "acorn/threads/idle_policy.h"
+
+namespace acorn {
+
+/** Priority lanes that tasks can be submitted to. */
+enum class TaskPriority {
+  /** Latency critical tasks, taken ahead of all others. */
+  high,
+  /** The default priority. */
+  normal,
+  /** Bulk work that can wait until the pool is otherwise idle. */
+  background,
+};
+
+/** What a thread pool does with queued tasks when it shuts down. */
+enum class ShutdownMode {
+  /** Run every queued task before the workers exit. */
+  drain,
+  /**
+   * Drop queued tasks without running them, storing TaskCancelled in their
+   * futures. Running tasks still finish.
+   */
+  discard,
+};
+
+/**
+ * What adding a task does once a pool already has PoolOptions::max_queued
+ * tasks waiting to start.
+ */
+enum class BackpressurePolicy {
+  /** Wait until a worker starts a task, freeing up space. */
+  block,
+  /** Run the task straight away on the calling thread instead of queuing it. */
+  caller_runs,
+};
+
+/** The number of TaskPriority lanes. */
+constexpr size_t NumTaskPriorities = 3;
+
+/**
+ * Maximum number of tasks a worker runs from its run_next slot in a row before
+ * going back to the shared queue.
+ */
+constexpr unsigned RunNextChainLimit = 32;
+
+/**
+ * Number of tasks taken from a queue with priority lanes for each aged task
+ * taken ahead of a higher lane. Once a backlog of lower priority work has aged
+ * past PoolOptions::priority_aging, the remaining tasks taken still come from
+ * the highest lane, so that higher priority tasks are only slowed down rather
+ * than stuck behind the whole backlog.
+ */
+constexpr unsigned PriorityAgingInterval = 4;
+
+/**
+ * Handler called on a worker thread with any exception thrown by a task that
+ * was added without a future.
+ */
+using PoolErrorHandler = std::function<void(std::exception_ptr)>;
+
+/** Options used to configure a thread pool. */
+struct PoolOptions {
+  /** How idle workers wait for new tasks. */
+  IdlePolicy idle_policy = IdlePolicy::park();
+  /**
+   * Handler for exceptions thrown by tasks added without a future. If this is
+   * empty such an exception will call @c std::terminate, as for an exception
+   * escaping a @c std::thread.
+   */
+  PoolErrorHandler error_handler = {};
+  /**
+   * CPUs that each worker is pinned to, where worker @c i is pinned to
+   * @c worker_affinity[i % worker_affinity.size()]. Workers are left free to
+   * run on any CPU if this is empty, or if pinning fails.
+   *
+   * See per_cpu_affinity and per_node_affinity for common placements.
+   */
+  std::vector<CpuSet> worker_affinity = {};
+  /**
+   * How long a task can wait in a queue with priority lanes before it is
+   * taken ahead of tasks in higher priority lanes, so that a steady stream of
+   * high priority work cannot starve the lower lanes. No more than one in
+   * every PriorityAgingInterval tasks is taken early in this way.
+   */
+  std::chrono::nanoseconds priority_aging = std::chrono::milliseconds{50};
+  /**
+   * Maximum number of workers. If this is more than the number of workers the
+   * pool is constructed with, the pool adds workers while tasks are backed
+   * up, and retires the extra workers again once they are idle.
+   */
+  unsigned max_threads = 0;
+  /**
+   * How long every worker must stay busy, with tasks still being submitted,
+   * before another worker is added.
+   */
+  std::chrono::nanoseconds grow_after = std::chrono::milliseconds{1};
+  /**
+   * How long a worker above the pool's minimum size may idle before exiting.
+   */
+  std::chrono::nanoseconds idle_timeout = std::chrono::seconds{10};
+  /**
+   * Length of each tick of the timer wheel used by add_task_at, add_task_after
+   * and add_periodic. Delayed tasks run up to one tick after their deadline.
+   */
+  std::chrono::nanoseconds timer_resolution = std::chrono::milliseconds{1};
+  /** What the pool's destructor does with tasks that are still queued. */
+  ShutdownMode shutdown_mode = ShutdownMode::drain;
+  /**
+   * Give each worker a LIFO run_next slot. A task submitted from one of the
+   * pool's workers goes into that worker's slot instead of the shared queue,
+   * and runs on the same worker as soon as its current task finishes, while
+   * the data it shares with its parent is still in cache. Any task already in
+   * the slot is moved to the shared queue.
+   *
+   * Filling an empty slot wakes an idle worker, which can steal the task once
+   * it finds nothing else queued, so the slot trades locality for
+   * parallelism: follow-up tasks only stay on the submitting worker while the
+   * other workers are busy, which is when the shared queue would otherwise
+   * delay them. A worker that has run RunNextChainLimit slot tasks in a row
+   * moves the slot to the shared queue, so that chains of follow-up tasks
+   * cannot starve queued work.
+   */
+  bool run_next = false;
+  /**
+   * Maximum number of tasks a worker takes from the shared queue at once. With
+   * more than one, a worker moves a batch of tasks into its own buffer under a
+   * single acquisition of the queue, and runs them before going back to the
+   * queue, so that short tasks do not pay for a lock round trip each.
+   *
+   * A worker takes no more than a fair share of the queued tasks, dividing
+   * them between all the workers, and idle workers steal from the buffers of
+   * busy ones, so that batched tasks are not held up behind a long task.
+   */
+  size_t dequeue_batch = 1;
+  /**
+   * Maximum number of tasks waiting to start, or zero for no limit. Once this
+   * many tasks are waiting, adding a task does as set by backpressure, while
+   * the pool's @c try_ methods refuse the task straight away.
+   *
+   * Tasks added from the pool's own workers with BackpressurePolicy::block are
+   * queued regardless, since a worker waiting for space could deadlock the
+   * pool, and delayed and periodic tasks are always queued once due.
+   */
+  size_t max_queued = 0;
+  /** What adding a task does once max_queued tasks are waiting. */
+  BackpressurePolicy backpressure = BackpressurePolicy::block;
+};
+
+}  // namespace acorn
+
+#endif  // ACORN_THREADS_POOL_OPTIONS_H_
@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_POOL_STATS_H_
+#define ACORN_THREADS_POOL_STATS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+/**
+ * @def ACORN_POOL_STATS
+ * Define to have thread pools collect statistics about their tasks and
+ * workers, which can be read with @c snapshot(). Without it the statistics
+ * hooks are empty and compile away, so @c snapshot() returns an empty
+ * PoolStatsSnapshot. This changes the layout of pool tasks, so must be set
+ * the same way for every translation unit in a program.
+ */
+
+namespace acorn {
+
+/**
+ * Snapshot of a histogram of durations, bucketed by powers of two of
+ * nanoseconds.
+ *
+ * Bucket 0 counts durations under 1ns, and bucket @c i counts durations from
+ * @c 2^(i-1) ns up to, but excluding, @c 2^i ns. The last bucket also counts
+ * any longer durations.
+ */
+struct DurationHistogram {
+  static constexpr size_t NumBuckets = 40;
+
+  /** Number of durations recorded in each bucket. */
+  std::array<uint64_t, NumBuckets> counts{};
+
+  /** The bucket that a duration is recorded in. */
+  static size_t bucket(std::chrono::nanoseconds duration) noexcept {
+    if (duration.count() <= 0) {
+      return 0;
+    }
+    auto value = static_cast<uint64_t>(duration.count());
+    size_t width = 0;
+    while (value != 0) {
+      value >>= 1;
+      ++width;
+    }
+    return width < NumBuckets ? width : NumBuckets - 1;
+  }
+
+  /** The exclusive upper bound of durations recorded in bucket @p index. */
+  static std::chrono::nanoseconds bucket_limit(size_t index) noexcept {
+    return std::chrono::nanoseconds{int64_t{1} << index};
+  }
+
+  /** Total number of durations recorded. */
+  uint64_t total() const noexcept {
+    uint64_t total = 0;
+    for (auto count : counts) {
+      total += count;
+    }
+    return total;
+  }
+
+  /**
+   * An upper bound for the given quantile of the recorded durations, where
+   * @p quantile is between 0 and 1. This is the limit of the bucket holding
+   * the quantile, so is within a factor of two of the true value.
+   */
+  std::chrono::nanoseconds quantile(double quantile) const noexcept {
+    uint64_t n_recorded = total();
+    if (n_recorded == 0) {
+      return std::chrono::nanoseconds{0};
+    }
+    auto rank = static_cast<uint64_t>(quantile * n_recorded);
+    rank = rank < n_recorded ? rank : n_recorded - 1;
+    uint64_t seen = 0;
+    size_t index = 0;
+    for (; index < NumBuckets - 1; ++index) {
+      seen += counts[index];
+      if (seen > rank) {
+        break;
+      }
+    }
+    return bucket_limit(index);
+  }
+
+  DurationHistogram& operator+=(DurationHistogram const& other) noexcept {
+    for (size_t index = 0; index < NumBuckets; ++index) {
+      counts[index] += other.counts[index];
+    }
+    return *this;
+  }
+};
+
+/** Snapshot of the counters for a single worker. */
+struct WorkerStats {
+  /** Number of tasks the worker has completed. */
+  uint64_t n_tasks = 0;
+  /** Total time the worker has spent running tasks. */
+  std::chrono::nanoseconds busy_time{0};
+};
+
+/** Snapshot of a thread pool's statistics. */
+struct PoolStatsSnapshot {
+  /**
+   * Whether statistics were collected, that is whether ACORN_POOL_STATS was
+   * defined. If not, all other fields are empty.
+   */
+  bool enabled = false;
+  /** Time since the pool was constructed. */
+  std::chrono::nanoseconds uptime{0};
+  /** Number of tasks submitted to the pool. */
+  uint64_t n_submitted = 0;
+  /** Number of tasks submitted to the pool but not yet started. */
+  uint64_t queue_depth = 0;
+  /** Counters for each worker. */
+  std::vector<WorkerStats> workers;
+  /** Time that tasks spent queued before a worker started them. */
+  DurationHistogram queue_wait;
+  /** Time that tasks took to run. */
+  DurationHistogram run_time;
+};
+
+#ifdef ACORN_POOL_STATS
+
+/**
+ * Statistics collected by a thread pool.
+ *
+ * Each worker owns its own counters and histograms, which only it writes, so
+ * recording a task never contends with other workers.
+ */
+struct PoolStats {
+  using Clock = std::chrono::steady_clock;
+  /** Time a task was started, passed back in when it finishes. */
+  using TimePoint = Clock::time_point;
+
+ private:
+  /** Histogram which is written by a single thread and read by any. */
+  struct AtomicHistogram {
+    std::atomic<uint64_t> counts[DurationHistogram::NumBuckets] = {};
+
+    void record(std::chrono::nanoseconds duration) noexcept {
+      increment(counts[DurationHistogram::bucket(duration)], 1);
+    }
+
+    DurationHistogram load() const noexcept {
+      DurationHistogram histogram;
+      for (size_t index = 0; index < DurationHistogram::NumBuckets; ++index) {
+        histogram.counts[index] = counts[index].load(std::memory_order_relaxed);
+      }
+      return histogram;
+    }
+  };
+
+  using Mutex = absl::Mutex;
+  using Lock = absl::MutexLock;
+
+ public:
+  /** Counters owned by a single worker. */
+  struct WorkerCounters {
+    std::atomic<uint64_t> n_started{0};
+    std::atomic<uint64_t> n_tasks{0};
+    std::atomic<uint64_t> busy_ns{0};
+    AtomicHistogram queue_wait;
+    AtomicHistogram run_time;
+  };
+
+ private:
+  using WorkerContainer = std::vector<std::unique_ptr<WorkerCounters>>;
+
+ public:
+  /** Construct statistics for a pool starting with @p n_workers workers. */
+  explicit PoolStats(size_t n_workers) : created_{Clock::now()} {
+    workers_.reserve(n_workers);
+  }
+
+  /**
+   * The counters for the worker with the given index, which are created the
+   * first time they are asked for. A worker should fetch its counters once
+   * when it starts, to pass to task_started and task_finished.
+   */
+  WorkerCounters& worker(size_t index) ABSL_LOCKS_EXCLUDED(mutex_) {
+    Lock lock{&mutex_};
+    while (workers_.size() <= index) {
+      workers_.emplace_back(new WorkerCounters{});
+    }
+    return *workers_[index];
+  }
+
+  /** Record that @p n_tasks tasks are about to be queued. */
+  void tasks_submitted(size_t n_tasks) noexcept {
+    n_submitted_.fetch_add(n_tasks, std::memory_order_relaxed);
+  }
+
+  /** Record that a worker has taken @p task from the queue. */
+  template <typename Task>
+  TimePoint task_started(WorkerCounters& counters, Task const& task) noexcept {
+    auto now = Clock::now();
+    increment(counters.n_started, 1);
+    counters.queue_wait.record(now - task.created);
+    return now;
+  }
+
+  /** Record that a worker has finished the task it started at @p started. */
+  void task_finished(WorkerCounters& counters, TimePoint started) noexcept {
+    auto run_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - started);
+    counters.run_time.record(run_time);
+    increment(counters.busy_ns, static_cast<uint64_t>(run_time.count()));
+    increment(counters.n_tasks, 1);
+  }
+
+  /** Read the current statistics. */
+  PoolStatsSnapshot snapshot() const ABSL_LOCKS_EXCLUDED(mutex_) {
+    Lock lock{&mutex_};
+    PoolStatsSnapshot result;
+    result.enabled = true;
+    result.uptime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - created_);
+    // Read the started counts before the submitted count, so that the
+    // submitted count includes every task seen to start.
+    uint64_t n_started = 0;
+    for (auto const& worker : workers_) {
+      n_started += worker->n_started.load(std::memory_order_relaxed);
+      WorkerStats stats;
+      stats.n_tasks = worker->n_tasks.load(std::memory_order_relaxed);
+      stats.busy_time = std::chrono::nanoseconds{static_cast<int64_t>(
+          worker->busy_ns.load(std::memory_order_relaxed))};
+      result.workers.push_back(stats);
+      result.queue_wait += worker->queue_wait.load();
+      result.run_time += worker->run_time.load();
+    }
+    result.n_submitted = n_submitted_.load(std::memory_order_acquire);
+    result.queue_depth =
+        result.n_submitted > n_started ? result.n_submitted - n_started : 0;
+    return result;
+  }
+
+ private:
+  /** Add to a counter only written by the calling thread. */
+  static void increment(std::atomic<uint64_t>& counter,
+                        uint64_t amount) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + amount,
+                  std::memory_order_relaxed);
+  }
+
+  /** Mutex guarding the list of workers, but not their counters. */
+  mutable Mutex mutex_;
+  /** Counters for each worker, allocated separately to avoid false sharing. */
+  WorkerContainer workers_ ABSL_GUARDED_BY(mutex_);
+  /** Number of tasks submitted to the pool. */
+  std::atomic<uint64_t> n_submitted_{0};
+  /** When the pool was constructed. */
+  TimePoint const created_;
+};
+
+#else  // ACORN_POOL_STATS
+
+/** Statistics hooks which do nothing, used when ACORN_POOL_STATS is unset. */
+struct PoolStats {
+  struct TimePoint {};
+  struct WorkerCounters {};
+
+  explicit PoolStats(size_t) noexcept {}
+
+  WorkerCounters worker(size_t) noexcept { return {}; }
+
+  void tasks_submitted(size_t) noexcept {}
+
+  template <typename Task>
+  TimePoint task_started(WorkerCounters const&, Task const&) noexcept {
+    return {};
+  }
+
+  void task_finished(WorkerCounters const&, TimePoint) noexcept {}
+
+  PoolStatsSnapshot snapshot() const { return {}; }
+};
+
+#endif  // ACORN_POOL_STATS
+
+}  // namespace acorn
+
+#endif  // ACORN_THREADS_POOL_STATS_H_
@@ -31,67 +31,255 @@
 #ifndef ACORN_THREADS_SHARED_THREAD_POOL_H_
 #define ACORN_THREADS_SHARED_THREAD_POOL_H_
 
+#include <algorithm>
 #include <atomic>
-#include <condition_variable>
+#include <cassert>
+#include <chrono>
+#include <deque>
+#include <exception>
 #include <future>
-#include <mutex>
-#include <queue>
+#include <iterator>
+#include <memory>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+
+#include "acorn/threads/cancellation.h"
+#include "acorn/threads/cpu_topology.h"
+#include "acorn/threads/event_count.h"
+#include "acorn/threads/future.h"
+#include "acorn/threads/idle_policy.h"
+#include "acorn/threads/pool_options.h"
+#include "acorn/threads/pool_stats.h"
+#include "acorn/threads/task_queue.h"
+#include "acorn/threads/timer_wheel.h"
+#include "acorn/threads/unique_task.h"
 
 namespace acorn {
 
+/** Fulfil a @c std::promise with the result of calling @p func. */
+template <typename T, typename Function>
+void fulfil_promise(std::promise<T>& promise, Function& func) {
+  try {
+    promise.set_value(func());
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+  }
+}
+
+/** @copydoc fulfil_promise(std::promise<T>&, Function&) */
+template <typename Function>
+void fulfil_promise(std::promise<void>& promise, Function& func) {
+  try {
+    func();
+    promise.set_value();
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+  }
+}
+
+/**
+ * A queued task along with the promise for its result.
+ *
+ * Destroying the task without running it, as happens when its
+ * CancellationToken is cancelled or the pool discards its queue, stores
+ * TaskCancelled in the promise, rather than leaving it broken.
+ */
+template <typename PromiseType, typename Function>
+struct PromisedTask {
+  PromisedTask(PromiseType promise, Function func)
+      : promise_{std::move(promise)}, func_{std::move(func)} {}
+
+  PromisedTask(PromisedTask&& other) noexcept
+      : promise_{std::move(other.promise_)},
+        func_{std::move(other.func_)},
+        pending_{std::exchange(other.pending_, false)} {}
+  PromisedTask& operator=(PromisedTask&&) = delete;
+
+  ~PromisedTask() {
+    if (pending_) {
+      promise_.set_exception(std::make_exception_ptr(TaskCancelled{}));
+    }
+  }
+
+  void operator()() {
+    pending_ = false;
+    fulfil_promise(promise_, func_);
+  }
+
+ private:
+  PromiseType promise_;
+  Function func_;
+  bool pending_ = true;
+};
+
+/** Make a PromisedTask to fulfil @p promise by calling @p func. */
+template <typename PromiseType, typename Function>
+auto make_promised_task(PromiseType promise, Function&& func) {
+  return PromisedTask<PromiseType, std::decay_t<Function>>{
+      std::move(promise), std::forward<Function>(func)};
+}
+
 /**
  * A basc thread pool executor with a single shared task queue.
  *
  * Workers will query the central shared queue for work once they have completed
  * a task.
+ *
+ * The number of workers can be changed with resize. If
+ * PoolOptions::max_threads is larger than the pool's size, the pool is
+ * elastic: it adds a worker whenever a task is submitted after all workers
+ * have been busy for PoolOptions::grow_after, up to max_threads, and workers
+ * above the pool's size exit after idling for PoolOptions::idle_timeout.
+ *
+ * Tasks can be delayed, or run periodically, with add_task_at, add_task_after
+ * and add_periodic. These are held by a TimerWheel, started on first use,
+ * which only adds each task to the queue once it is due.
+ *
+ * With PoolOptions::dequeue_batch above one, workers take tasks from the queue
+ * in batches, holding them in per-worker buffers that idle workers can steal
+ * from.
+ *
+ * The number of tasks waiting to start can be limited with
+ * PoolOptions::max_queued, to shed load rather than queue without bound. Once
+ * full, adding a task either blocks or runs the task on the caller, as set by
+ * PoolOptions::backpressure, while try_add_task, try_submit and try_execute
+ * fail straight away.
+ *
+ * @tparam TaskQueue Policy providing the shared queue of tasks, see
+ *         LockedTaskQueue for the required interface.
  */
-struct SharedThreadPool {
+template <typename TaskQueue = LockedTaskQueue>
+struct BasicSharedThreadPool {
  private:
+  using Task = PoolTask;
+
   using Mutex = absl::Mutex;
   using Lock = absl::MutexLock;
-
-  using Task = std::packaged_task<void()>;
-  using TaskQueueAllocator = std::allocator<Task>;
-  using TaskQueueContainer = std::deque<Task, TaskQueueAllocator>;
-  using TaskQueue = std::queue<Task, TaskQueueContainer>;
+  using Clock = std::chrono::steady_clock;
 
   using Thread = std::thread;
   using ThreadContainer = std::vector<Thread>;
+  using SlotContainer = std::vector<unsigned>;
 
  public:
-  /** Construct a SharedThreadPool with a set number of threads. */
-  explicit SharedThreadPool(unsigned n_threads) {
-    // Threads are not copyable, so have to create each separately
+  /**
+   * Handler called on a worker thread with any exception thrown by a task
+   * that was added without a future.
+   */
+  using ErrorHandler = PoolErrorHandler;
+
+  /**
+   * Construct a SharedThreadPool with a set number of threads.
+   *
+   * @param n_threads [in] Number of worker threads to start, which is also the
+   *        minimum size of an elastic pool.
+   * @param options [in] Options configuring the pool's behaviour.
+   */
+  explicit BasicSharedThreadPool(unsigned n_threads, PoolOptions options = {})
+      : queue_{options},
+        idle_policy_{options.idle_policy},
+        error_handler_{std::move(options.error_handler)},
+        worker_affinity_{std::move(options.worker_affinity)},
+        grow_after_{options.grow_after},
+        idle_timeout_{options.idle_timeout},
+        min_threads_{n_threads},
+        max_threads_{std::max(n_threads, options.max_threads)},
+        stats_{n_threads},
+        shutdown_mode_{options.shutdown_mode},
+        run_next_{options.run_next},
+        dequeue_batch_{options.dequeue_batch},
+        max_queued_{options.max_queued},
+        backpressure_{options.backpressure},
+        timer_resolution_{options.timer_resolution} {
+    Lock lock{&threads_mutex_};
     thread_pool_.reserve(n_threads);
-    for (unsigned count = 0; count < n_threads; ++count) {
-      thread_pool_.emplace_back(&SharedThreadPool::worker_loop, this);
+    while (n_threads_.load(std::memory_order_relaxed) < n_threads) {
+      start_worker();
     }
   }
 
-  SharedThreadPool() = delete;
-  SharedThreadPool(SharedThreadPool const&) = delete;
-  SharedThreadPool& operator=(SharedThreadPool const&) = delete;
+  /**
+   * Construct a SharedThreadPool with a set number of threads, passing any
+   * exception thrown by a task added without a future to @p error_handler.
+   */
+  BasicSharedThreadPool(unsigned n_threads, ErrorHandler error_handler)
+      : BasicSharedThreadPool{n_threads,
+                              PoolOptions{IdlePolicy::park(),
+                                          std::move(error_handler)}} {}
+
+  BasicSharedThreadPool() = delete;
+  BasicSharedThreadPool(BasicSharedThreadPool const&) = delete;
+  BasicSharedThreadPool& operator=(BasicSharedThreadPool const&) = delete;
 
   /**
-   * Tear down the thread pool and wait for all currently queued tasks to be
-   * completed.
+   * Tear down the thread pool, shutting it down as set by
+   * PoolOptions::shutdown_mode if shutdown has not already been called. By
+   * default this waits for all currently queued tasks to be completed.
    */
-  ~SharedThreadPool() ABSL_LOCKS_EXCLUDED(mutex_) {
+  ~BasicSharedThreadPool() { shutdown(shutdown_mode_); }
+
+  /**
+   * Stop the thread pool and wait for its workers to exit.
+   *
+   * With ShutdownMode::drain every queued task is run first, while with
+   * ShutdownMode::discard queued tasks are dropped without running, storing
+   * TaskCancelled in their futures. Tasks which are running are always
+   * allowed to finish. Delayed and periodic tasks which are not yet due are
+   * dropped. Tasks added from outside the pool once it is shutting down are
+   * refused, storing TaskCancelled in their futures, as no worker would run
+   * them and a pool with PoolOptions::max_queued set would never free up
+   * space for them. Tasks added by running tasks are still queued, so a task
+   * can wait on the tasks it submits, but any left once the workers have
+   * exited are dropped.
+   */
+  void shutdown(ShutdownMode mode = ShutdownMode::drain)
+      ABSL_LOCKS_EXCLUDED(threads_mutex_) {
+    ThreadContainer threads;
+    TimerWheel* timers;
     {
-      Lock lock{&mutex_};
-      for (unsigned count = 0; count < thread_pool_.size(); ++count) {
-        // Add an invalid task to end of queue to signal shutdown. This ensures
-        // all queued tasks get finished.
-        queue_.emplace(Task{});
+      Lock lock{&threads_mutex_};
+      if (shutting_down_) {
+        return;
       }
+      shutting_down_ = true;
+      threads.swap(thread_pool_);
+      timers = timer_wheel_.get();
     }
-    for (auto& thread : thread_pool_) {
-      thread.join();
+    // Wake any submitters waiting for space, so they see the pool is stopped.
+    stopped_.store(true);
+    space_event_.notify_all();
+    if (timers != nullptr) {
+      timers->stop();
+    }
+    if (mode == ShutdownMode::discard) {
+      discarding_.store(true, std::memory_order_relaxed);
+    }
+    // Add an empty task to end of queue for every worker thread to signal
+    // shutdown. This ensures all queued tasks get finished. Signals are
+    // counted from the threads rather than n_threads_, as a worker of an
+    // elastic pool can leave n_threads_ and then stay on seeing a new task,
+    // and workers which have already exited just leave their signal unused.
+    for (auto& thread : threads) {
+      if (thread.joinable()) {
+        queue_.push(Task{});
+      }
+    }
+    for (auto& thread : threads) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+    // Drop tasks added by running tasks behind the shutdown signals, which no
+    // worker is left to run, so their futures are not left pending.
+    Task task;
+    while (queue_.try_pop(task)) {
+      task.reset();
     }
   }
 
@@ -103,62 +291,1271 @@ struct SharedThreadPool {
   template <typename Function>
   auto add_task(Function&& func) -> std::future<decltype(func())> {
     using Return = decltype(func());
-    using TypedTask = std::packaged_task<Return()>;
-
-    auto new_task = TypedTask{std::move(func)};
-    auto future = new_task.get_future();
-    add_task(std::move(new_task));
+    std::promise<Return> promise;
+    auto future = promise.get_future();
+    enqueue(Task{make_promised_task(std::move(promise),
+                                    std::forward<Function>(func))});
     return future;
   }
 
-  /** Add a packaged task to run n the SharedThreadPool. */
+  /**
+   * Add a packaged task to run n the SharedThreadPool.
+   *
+   * The pool cannot reach the packaged task's promise, so if the task is
+   * dropped without running its future is broken with
+   * @c std::future_errc::broken_promise rather than holding TaskCancelled.
+   */
   template <typename ReturnType>
   void add_task(std::packaged_task<ReturnType()>&& task) {
-    Lock lock{&mutex_};
-    queue_.emplace(std::move(task));
+    enqueue(Task{std::move(task)});
+  }
+
+  /**
+   * Add a type-erased task to run on the SharedThreadPool.
+   *
+   * No future is created for the task, so any result must be handled by the
+   * task itself. The task must not be empty.
+   */
+  void add_task(UniqueTask&& task) {
+    assert(task && "Empty tasks are reserved to signal shutdown.");
+    enqueue(std::move(task));
+  }
+
+  /**
+   * Add a task to be run on the ThreadPool.
+   *
+   * Waiting on the returned future from one of the pool's workers runs other
+   * queued tasks until the result is ready, so tasks can wait on the results
+   * of tasks they submit without tying up or deadlocking the pool.
+   *
+   * @return An acorn::Future which will be filled in with the return value of
+   * the task once completed.
+   */
+  template <typename Function>
+  auto submit(Function&& func) -> Future<decltype(func())> {
+    using Return = decltype(func());
+    Promise<Return> promise;
+    auto future = promise.get_future();
+    enqueue(Task{make_promised_task(std::move(promise),
+                                    std::forward<Function>(func))});
+    return future;
+  }
+
+  /** Awaitable which resumes the awaiting coroutine on one of the workers. */
+  struct ScheduleAwaiter {
+    bool await_ready() const noexcept { return false; }
+
+    template <typename Handle>
+    void await_suspend(Handle awaiting) {
+      pool.execute([awaiting]() mutable { awaiting.resume(); });
+    }
+
+    void await_resume() const noexcept {}
+
+    BasicSharedThreadPool& pool;
+  };
+
+  /**
+   * Move a C++20 coroutine onto one of the pool's workers, as in
+   * @c co_await pool.schedule(). The coroutine is queued like any other task
+   * and carries on from the await once a worker takes it.
+   */
+  ScheduleAwaiter schedule() noexcept { return ScheduleAwaiter{*this}; }
+
+  /**
+   * Add a task to be run on the ThreadPool, unless @p token is cancelled
+   * before a worker takes it, in which case the task is dropped and its
+   * future holds TaskCancelled.
+   */
+  template <typename Function>
+  auto add_task(CancellationToken token, Function&& func)
+      -> std::future<decltype(func())> {
+    using Return = decltype(func());
+    std::promise<Return> promise;
+    auto future = promise.get_future();
+    enqueue(Task{unless_cancelled(
+        std::move(token), make_promised_task(std::move(promise),
+                                             std::forward<Function>(func)))});
+    return future;
+  }
+
+  /**
+   * Add a task to be run on the ThreadPool as for submit, unless @p token is
+   * cancelled before a worker takes it, in which case the task is dropped and
+   * its future holds TaskCancelled.
+   */
+  template <typename Function>
+  auto submit(CancellationToken token, Function&& func)
+      -> Future<decltype(func())> {
+    using Return = decltype(func());
+    Promise<Return> promise;
+    auto future = promise.get_future();
+    enqueue(Task{unless_cancelled(
+        std::move(token), make_promised_task(std::move(promise),
+                                             std::forward<Function>(func)))});
+    return future;
+  }
+
+  /**
+   * Add a fire-and-forget task to run on the SharedThreadPool, unless
+   * @p token is cancelled before a worker takes it.
+   */
+  template <typename Function>
+  void execute(CancellationToken token, Function&& func) {
+    enqueue(Task{
+        unless_cancelled(std::move(token), std::forward<Function>(func))});
+  }
+
+  /**
+   * Add a task to be run on the ThreadPool in the lane for @p priority.
+   *
+   * Only available if the queue policy has priority lanes, as LockedTaskQueue
+   * does.
+   *
+   * @return A @c std::future which will be filled in with the return value of
+   * the task once completed.
+   */
+  template <typename Function>
+  auto add_task(TaskPriority priority, Function&& func)
+      -> std::future<decltype(func())> {
+    using Return = decltype(func());
+    std::promise<Return> promise;
+    auto future = promise.get_future();
+    enqueue(Task{make_promised_task(std::move(promise),
+                                    std::forward<Function>(func))},
+            priority);
+    return future;
+  }
+
+  /**
+   * Add a batch of tasks to be run on the ThreadPool.
+   *
+   * All the tasks are added to the queue at once, rather than contending on the
+   * queue for each task in turn, and only as many workers are woken as there
+   * are tasks. The callables are moved out of the range.
+   *
+   * @return A vector containing a @c std::future for each task, in the same
+   * order as the tasks.
+   */
+  template <typename Iterator>
+  auto add_tasks(Iterator first, Iterator last)
+      -> std::vector<std::future<decltype((*first)())>> {
+    using Return = decltype((*first)());
+
+    std::vector<Task> tasks;
+    std::vector<std::future<Return>> futures;
+    auto n_tasks = std::distance(first, last);
+    tasks.reserve(n_tasks);
+    futures.reserve(n_tasks);
+    for (; first != last; ++first) {
+      std::promise<Return> promise;
+      futures.push_back(promise.get_future());
+      tasks.emplace_back(
+          make_promised_task(std::move(promise), std::move(*first)));
+    }
+    enqueue_bulk(tasks);
+    return futures;
+  }
+
+  /** @copydoc add_tasks(Iterator, Iterator) */
+  template <typename Function>
+  auto add_tasks(absl::Span<Function> funcs)
+      -> std::vector<std::future<decltype(std::declval<Function&>()())>> {
+    return add_tasks(funcs.begin(), funcs.end());
+  }
+
+  /**
+   * Add a fire-and-forget task to run on the SharedThreadPool.
+   *
+   * Unlike add_task, no future or shared state is created, so a callable small
+   * enough to be stored inline in a UniqueTask is queued without any
+   * allocation. Any value returned by the callable is discarded, and any
+   * exception it throws is passed to the pool's error handler.
+   */
+  template <typename Function>
+  void execute(Function&& func) {
+    add_task(UniqueTask{std::forward<Function>(func)});
+  }
+
+  /**
+   * Add a task to be run on the ThreadPool as for add_task, unless the pool
+   * already has PoolOptions::max_queued tasks waiting to start, or is shutting
+   * down.
+   *
+   * @return A @c std::future for the task's result, or an invalid future if
+   * the task was refused.
+   */
+  template <typename Function>
+  auto try_add_task(Function&& func) -> std::future<decltype(func())> {
+    using Return = decltype(func());
+    if (!try_admit()) {
+      return {};
+    }
+    std::promise<Return> promise;
+    auto future = promise.get_future();
+    enqueue_admitted(Task{make_promised_task(std::move(promise),
+                                             std::forward<Function>(func))});
+    return future;
+  }
+
+  /**
+   * Add a task to be run on the ThreadPool as for submit, unless the pool
+   * already has PoolOptions::max_queued tasks waiting to start, or is shutting
+   * down.
+   *
+   * @return An acorn::Future for the task's result, or an invalid future if
+   * the task was refused.
+   */
+  template <typename Function>
+  auto try_submit(Function&& func) -> Future<decltype(func())> {
+    using Return = decltype(func());
+    if (!try_admit()) {
+      return {};
+    }
+    Promise<Return> promise;
+    auto future = promise.get_future();
+    enqueue_admitted(Task{make_promised_task(std::move(promise),
+                                             std::forward<Function>(func))});
+    return future;
+  }
+
+  /**
+   * Add a fire-and-forget task as for execute, unless the pool already has
+   * PoolOptions::max_queued tasks waiting to start, or is shutting down.
+   *
+   * @return Whether the task was added.
+   */
+  template <typename Function>
+  bool try_execute(Function&& func) {
+    if (!try_admit()) {
+      return false;
+    }
+    auto task = Task{std::forward<Function>(func)};
+    assert(task && "Empty tasks are reserved to signal shutdown.");
+    enqueue_admitted(std::move(task));
+    return true;
+  }
+
+  /**
+   * Add a fire-and-forget task to run on the SharedThreadPool in the lane for
+   * @p priority.
+   *
+   * Only available if the queue policy has priority lanes, as LockedTaskQueue
+   * does.
+   */
+  template <typename Function>
+  void execute(TaskPriority priority, Function&& func) {
+    auto task = Task{std::forward<Function>(func)};
+    assert(task && "Empty tasks are reserved to signal shutdown.");
+    enqueue(std::move(task), priority);
+  }
+
+  /**
+   * Add a batch of fire-and-forget tasks to run on the SharedThreadPool.
+   *
+   * As for add_tasks the whole batch is queued at once, and as for execute no
+   * futures are created. The callables are moved out of the range.
+   */
+  template <typename Iterator>
+  void execute_tasks(Iterator first, Iterator last) {
+    std::vector<Task> tasks;
+    tasks.reserve(std::distance(first, last));
+    for (; first != last; ++first) {
+      tasks.emplace_back(std::move(*first));
+      assert(tasks.back() && "Empty tasks are reserved to signal shutdown.");
+    }
+    enqueue_bulk(tasks);
+  }
+
+  /** @copydoc execute_tasks(Iterator, Iterator) */
+  template <typename Function>
+  void execute_tasks(absl::Span<Function> funcs) {
+    execute_tasks(funcs.begin(), funcs.end());
+  }
+
+  /**
+   * Add a fire-and-forget task to run on the SharedThreadPool once
+   * @p deadline has passed.
+   *
+   * The task waits in the pool's timer wheel rather than tying up a worker,
+   * and as for execute any exception it throws is passed to the pool's error
+   * handler.
+   *
+   * @return A handle which cancels the task if it has not yet been queued.
+   */
+  template <typename Function>
+  TimerHandle add_task_at(std::chrono::steady_clock::time_point deadline,
+                          Function&& func) {
+    auto* wheel = timers();
+    if (wheel == nullptr) {
+      return TimerHandle{};
+    }
+    return wheel->schedule(deadline, UniqueTask{std::forward<Function>(func)});
+  }
+
+  /**
+   * Add a fire-and-forget task to run on the SharedThreadPool once @p delay
+   * has passed, as for add_task_at.
+   */
+  template <typename Rep, typename Period, typename Function>
+  TimerHandle add_task_after(std::chrono::duration<Rep, Period> const& delay,
+                             Function&& func) {
+    return add_task_at(std::chrono::steady_clock::now() + to_duration(delay),
+                       std::forward<Function>(func));
+  }
+
+  /**
+   * Run @p func on the SharedThreadPool every @p interval, starting one
+   * interval from now, until cancelled through the returned handle.
+   *
+   * Each run is queued once the previous run has finished, so runs never
+   * overlap, and runs missed while a run was late are skipped.
+   */
+  template <typename Rep, typename Period, typename Function>
+  TimerHandle add_periodic(std::chrono::duration<Rep, Period> const& interval,
+                           Function&& func) {
+    auto* wheel = timers();
+    if (wheel == nullptr) {
+      return TimerHandle{};
+    }
+    auto period = to_duration(interval);
+    return wheel->schedule_periodic(std::chrono::steady_clock::now() + period,
+                                    period,
+                                    UniqueTask{std::forward<Function>(func)});
+  }
+
+  /**
+   * The number of worker threads in the pool. This does not count workers
+   * which are still finishing a task after being told to exit by resize.
+   */
+  size_t size() const noexcept {
+    return n_threads_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Change the number of worker threads to @p n_threads, which also becomes
+   * the minimum size of an elastic pool.
+   *
+   * New workers are started straight away. When shrinking, the excess workers
+   * exit as soon as they finish their current task, while queued tasks are
+   * left for the remaining workers, so this does not wait for the queue to
+   * drain.
+   */
+  void resize(unsigned n_threads) ABSL_LOCKS_EXCLUDED(threads_mutex_) {
+    assert(n_threads > 0 && "A pool needs a worker to run its tasks.");
+    Lock lock{&threads_mutex_};
+    if (shutting_down_) {
+      return;
+    }
+    min_threads_.store(n_threads, std::memory_order_relaxed);
+    if (max_threads_.load(std::memory_order_relaxed) < n_threads) {
+      max_threads_.store(n_threads, std::memory_order_relaxed);
+    }
+    // Workers told to exit which have not yet done so can be kept instead.
+    n_threads_.fetch_add(n_to_retire_.exchange(0));
+    auto current = n_threads_.load();
+    while (current > n_threads &&
+           !n_threads_.compare_exchange_weak(current, n_threads)) {
+    }
+    if (current > n_threads) {
+      n_to_retire_.fetch_add(current - n_threads);
+      queue_.push_event().notify_all();
+    }
+    while (n_threads_.load() < n_threads) {
+      start_worker();
+    }
+  }
+
+  /**
+   * Queue depth and wait time statistics for the lane for @p priority.
+   *
+   * Only available if the queue policy has priority lanes, as LockedTaskQueue
+   * does.
+   */
+  TaskLaneStats lane_stats(TaskPriority priority) {
+    return queue_.lane_stats(priority);
+  }
+
+  /**
+   * Read the pool's statistics. These are only collected if ACORN_POOL_STATS
+   * is defined, otherwise the snapshot is empty.
+   */
+  PoolStatsSnapshot snapshot() const { return stats_.snapshot(); }
+
+  /**
+   * The number of tasks added while the pool had PoolOptions::max_queued tasks
+   * waiting, which were either refused by a @c try_ method or run by the
+   * caller, along with tasks refused as the pool was shutting down.
+   */
+  size_t n_rejected() const noexcept {
+    return n_rejected_.load(std::memory_order_relaxed);
   }
 
  private:
+  /**
+   * Tasks taken from the queue in a batch by a single worker. The owner runs
+   * tasks from the front, while idle workers steal from the back.
+   */
+  struct WorkerBatch {
+    /**
+     * Mutex guarding the worker's batch. This is only contended when another
+     * worker is trying to steal from this one.
+     */
+    Mutex mutex;
+    /** The batched tasks, in the order they were queued. */
+    std::deque<Task> tasks ABSL_GUARDED_BY(mutex);
+  };
+  using BatchContainer = std::vector<std::unique_ptr<WorkerBatch>>;
+
+  /**
+   * A worker's run_next slot. The owner runs the task as soon as its current
+   * task finishes, while idle workers can steal it.
+   */
+  struct RunNextSlot {
+    /**
+     * Mutex guarding the slot. This is only contended when another worker is
+     * trying to steal from this one.
+     */
+    Mutex mutex;
+    /** The task to run next, if any. */
+    Task task ABSL_GUARDED_BY(mutex);
+  };
+  using RunNextContainer = std::vector<std::unique_ptr<RunNextSlot>>;
+
+  /** State of the worker running on the current thread. */
+  struct WorkerContext {
+    WorkerContext(BasicSharedThreadPool* pool, unsigned index,
+                  WorkerBatch* batch, RunNextSlot* run_next) noexcept
+        : pool{pool},
+          index{index},
+          batch{batch},
+          run_next{run_next},
+          previous_{current()} {
+      current() = this;
+    }
+
+    ~WorkerContext() { current() = previous_; }
+
+    WorkerContext(WorkerContext const&) = delete;
+    WorkerContext& operator=(WorkerContext const&) = delete;
+
+    /** The context of the worker running on this thread, if any. */
+    static WorkerContext*& current() noexcept {
+      static thread_local WorkerContext* context = nullptr;
+      return context;
+    }
+
+    /** The pool the worker belongs to. */
+    BasicSharedThreadPool* const pool;
+    /** Index of the worker in the pool. */
+    unsigned const index;
+    /** The worker's batch buffer, or null if tasks are not batched. */
+    WorkerBatch* const batch;
+    /** The worker's run_next slot, or null if run_next is not enabled. */
+    RunNextSlot* const run_next;
+
+   private:
+    WorkerContext* const previous_;
+  };
+
   /**
    * The main loop for each of the worker threads.
    *
-   * Wait on the mutex until work is made available on the queue, then pull the
-   * first task form the queue and execute that. An invalid task is used to
+   * Take the first task from the queue and execute that, waiting as set by the
+   * pool's idle policy if no work is available. An empty task is used to
    * signal to the worker that the threadpool is shutting down, so the worker
-   * should exit the loop.
+   * should exit the loop. After each task the worker runs any tasks left in
+   * its run_next slot before going back to its batch or the queue.
+   *
+   * @param index [in] Index of the worker in the pool.
+   * @param affinity [in] CPUs to pin the worker to, or empty to leave it
+   * unpinned.
    */
-  void worker_loop() ABSL_LOCKS_EXCLUDED(mutex_) {
+  void worker_loop(unsigned index, CpuSet const& affinity) {
+    if (!affinity.empty()) {
+      pin_current_thread(affinity);
+    }
+    auto&& counters = stats_.worker(index);
+    WorkerContext context{this, index,
+                          dequeue_batch_ > 1 ? &worker_batch(index) : nullptr,
+                          run_next_ ? &run_next_slot(index) : nullptr};
+    WorkerWaitHelper helper{*this, context, counters};
+    FutureWaitHelperScope helper_scope{&helper};
+    Task task;
     while (true) {
-      mutex_.Lock();
-      mutex_.Await(absl::Condition{
-          +[](TaskQueue* queue) { return !queue->empty(); }, &queue_});
-      auto task = std::move(queue_.front());
-      queue_.pop();
-      mutex_.Unlock();
-      if (!task.valid()) {
-        // An invalid task signals the thread pool is shutting down.
+      if (!next_task(context, task)) {
+        retire(index);
+        return;
+      }
+      if (!task) {
+        // An empty task signals the thread pool is shutting down.
         break;
       }
+      run_task(task, counters);
+      run_next_tasks(context, counters);
+    }
+  }
+
+  /**
+   * Take the worker's next task, or a shutdown signal, waiting as set by the
+   * pool's idle policy if no work is available. Tasks in the worker's own
+   * batch are always run before it can exit.
+   *
+   * @return Whether a task was taken, or false if the worker should instead
+   * exit, either as asked by resize or after idling above the pool's minimum
+   * size.
+   */
+  bool next_task(WorkerContext& context, Task& task) {
+    if (context.batch != nullptr && take_batched(*context.batch, task)) {
+      return true;
+    }
+    return !claim_retirement() &&
+           (try_pop(context, task) || wait_for_task(context, task));
+  }
+
+  /**
+   * Take a task, or a shutdown signal once there are no tasks, without
+   * waiting.
+   */
+  bool try_pop(WorkerContext& context, Task& task) {
+    if (context.batch != nullptr && try_pop_task(context, task)) {
+      return true;
+    }
+    return queue_.try_pop(task) || steal_run_next(context.index, task);
+  }
+
+  /**
+   * Take a task without waiting, never taking a shutdown signal. A batching
+   * worker takes from its own batch, then a new batch from the queue, then
+   * steals from the batches of other workers. Tasks in other workers'
+   * run_next slots are only stolen once there is nothing else to take.
+   */
+  bool try_pop_task(WorkerContext& context, Task& task) {
+    if (context.batch == nullptr) {
+      return queue_.try_pop_task(task) || steal_run_next(context.index, task);
+    }
+    return take_batched(*context.batch, task) ||
+           take_batch(*context.batch, task) ||
+           steal_batched(context.index, task) ||
+           steal_run_next(context.index, task);
+  }
+
+  /** Take the next task from a worker's own batch. */
+  bool take_batched(WorkerBatch& batch, Task& task) {
+    Lock lock{&batch.mutex};
+    if (batch.tasks.empty()) {
+      return false;
+    }
+    task = std::move(batch.tasks.front());
+    batch.tasks.pop_front();
+    n_batched_.fetch_sub(1);
+    return true;
+  }
+
+  /**
+   * Move a batch of tasks from the queue to a worker's empty batch, under a
+   * single acquisition of the queue, and take the first of them. Idle workers
+   * are woken to steal the rest.
+   */
+  bool take_batch(WorkerBatch& batch, Task& task) {
+    size_t n_taken;
+    {
+      Lock lock{&batch.mutex};
+      n_taken = queue_.try_pop_bulk(batch.tasks, dequeue_batch_,
+                                    n_threads_.load(std::memory_order_relaxed));
+      if (n_taken == 0) {
+        return false;
+      }
+      task = std::move(batch.tasks.front());
+      batch.tasks.pop_front();
+      // Counting the batch before checking for idle workers pairs with
+      // wait_for_task counting the worker as idle before checking for
+      // batches, so either the idle worker sees the batch or it is woken.
+      n_batched_.fetch_add(n_taken - 1);
+    }
+    auto n_idle = n_idle_.load();
+    if (n_taken > 1 && n_idle > 0) {
+      queue_.push_event().notify(std::min<size_t>(n_taken - 1, n_idle));
+    }
+    return true;
+  }
+
+  /**
+   * Steal the last task from another worker's batch. Victims are visited in
+   * turn, starting from the worker after the thief.
+   */
+  bool steal_batched(unsigned index, Task& task)
+      ABSL_LOCKS_EXCLUDED(batches_mutex_) {
+    if (n_batched_.load() == 0) {
+      return false;
+    }
+    absl::ReaderMutexLock lock{&batches_mutex_};
+    size_t const n_batches = batches_.size();
+    for (size_t offset = 1; offset <= n_batches; ++offset) {
+      auto& victim = *batches_[(index + offset) % n_batches];
+      Lock victim_lock{&victim.mutex};
+      if (victim.tasks.empty()) {
+        continue;
+      }
+      task = std::move(victim.tasks.back());
+      victim.tasks.pop_back();
+      n_batched_.fetch_sub(1);
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * The batch buffer for the worker with the given index, which is created the
+   * first time it is asked for and kept for any later worker in the same slot.
+   */
+  WorkerBatch& worker_batch(unsigned index)
+      ABSL_LOCKS_EXCLUDED(batches_mutex_) {
+    Lock lock{&batches_mutex_};
+    while (batches_.size() <= index) {
+      batches_.emplace_back(new WorkerBatch{});
+    }
+    return *batches_[index];
+  }
+
+  /**
+   * The run_next slot for the worker with the given index, which is created
+   * the first time it is asked for and kept for any later worker in the same
+   * slot.
+   */
+  RunNextSlot& run_next_slot(unsigned index)
+      ABSL_LOCKS_EXCLUDED(run_next_mutex_) {
+    Lock lock{&run_next_mutex_};
+    while (run_next_slots_.size() <= index) {
+      run_next_slots_.emplace_back(new RunNextSlot{});
+    }
+    return *run_next_slots_[index];
+  }
+
+  /** Take the task in a run_next slot, if there is one. */
+  bool take_run_next(RunNextSlot& slot, Task& task) {
+    Lock lock{&slot.mutex};
+    if (!slot.task) {
+      return false;
+    }
+    task = std::move(slot.task);
+    n_run_next_.fetch_sub(1);
+    return true;
+  }
+
+  /**
+   * Steal the task from another worker's run_next slot. Victims are visited
+   * in turn, starting from the worker after the thief.
+   */
+  bool steal_run_next(unsigned index, Task& task)
+      ABSL_LOCKS_EXCLUDED(run_next_mutex_) {
+    if (n_run_next_.load() == 0) {
+      return false;
+    }
+    absl::ReaderMutexLock lock{&run_next_mutex_};
+    size_t const n_slots = run_next_slots_.size();
+    for (size_t offset = 1; offset <= n_slots; ++offset) {
+      if (take_run_next(*run_next_slots_[(index + offset) % n_slots], task)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Run the tasks left in a worker's run_next slot, moving the slot to the
+   * shared queue after RunNextChainLimit tasks in a row.
+   */
+  void run_next_tasks(WorkerContext& context,
+                      PoolStats::WorkerCounters& counters) {
+    if (context.run_next == nullptr) {
+      return;
+    }
+    Task task;
+    for (unsigned chain = 0; take_run_next(*context.run_next, task); ++chain) {
+      if (chain == RunNextChainLimit) {
+        queue_.push(std::move(task));
+        return;
+      }
+      run_task(task, counters);
+    }
+  }
+
+  /** Run a task taken from the queue, recording it in the statistics. */
+  void run_task(Task& task, PoolStats::WorkerCounters& counters) {
+    if (max_queued_ != 0) {
+      release_space();
+    }
+    if (discarding_.load(std::memory_order_relaxed)) {
+      // Destroying the task without running it stores TaskCancelled in any
+      // future for it.
+      task.reset();
+      return;
+    }
+    auto started = stats_.task_started(counters, task);
+    try {
+      task();
+    } catch (...) {
+      // Tasks with futures store any exception in the future, so only tasks
+      // added without one can get here.
+      handle_error(std::current_exception());
+    }
+    stats_.task_finished(counters, started);
+    task.reset();
+  }
+
+  /**
+   * Lets a worker run queued tasks while a task waits on a Future, starting
+   * with the task in its run_next slot, then any tasks in its batch.
+   * Shutdown signals are left in the queue, since the worker cannot exit until
+   * its current task is done, and tasks submitted after all the workers have
+   * taken a signal would otherwise never run.
+   */
+  struct WorkerWaitHelper final : FutureWaitHelper {
+    WorkerWaitHelper(BasicSharedThreadPool& pool, WorkerContext& context,
+                     PoolStats::WorkerCounters& counters) noexcept
+        : pool{pool}, context{context}, counters{counters} {}
+
+    bool try_run_one() override {
+      Task task;
+      bool const from_slot = context.run_next != nullptr &&
+                             pool.take_run_next(*context.run_next, task);
+      if (!from_slot && !pool.try_pop_task(context, task)) {
+        return false;
+      }
+      pool.run_task(task, counters);
+      return true;
+    }
+
+    bool has_work() override { return pool.has_queued_tasks(); }
+
+    EventCount& work_event() override { return pool.queue_.push_event(); }
+
+    BasicSharedThreadPool& pool;
+    WorkerContext& context;
+    PoolStats::WorkerCounters& counters;
+  };
+
+  /**
+   * Start a new worker thread, reusing the slot of a worker that has exited
+   * if there is one.
+   */
+  void start_worker() ABSL_EXCLUSIVE_LOCKS_REQUIRED(threads_mutex_) {
+    unsigned index;
+    if (free_slots_.empty()) {
+      index = static_cast<unsigned>(thread_pool_.size());
+      thread_pool_.emplace_back();
+    } else {
+      index = free_slots_.back();
+      free_slots_.pop_back();
+      // The previous worker in this slot has already left its loop.
+      thread_pool_[index].join();
+    }
+    auto const& affinity = worker_affinity_;
+    thread_pool_[index] =
+        Thread{&BasicSharedThreadPool::worker_loop, this, index,
+               affinity.empty() ? CpuSet{} : affinity[index % affinity.size()]};
+    n_threads_.fetch_add(1);
+  }
+
+  /**
+   * Add a worker if the pool is elastic, every worker has been busy for
+   * longer than grow_after_ and the pool is not yet at its maximum size. An
+   * elastic pool that has shrunk to no workers grows straight away.
+   */
+  void maybe_grow() ABSL_LOCKS_EXCLUDED(threads_mutex_) {
+    auto n_threads = n_threads_.load(std::memory_order_relaxed);
+    if (n_threads >= max_threads_.load(std::memory_order_relaxed) ||
+        n_idle_.load(std::memory_order_relaxed) > 0) {
+      return;
+    }
+    if (n_threads > 0) {
+      auto now = Clock::now().time_since_epoch().count();
+      auto busy_since = busy_since_.load(std::memory_order_relaxed);
+      if (busy_since == 0) {
+        busy_since_.compare_exchange_strong(busy_since, now);
+        return;
+      }
+      if (Clock::duration{now - busy_since} < grow_after_ ||
+          !busy_since_.compare_exchange_strong(busy_since, now)) {
+        return;
+      }
+    }
+    Lock lock{&threads_mutex_};
+    if (!shutting_down_ && n_threads_.load() < max_threads_.load()) {
+      start_worker();
+    }
+  }
+
+  /** Take one of the exits requested by resize, if there are any. */
+  bool claim_retirement() noexcept {
+    auto n_to_retire = n_to_retire_.load(std::memory_order_relaxed);
+    while (n_to_retire > 0) {
+      if (n_to_retire_.compare_exchange_weak(n_to_retire, n_to_retire - 1)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Leave the pool after idling, if it is above its minimum size. */
+  bool claim_idle_retirement() noexcept {
+    auto current = n_threads_.load();
+    while (current > min_threads_.load(std::memory_order_relaxed)) {
+      if (n_threads_.compare_exchange_weak(current, current - 1)) {
+        // Pairs with the fence in the push event's notify, so that either a
+        // submitter sees there are no workers left and starts one, or the
+        // last worker sees the submitted task and stays.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (current == 1 && !queue_.empty()) {
+          n_threads_.fetch_add(1);
+          return false;
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Free the slot of a worker that is exiting, so it can be reused. */
+  void retire(unsigned index) ABSL_LOCKS_EXCLUDED(threads_mutex_) {
+    Lock lock{&threads_mutex_};
+    free_slots_.push_back(index);
+  }
+
+  /**
+   * The pool's timer wheel, started on first use, or null if the pool is
+   * shutting down.
+   */
+  TimerWheel* timers() ABSL_LOCKS_EXCLUDED(threads_mutex_) {
+    auto* wheel = timers_.load(std::memory_order_acquire);
+    if (wheel != nullptr) {
+      return wheel;
+    }
+    Lock lock{&threads_mutex_};
+    if (shutting_down_) {
+      return nullptr;
+    }
+    if (!timer_wheel_) {
+      timer_wheel_.reset(new TimerWheel{
+          [this](UniqueTask&& task) {
+            assert(task && "Empty tasks are reserved to signal shutdown.");
+            if (max_queued_ != 0) {
+              n_unstarted_.fetch_add(1);
+            }
+            enqueue_admitted(Task{std::move(task)});
+          },
+          timer_resolution_});
+      timers_.store(timer_wheel_.get(), std::memory_order_release);
+    }
+    return timer_wheel_.get();
+  }
+
+  /**
+   * Wrap @p func so that it is only called if @p token has not been
+   * cancelled by the time a worker takes it.
+   */
+  template <typename Function>
+  static auto unless_cancelled(CancellationToken token, Function&& func) {
+    return [token = std::move(token),
+            func = std::forward<Function>(func)]() mutable {
+      if (!token.is_cancelled()) {
+        func();
+      }
+    };
+  }
+
+  template <typename Rep, typename Period>
+  static std::chrono::steady_clock::duration to_duration(
+      std::chrono::duration<Rep, Period> const& duration) {
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        duration);
+  }
+
+  /**
+   * Add a task to the queue, or to the calling worker's run_next slot if
+   * enabled, once there is space for it.
+   */
+  void enqueue(Task&& task) {
+    if (!admit(task)) {
+      return;
+    }
+    enqueue_admitted(std::move(task));
+  }
+
+  /** Add a task which has been admitted to the queue. */
+  void enqueue_admitted(Task&& task) {
+    stats_.tasks_submitted(1);
+    if (run_next_ && swap_into_run_next(task)) {
+      return;
+    }
+    queue_.push(std::move(task));
+    maybe_grow();
+  }
+
+  /**
+   * If called from one of this pool's workers, swap @p task with the task in
+   * the worker's run_next slot. Filling an empty slot wakes an idle worker,
+   * if there is one, to steal the task rather than leave it waiting for the
+   * current task to finish.
+   *
+   * @return Whether the slot was empty, leaving nothing to queue.
+   */
+  bool swap_into_run_next(Task& task) {
+    auto* context = WorkerContext::current();
+    if (context == nullptr || context->pool != this) {
+      return false;
+    }
+    {
+      Lock lock{&context->run_next->mutex};
+      std::swap(task, context->run_next->task);
+      if (task) {
+        // The displaced task is queued by the caller, which wakes a worker.
+        return false;
+      }
+      // Counting the task before checking for idle workers pairs with
+      // wait_for_task counting the worker as idle before checking for
+      // tasks, so either the idle worker sees the task or it is woken.
+      n_run_next_.fetch_add(1);
+    }
+    if (n_idle_.load() > 0) {
+      queue_.push_event().notify(1);
+    }
+    return true;
+  }
+
+  /** Add a task to the queue's lane for @p priority. */
+  void enqueue(Task&& task, TaskPriority priority) {
+    if (!admit(task)) {
+      return;
+    }
+    stats_.tasks_submitted(1);
+    queue_.push(std::move(task), priority);
+    maybe_grow();
+  }
+
+  /**
+   * Move a batch of tasks to the queue. If the pool is full part way through,
+   * the tasks admitted so far are queued before waiting for space or running
+   * the next task on the caller.
+   */
+  void enqueue_bulk(std::vector<Task>& tasks) {
+    if (stopped_.load() && !on_worker()) {
+      for (auto& task : tasks) {
+        refuse(task);
+      }
+      return;
+    }
+    if (max_queued_ == 0) {
+      enqueue_range(tasks.begin(), tasks.end());
+      return;
+    }
+    auto first = tasks.begin();
+    auto last = first;
+    while (last != tasks.end()) {
+      if (try_reserve_space()) {
+        ++last;
+        continue;
+      }
+      enqueue_range(first, last);
+      first = last;
+      if (!admit(*last)) {
+        // The task was run by the caller, or refused, so is not queued.
+        ++first;
+      }
+      ++last;
+    }
+    enqueue_range(first, last);
+  }
+
+  /** Move the admitted tasks in the range to the queue. */
+  template <typename Iterator>
+  void enqueue_range(Iterator first, Iterator last) {
+    if (first == last) {
+      return;
+    }
+    stats_.tasks_submitted(static_cast<size_t>(std::distance(first, last)));
+    queue_.push_bulk(first, last);
+    maybe_grow();
+  }
+
+  /**
+   * Take a place for @p task among the PoolOptions::max_queued tasks waiting
+   * to start, if set, waiting for one or running the task on the caller if
+   * there is no space, as set by the backpressure policy.
+   *
+   * A task added from outside the pool once it is shutting down is refused
+   * instead, as no worker would run it, and dropped, storing TaskCancelled in
+   * any future for it.
+   *
+   * @return Whether the task should now be queued, or false if it was run or
+   * dropped.
+   */
+  bool admit(Task& task) {
+    if (stopped_.load() && !on_worker()) {
+      refuse(task);
+      return false;
+    }
+    if (max_queued_ == 0 || try_reserve_space()) {
+      return true;
+    }
+    if (backpressure_ == BackpressurePolicy::caller_runs) {
+      n_rejected_.fetch_add(1, std::memory_order_relaxed);
+      run_on_caller(task);
+      return false;
+    }
+    if (on_worker()) {
+      // Waiting on a worker could deadlock the pool, so go over the limit.
+      n_unstarted_.fetch_add(1);
+      return true;
+    }
+    while (true) {
+      auto key = space_event_.prepare_wait();
+      if (stopped_.load()) {
+        space_event_.cancel_wait();
+        refuse(task);
+        return false;
+      }
+      if (try_reserve_space()) {
+        space_event_.cancel_wait();
+        return true;
+      }
+      space_event_.commit_wait(key);
+      if (try_reserve_space()) {
+        return true;
+      }
+    }
+  }
+
+  /** Whether the calling thread is one of this pool's workers. */
+  bool on_worker() const noexcept {
+    auto* context = WorkerContext::current();
+    return context != nullptr && context->pool == this;
+  }
+
+  /**
+   * Drop a task added to a pool that is shutting down, counting it as
+   * rejected. This stores TaskCancelled in any future for the task.
+   */
+  void refuse(Task& task) noexcept {
+    n_rejected_.fetch_add(1, std::memory_order_relaxed);
+    task.reset();
+  }
+
+  /**
+   * Take a place among the PoolOptions::max_queued tasks waiting to start if
+   * there is one, counting the task as rejected otherwise, or if the pool is
+   * shutting down.
+   */
+  bool try_admit() noexcept {
+    if (!stopped_.load() && (max_queued_ == 0 || try_reserve_space())) {
+      return true;
+    }
+    n_rejected_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  /** Take a place among the max_queued_ tasks waiting to start, if any. */
+  bool try_reserve_space() noexcept {
+    auto n_unstarted = n_unstarted_.load(std::memory_order_relaxed);
+    while (n_unstarted < max_queued_) {
+      if (n_unstarted_.compare_exchange_weak(n_unstarted, n_unstarted + 1)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Give up the place of a task that has been started. */
+  void release_space() {
+    n_unstarted_.fetch_sub(1);
+    space_event_.notify(1);
+  }
+
+  /** Run a task that did not fit in the queue on the calling thread. */
+  void run_on_caller(Task& task) {
+    try {
       task();
+    } catch (...) {
+      handle_error(std::current_exception());
+    }
+    task.reset();
+  }
+
+  /**
+   * Whether there may be tasks in the queue, or in any worker's batch or
+   * run_next slot. This is cheap and never blocks.
+   */
+  bool has_queued_tasks() const noexcept {
+    return !queue_.empty() || n_batched_.load(std::memory_order_relaxed) > 0 ||
+           n_run_next_.load(std::memory_order_relaxed) > 0;
+  }
+
+  /**
+   * Wait until a task can be taken from the queue, or stolen from another
+   * worker's batch or run_next slot.
+   *
+   * @return Whether a task was taken, or false if the worker should instead
+   * exit, either as asked by resize or after idling above the pool's minimum
+   * size.
+   */
+  bool wait_for_task(WorkerContext& context, Task& task) {
+    n_idle_.fetch_add(1);
+    if (busy_since_.load(std::memory_order_relaxed) != 0) {
+      busy_since_.store(0, std::memory_order_relaxed);
+    }
+    bool retiring = false;
+    while (true) {
+      auto timeout = n_threads_.load(std::memory_order_relaxed) >
+                             min_threads_.load(std::memory_order_relaxed)
+                         ? idle_timeout_
+                         : std::chrono::nanoseconds::max();
+      bool taken = idle_wait_for(
+          idle_policy_, queue_.push_event(),
+          [this] {
+            return has_queued_tasks() ||
+                   n_to_retire_.load(std::memory_order_relaxed) > 0;
+          },
+          [this, &context, &task, &retiring] {
+            retiring = claim_retirement();
+            return retiring || try_pop(context, task);
+          },
+          timeout);
+      if (taken || claim_idle_retirement()) {
+        retiring = retiring || !taken;
+        break;
+      }
+    }
+    n_idle_.fetch_sub(1);
+    return !retiring;
+  }
+
+  /** Pass an exception thrown by a task to the pool's error handler. */
+  void handle_error(std::exception_ptr error) const noexcept {
+    if (!error_handler_) {
+      std::terminate();
+    }
+    try {
+      error_handler_(std::move(error));
+    } catch (...) {
+      std::terminate();
     }
   }
 
+  /** Mutex guarding the worker threads, used when starting or retiring one. */
+  Mutex threads_mutex_;
   /**
    * Pool of worker threads, used to execute queued tasks. Each worker thread
-   * should invoke the ThreadPool::worker_loop.
+   * should invoke the ThreadPool::worker_loop. Workers that have exited keep
+   * their slot until it is reused or the pool is destroyed, so that they can
+   * be joined.
    */
-  ThreadContainer thread_pool_;
+  ThreadContainer thread_pool_ ABSL_GUARDED_BY(threads_mutex_);
+  /** Slots in thread_pool_ whose worker has exited. */
+  SlotContainer free_slots_ ABSL_GUARDED_BY(threads_mutex_);
+  /** Set once the pool starts shutting down, after which no workers start. */
+  bool shutting_down_ ABSL_GUARDED_BY(threads_mutex_) = false;
   /**
-   * Mutex to guard the shared task queue, so that only one thread will execute
-   * a given task, and queued tasks will not get lost. This means that not only
-   * can this handle multiple workers it can also handle getting tasks from
-   * multiple threads at once.
+   * The shared queue of tasks to be done. The queue policy must handle tasks
+   * being added and removed from many threads at once, so that only one thread
+   * will execute a given task, and queued tasks will not get lost.
    */
-  Mutex mutex_;
-  /** The queue of tasks to be done. */
-  TaskQueue queue_ ABSL_GUARDED_BY(mutex_);
+  TaskQueue queue_;
+  /** How idle workers wait for new tasks. */
+  IdlePolicy const idle_policy_;
+  /** Handler for exceptions thrown by tasks added without a future. */
+  ErrorHandler const error_handler_;
+  /** CPUs that each worker is pinned to, by worker index. */
+  std::vector<CpuSet> const worker_affinity_;
+  /** How long all workers must be busy before an elastic pool grows. */
+  std::chrono::nanoseconds const grow_after_;
+  /** How long a worker above the minimum size idles before exiting. */
+  std::chrono::nanoseconds const idle_timeout_;
+  /** The number of workers the pool keeps even when idle. */
+  std::atomic<unsigned> min_threads_;
+  /** The number of workers an elastic pool can grow to. */
+  std::atomic<unsigned> max_threads_;
+  /** The number of workers, not counting those told to exit by resize. */
+  std::atomic<unsigned> n_threads_{0};
+  /** The number of workers told to exit by resize that have not yet done so. */
+  std::atomic<unsigned> n_to_retire_{0};
+  /** The number of workers waiting for a task. */
+  std::atomic<unsigned> n_idle_{0};
+  /**
+   * Time, as a count of Clock ticks, since when all workers have been busy,
+   * or zero if a worker has been idle since the last check.
+   */
+  std::atomic<Clock::rep> busy_since_{0};
+  /** Statistics about the pool's tasks, if enabled with ACORN_POOL_STATS. */
+  PoolStats stats_;
+  /** How the destructor shuts down the pool. */
+  ShutdownMode const shutdown_mode_;
+  /** Whether tasks submitted from workers go to their run_next slot. */
+  bool const run_next_;
+  /** Maximum number of tasks a worker takes from the queue at once. */
+  size_t const dequeue_batch_;
+  /** Maximum number of tasks waiting to start, or zero for no limit. */
+  size_t const max_queued_;
+  /** What adding a task does once max_queued_ tasks are waiting. */
+  BackpressurePolicy const backpressure_;
+  /** Number of tasks queued but not yet started, if max_queued_ is set. */
+  std::atomic<size_t> n_unstarted_{0};
+  /** Number of tasks refused, or run by the caller, as the pool was full. */
+  std::atomic<size_t> n_rejected_{0};
+  /** Event notified when a task is started, freeing up space. */
+  EventCount space_event_;
+  /** Set once the pool starts shutting down, after which tasks are refused. */
+  std::atomic<bool> stopped_{false};
+  /** Mutex guarding the list of batch buffers, but not their tasks. */
+  Mutex batches_mutex_;
+  /** Batch buffer for each worker slot, if tasks are taken in batches. */
+  BatchContainer batches_ ABSL_GUARDED_BY(batches_mutex_);
+  /** Number of tasks held across all workers' batches. */
+  std::atomic<size_t> n_batched_{0};
+  /** Mutex guarding the list of run_next slots, but not their tasks. */
+  Mutex run_next_mutex_;
+  /** The run_next slot for each worker slot, if run_next is enabled. */
+  RunNextContainer run_next_slots_ ABSL_GUARDED_BY(run_next_mutex_);
+  /** Number of tasks held across all workers' run_next slots. */
+  std::atomic<size_t> n_run_next_{0};
+  /** Set when shutting down in ShutdownMode::discard. */
+  std::atomic<bool> discarding_{false};
+  /** Length of each tick of the timer wheel. */
+  std::chrono::nanoseconds const timer_resolution_;
+  /**
+   * Timer wheel holding delayed and periodic tasks, started on first use.
+   * This is declared last so that its thread is stopped before the queue it
+   * adds tasks to is destroyed.
+   */
+  std::unique_ptr<TimerWheel> timer_wheel_ ABSL_GUARDED_BY(threads_mutex_);
+  /** Copy of timer_wheel_ which can be read without the mutex. */
+  std::atomic<TimerWheel*> timers_{nullptr};
 };
 
+/** Thread pool with a single mutex guarded queue shared by all workers. */
+using SharedThreadPool = BasicSharedThreadPool<LockedTaskQueue>;
+
+/**
+ * Thread pool with a single lock-free bounded queue shared by all workers.
+ *
+ * @tparam Capacity Maximum number of queued tasks, after which submitting a
+ *         task will block until space is available.
+ */
+template <size_t Capacity = 1024>
+using LockFreeSharedThreadPool =
+    BasicSharedThreadPool<LockFreeTaskQueue<Capacity>>;
+
+/**
+ * Thread pool with a task queue for each NUMA node, where workers prefer tasks
+ * submitted on their own node.
+ *
+ * Workers should be pinned to nodes, for example by setting
+ * PoolOptions::worker_affinity to per_node_affinity(CpuTopology::discover()),
+ * otherwise the node a worker takes tasks from follows wherever the scheduler
+ * happens to run it.
+ */
+using NumaSharedThreadPool = BasicSharedThreadPool<NumaTaskQueue>;
+
 }  // namespace acorn
 
 #endif  // ACORN_THREADS_SHARED_THREAD_POOL_H_
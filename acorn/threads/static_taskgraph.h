@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_STATIC_TASKGRAPH_H_
+#define ACORN_THREADS_STATIC_TASKGRAPH_H_
+
+#include "acorn/threads/event_count.h"
+#include "acorn/threads/future.h"
+#include "acorn/threads/idle_policy.h"
+#include "acorn/threads/shared_thread_pool.h"
+#include "acorn/threads/unique_task.h"
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <utility>
+#include <vector>
+
+namespace acorn {
+
+/**
+ * A task graph which is built once and can then be run many times.
+ *
+ * Nodes are added with add, each naming the nodes it depends on, which must
+ * already have been added. This allocates, but is done once. Each call to run
+ * then only resets every node's atomic count of unfinished dependencies and
+ * queues the nodes without dependencies on the pool. As each node finishes it
+ * counts down its dependees, queuing those that become ready, except for one
+ * which it runs straight away on the same worker. No locks are taken and no
+ * memory is allocated by the graph itself while it runs.
+ *
+ * The node functions are called once per run, so must be callable repeatedly.
+ * The graph must not be changed, or run again, while it is running.
+ */
+struct StaticTaskGraph {
+ private:
+  /** A node of the graph along with its dependency tracking. */
+  struct InternalNode {
+    /* The work done by this node on each run. */
+    UniqueTask function;
+    /* Number of nodes that must finish before this node runs. */
+    size_t n_dependencies = 0;
+    /* Number of those nodes still to finish in the current run. */
+    std::atomic<size_t> n_remaining{0};
+    /* Nodes that depend on this node. */
+    std::vector<size_t> dependees;
+  };
+  using NodeContainer = std::deque<InternalNode>;
+
+  /** Whether the graph is running, or a run is finishing. */
+  enum class Phase { idle, running, finishing };
+
+ public:
+  /** Identifies a node of the graph, to name as a dependency of later nodes. */
+  struct Node {
+    size_t const node_id;
+  };
+
+  /** Construct an empty graph whose runs execute on @p pool. */
+  explicit StaticTaskGraph(SharedThreadPool& pool) noexcept : pool_{pool} {}
+
+  StaticTaskGraph(StaticTaskGraph const&) = delete;
+  StaticTaskGraph& operator=(StaticTaskGraph const&) = delete;
+
+  /**
+   * Add a node calling @p func on each run, once all of @p deps have finished
+   * in that run.
+   *
+   * @return The new node, which can be used as a dependency of later nodes.
+   */
+  template <typename Function, typename... Deps>
+  Node add(Function&& func, Deps const&... deps) {
+    assert(phase_.load() == Phase::idle && "Graph changed while running.");
+    constexpr size_t NumDeps = sizeof...(Deps);
+
+    size_t node_id = nodes_.size();
+    nodes_.emplace_back();
+    auto& node = nodes_.back();
+    node.function = UniqueTask{std::forward<Function>(func)};
+    node.n_dependencies = NumDeps;
+    if (NumDeps == 0) {
+      roots_.push_back(node_id);
+    }
+    std::array<Node, NumDeps> node_deps{deps...};
+    for (auto&& dep : node_deps) {
+      assert(dep.node_id < node_id && "Dependencies must be added first.");
+      nodes_[dep.node_id].dependees.push_back(node_id);
+    }
+    return {node_id};
+  }
+
+  /** The number of nodes in the graph. */
+  size_t size() const noexcept { return nodes_.size(); }
+
+  /**
+   * Run every node of the graph once, in dependency order, and wait for them
+   * all to finish.
+   *
+   * Called from one of the pool's workers, this runs queued tasks while it
+   * waits, as for waiting on a Future. If any node throws, the other nodes
+   * still run, and the first exception is rethrown once the run is done.
+   */
+  void run() {
+    if (nodes_.empty()) {
+      return;
+    }
+    auto expected = Phase::idle;
+    if (!phase_.compare_exchange_strong(expected, Phase::running)) {
+      assert(false && "StaticTaskGraph run while already running.");
+      return;
+    }
+    for (auto& node : nodes_) {
+      node.n_remaining.store(node.n_dependencies, std::memory_order_relaxed);
+    }
+    n_unfinished_.store(nodes_.size(), std::memory_order_relaxed);
+    has_error_.store(false, std::memory_order_relaxed);
+    error_ = nullptr;
+    auto* helper = FutureWaitHelper::current();
+    helper_event_ = helper != nullptr ? &helper->work_event() : nullptr;
+    // Queuing the roots publishes the reset counters to the workers.
+    for (auto root : roots_) {
+      queue_node(root);
+    }
+    wait(helper);
+    if (error_) {
+      auto error = std::move(error_);
+      error_ = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+
+ private:
+  /** Queue the node with ID @p node_id on the pool. */
+  void queue_node(size_t node_id) {
+    pool_.execute([this, node_id] { run_from(node_id); });
+  }
+
+  /**
+   * Run the node with ID @p node_id, then keep running one of the dependees
+   * made ready by each node on this worker, queuing any others.
+   */
+  void run_from(size_t node_id) {
+    while (true) {
+      auto& node = nodes_[node_id];
+      try {
+        node.function();
+      } catch (...) {
+        record_error(std::current_exception());
+      }
+      size_t const none = nodes_.size();
+      size_t next = none;
+      for (auto dependee : node.dependees) {
+        if (nodes_[dependee].n_remaining.fetch_sub(
+                1, std::memory_order_acq_rel) == 1) {
+          if (next == none) {
+            next = dependee;
+          } else {
+            queue_node(dependee);
+          }
+        }
+      }
+      if (n_unfinished_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        finish();
+        return;
+      }
+      if (next == none) {
+        return;
+      }
+      node_id = next;
+    }
+  }
+
+  /** Keep the first exception thrown by a node in this run. */
+  void record_error(std::exception_ptr error) noexcept {
+    if (!has_error_.exchange(true, std::memory_order_acq_rel)) {
+      error_ = std::move(error);
+    }
+  }
+
+  /**
+   * Mark the run as done and wake the thread waiting in run. The phase only
+   * returns to idle once nothing else in the graph will be touched, so that
+   * the graph can then be destroyed.
+   */
+  void finish() {
+    phase_.store(Phase::finishing, std::memory_order_release);
+    done_event_.notify_all();
+    if (helper_event_ != nullptr) {
+      helper_event_->notify_all();
+    }
+    phase_.store(Phase::idle, std::memory_order_release);
+  }
+
+  /**
+   * Wait for the run to finish, running other work through @p helper while
+   * waiting if there is one.
+   */
+  void wait(FutureWaitHelper* helper) {
+    auto is_running = [this] {
+      return phase_.load(std::memory_order_acquire) == Phase::running;
+    };
+    auto& event = helper != nullptr ? helper->work_event() : done_event_;
+    while (is_running()) {
+      if (helper != nullptr && helper->try_run_one()) {
+        continue;
+      }
+      auto key = event.prepare_wait();
+      if (!is_running() || (helper != nullptr && helper->has_work())) {
+        event.cancel_wait();
+        continue;
+      }
+      event.commit_wait(key);
+    }
+    while (phase_.load(std::memory_order_acquire) != Phase::idle) {
+      cpu_relax();
+    }
+  }
+
+  /** Pool that runs the graph's nodes. */
+  SharedThreadPool& pool_;
+  /** All nodes of the graph, indexed by their ID. */
+  NodeContainer nodes_;
+  /** IDs of the nodes without dependencies, which start each run. */
+  std::vector<size_t> roots_;
+  /** Whether the graph is running. */
+  std::atomic<Phase> phase_{Phase::idle};
+  /** Number of nodes still to finish in the current run. */
+  std::atomic<size_t> n_unfinished_{0};
+  /** Set once a node has thrown in the current run. */
+  std::atomic<bool> has_error_{false};
+  /** The first exception thrown by a node in the current run. */
+  std::exception_ptr error_;
+  /** Event notified when a run finishes. */
+  EventCount done_event_;
+  /** Work event of the helper of the thread waiting in run, if any. */
+  EventCount* helper_event_ = nullptr;
+};
+
+}  // namespace acorn
+
+#endif  // ACORN_THREADS_STATIC_TASKGRAPH_H_
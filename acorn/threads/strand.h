@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_STRAND_H_
+#define ACORN_THREADS_STRAND_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <utility>
+
+#include "acorn/threads/future.h"
+#include "acorn/threads/idle_policy.h"
+#include "acorn/threads/shared_thread_pool.h"
+#include "acorn/threads/unique_task.h"
+
+namespace acorn {
+
+/**
+ * Maximum number of tasks a strand runs in a single pool task before queuing
+ * itself again, so that a busy strand does not starve other work in the pool.
+ */
+constexpr unsigned StrandDrainLimit = 64;
+
+/**
+ * A serial executor layered on a thread pool, which runs its tasks one at a
+ * time in the order they were added.
+ *
+ * Tasks are added to a lock-free intrusive queue, and the strand only has a
+ * task in the pool while it has tasks to run, which then runs the strand's
+ * tasks in turn. Nothing blocks a pool worker, so many strands, such as one
+ * per connection or per key, can share a single pool. Each task sees the
+ * effects of the strand's earlier tasks, even when they ran on another
+ * worker.
+ *
+ * The pool must outlive the strand. Destroying a strand waits for its queued
+ * tasks to finish, so a strand must not be destroyed from one of its own
+ * tasks, nor after its pool has been shut down with tasks still queued on the
+ * strand.
+ *
+ * @tparam Pool Type of the thread pool that runs the strand's tasks.
+ */
+template <typename Pool = SharedThreadPool>
+struct BasicStrand {
+ private:
+  /** A queued task, linked to the task queued after it. */
+  struct Node {
+    std::atomic<Node*> next{nullptr};
+    UniqueTask task;
+  };
+
+ public:
+  /** Construct a strand running its tasks on @p pool. */
+  explicit BasicStrand(Pool& pool) noexcept
+      : pool_{pool}, head_{&stub_}, tail_{&stub_} {}
+
+  BasicStrand(BasicStrand const&) = delete;
+  BasicStrand& operator=(BasicStrand const&) = delete;
+
+  /** Wait for any queued tasks to finish, then tear down the strand. */
+  ~BasicStrand() {
+    while (n_pending_.load(std::memory_order_acquire) != 0) {
+      std::this_thread::yield();
+    }
+    if (tail_ != &stub_) {
+      delete tail_;
+    }
+  }
+
+  /**
+   * Add a fire-and-forget task to run on the strand once all the tasks added
+   * before it have finished.
+   *
+   * As for BasicSharedThreadPool::execute, any exception thrown by the task is
+   * passed to the pool's error handler. The strand then carries on with its
+   * next task.
+   */
+  template <typename Function>
+  void execute(Function&& func) {
+    post(UniqueTask{std::forward<Function>(func)});
+  }
+
+  /**
+   * Add a task to run on the strand once all the tasks added before it have
+   * finished.
+   *
+   * @return An acorn::Future which will be filled in with the return value of
+   * the task once completed.
+   */
+  template <typename Function>
+  auto submit(Function&& func) -> Future<decltype(func())> {
+    using Return = decltype(func());
+    Promise<Return> promise;
+    auto future = promise.get_future();
+    post(UniqueTask{[promise = std::move(promise),
+                     func = std::forward<Function>(func)]() mutable {
+      fulfil_promise(promise, func);
+    }});
+    return future;
+  }
+
+ private:
+  /**
+   * Queue a task, and queue the strand on the pool if it had no tasks
+   * pending.
+   */
+  void post(UniqueTask&& task) {
+    assert(task && "Empty tasks cannot be run.");
+    auto* node = new Node{};
+    node->task = std::move(task);
+    // The node must be in the queue before it is counted, so that the drain
+    // always finds as many tasks as it has been told about.
+    auto* previous = head_.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+    if (n_pending_.fetch_add(1, std::memory_order_acq_rel) == 0) {
+      schedule();
+    }
+  }
+
+  /** Queue a task on the pool to run the strand's pending tasks. */
+  void schedule() {
+    pool_.execute([this] { drain(); });
+  }
+
+  /**
+   * Run the strand's pending tasks in order, until either none are left or
+   * StrandDrainLimit tasks have run, in which case the strand is queued on
+   * the pool again. Only one drain runs at a time, as a new one is only
+   * queued by the task that takes the count of pending tasks up from zero.
+   */
+  void drain() {
+    for (unsigned n_run = 1;; ++n_run) {
+      auto error = run_front();
+      // Once the count reaches zero another thread may add a task and start
+      // a new drain, or destroy the strand, so nothing else can be touched.
+      if (n_pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        rethrow_if(error);
+        return;
+      }
+      if (error || n_run == StrandDrainLimit) {
+        // Queue the rest of the tasks before passing any error on, so that
+        // the pool's error handler does not stall the strand.
+        schedule();
+        rethrow_if(error);
+        return;
+      }
+    }
+  }
+
+  /**
+   * Take the task at the front of the queue and run it.
+   *
+   * @return Any exception thrown by the task.
+   */
+  std::exception_ptr run_front() {
+    auto* front = tail_;
+    auto* next = front->next.load(std::memory_order_acquire);
+    while (next == nullptr) {
+      // A task has been counted whose producer has not yet linked it in.
+      cpu_relax();
+      next = front->next.load(std::memory_order_acquire);
+    }
+    // The node holding the task becomes the queue's new empty front.
+    tail_ = next;
+    if (front != &stub_) {
+      delete front;
+    }
+    auto task = std::move(next->task);
+    try {
+      task();
+    } catch (...) {
+      return std::current_exception();
+    }
+    return nullptr;
+  }
+
+  static void rethrow_if(std::exception_ptr const& error) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  /** The pool that runs the strand's tasks. */
+  Pool& pool_;
+  /** Empty node which the queue starts with. */
+  Node stub_;
+  /** The most recently queued node, which producers append to. */
+  std::atomic<Node*> head_;
+  /**
+   * The node before the next task to run, whose task has already been taken.
+   * This is only used by the drain.
+   */
+  Node* tail_;
+  /** Number of tasks queued or running. */
+  std::atomic<size_t> n_pending_{0};
+};
+
+/** Strand running its tasks on a SharedThreadPool. */
+using Strand = BasicStrand<SharedThreadPool>;
+
+}  // namespace acorn
+
+#endif  // ACORN_THREADS_STRAND_H_
@@ -0,0 +1,794 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_TASK_QUEUE_H_
+#define ACORN_THREADS_TASK_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+#include "acorn/container/bounded_mpmc_queue.h"
+#include "acorn/threads/cpu_topology.h"
+#include "acorn/threads/event_count.h"
+#include "acorn/threads/pool_options.h"
+#include "acorn/threads/pool_stats.h"
+#include "acorn/threads/unique_task.h"
+
+namespace acorn {
+
+#ifdef ACORN_POOL_STATS
+
+/**
+ * The type-erased unit of work held in a thread pool's task queue, along with
+ * the time it was created so that the time it spends queued can be measured.
+ *
+ * An empty task is used to signal to a worker that it should exit.
+ */
+struct PoolTask : UniqueTask {
+  using UniqueTask::UniqueTask;
+
+  PoolTask() noexcept = default;
+  PoolTask(UniqueTask&& task) noexcept : UniqueTask{std::move(task)} {}
+
+  /** When the task was created. */
+  PoolStats::TimePoint created = PoolStats::Clock::now();
+};
+
+#else  // ACORN_POOL_STATS
+
+/**
+ * The type-erased unit of work held in a thread pool's task queue.
+ *
+ * An empty task is used to signal to a worker that it should exit.
+ */
+using PoolTask = UniqueTask;
+
+#endif  // ACORN_POOL_STATS
+
+/**
+ * Statistics for one priority lane of a task queue.
+ *
+ * Waits are only timed once a task has been queued with a priority other than
+ * normal, so that a pool which only uses the normal lane never reads the
+ * clock. Tasks taken before then are counted in n_dequeued but not n_timed.
+ */
+struct TaskLaneStats {
+  /** Number of tasks currently queued in the lane. */
+  size_t depth = 0;
+  /** Number of tasks taken from the lane so far. */
+  size_t n_dequeued = 0;
+  /** Number of tasks taken from the lane whose wait was timed. */
+  size_t n_timed = 0;
+  /** Total time that the timed tasks taken from the lane spent queued. */
+  std::chrono::nanoseconds total_wait{0};
+  /** Longest time that any timed task taken from the lane spent queued. */
+  std::chrono::nanoseconds max_wait{0};
+
+  /** Mean time that the timed tasks taken from the lane spent queued. */
+  std::chrono::nanoseconds mean_wait() const noexcept {
+    return n_timed == 0 ? std::chrono::nanoseconds{0}
+                        : total_wait / static_cast<int64_t>(n_timed);
+  }
+};
+
+/**
+ * The number of tasks out of @p n_tasks that each of @p n_consumers consumers
+ * should take in a batch, so that the others are left some to take. This is
+ * never zero while there are tasks.
+ */
+inline size_t fair_share(size_t n_tasks, size_t n_consumers) noexcept {
+  n_consumers = std::max<size_t>(n_consumers, 1);
+  return (n_tasks + n_consumers - 1) / n_consumers;
+}
+
+/**
+ * Task queue policy for the SharedThreadPool using mutex guarded, unbounded
+ * FIFO queues, with one lane for each TaskPriority.
+ *
+ * A task queue policy provides:
+ *  - a constructor taking the pool's PoolOptions,
+ *  - @c push(PoolTask&&), which adds a task to the back of the queue,
+ *  - @c push_bulk(first, last), which moves a range of tasks to the back of
+ *    the queue,
+ *  - @c try_pop(PoolTask&), which removes the task at the front of the queue
+ *    if there is one, without blocking,
+ *  - @c try_pop_task(PoolTask&), which is like try_pop but never takes an
+ *    empty task,
+ *  - @c try_pop_bulk(tasks, max_tasks, n_consumers), which moves up to
+ *    @c max_tasks tasks, but no more than a fair share of those queued, to the
+ *    back of a container without blocking, and never takes an empty task,
+ *  - @c empty(), which is a cheap, possibly stale, check for whether the queue
+ *    has no tasks that does not block, and
+ *  - @c push_event(), an EventCount which is notified once for each task
+ *    pushed, so that idle consumers can park on it.
+ *
+ * The queue never blocks a consumer, instead the pool decides how its idle
+ * workers wait for tasks.
+ *
+ * This policy also provides @c push(PoolTask&&, TaskPriority) and
+ * @c lane_stats(TaskPriority). Tasks are taken from the highest priority lane
+ * that has any, except that a task which has been queued for longer than
+ * PoolOptions::priority_aging is taken ahead of tasks in higher lanes, so
+ * that lower lanes are not starved. At most one in every
+ * PriorityAgingInterval tasks taken is an aged task from a lower lane, so a
+ * large aged backlog does not starve the higher lanes in turn. Tasks are only
+ * timestamped once a task has been pushed to a lane other than normal, so a
+ * pool which never uses priorities does not read the clock for each task.
+ *
+ * Empty tasks, used to signal shutdown, are only handed out once every lane is
+ * empty, and are not counted by @c empty(). This holds for every queue policy,
+ * so that a worker waiting on a Future can keep running tasks without taking
+ * a shutdown signal meant for the worker's top level loop.
+ */
+struct LockedTaskQueue {
+ private:
+  using Mutex = absl::Mutex;
+  using Lock = absl::MutexLock;
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * A queued task along with the time it was queued, or the epoch if it was
+   * queued before the queue started timing tasks.
+   */
+  struct QueuedTask {
+    PoolTask task;
+    Clock::time_point enqueued;
+  };
+  using LaneContainer = std::deque<QueuedTask>;
+
+  /** The queued tasks of a single priority, and statistics about them. */
+  struct Lane {
+    LaneContainer tasks;
+    size_t n_dequeued = 0;
+    size_t n_timed = 0;
+    Clock::duration total_wait{0};
+    Clock::duration max_wait{0};
+  };
+
+ public:
+  LockedTaskQueue() = default;
+
+  /** Construct a queue using the priority aging set in @p options. */
+  explicit LockedTaskQueue(PoolOptions const& options)
+      : aging_{options.priority_aging} {}
+
+  /** Add a task to the back of the normal priority lane. */
+  void push(PoolTask&& task) ABSL_LOCKS_EXCLUDED(mutex_) {
+    push(std::move(task), TaskPriority::normal);
+  }
+
+  /** Add a task to the back of the lane for @p priority. */
+  void push(PoolTask&& task, TaskPriority priority)
+      ABSL_LOCKS_EXCLUDED(mutex_) {
+    auto now =
+        priority != TaskPriority::normal ? Clock::now() : read_clock();
+    {
+      Lock lock{&mutex_};
+      if (!task) {
+        ++n_shutdown_signals_;
+      } else {
+        if (priority != TaskPriority::normal) {
+          start_timing(now);
+        }
+        lane(priority).tasks.push_back(
+            QueuedTask{std::move(task), stamp(now)});
+      }
+      ++n_queued_;
+      update_size();
+    }
+    push_event_.notify(1);
+  }
+
+  /**
+   * Move all tasks in the range to the back of the normal priority lane, under
+   * a single lock and waking no more consumers than there are new tasks.
+   */
+  template <typename Iterator>
+  void push_bulk(Iterator first, Iterator last) ABSL_LOCKS_EXCLUDED(mutex_) {
+    auto now = read_clock();
+    size_t n_tasks = 0;
+    {
+      Lock lock{&mutex_};
+      now = stamp(now);
+      auto& tasks = lane(TaskPriority::normal).tasks;
+      for (; first != last; ++first, ++n_tasks) {
+        tasks.push_back(QueuedTask{std::move(*first), now});
+      }
+      n_queued_ += n_tasks;
+      update_size();
+    }
+    push_event_.notify(n_tasks);
+  }
+
+  /** Pull the next task from the queue, if there is one. */
+  bool try_pop(PoolTask& task) ABSL_LOCKS_EXCLUDED(mutex_) {
+    Lock lock{&mutex_};
+    if (n_queued_ == 0) {
+      return false;
+    }
+    auto now = read_clock();
+    Lane* next = select_lane(now);
+    if (next == nullptr) {
+      // No tasks are queued in any lane, so a shutdown signal can be handed
+      // out.
+      --n_shutdown_signals_;
+      --n_queued_;
+      task = PoolTask{};
+    } else {
+      take_front(*next, now, task);
+    }
+    return true;
+  }
+
+  /** Pull the next task from the queue, leaving any shutdown signals. */
+  bool try_pop_task(PoolTask& task) ABSL_LOCKS_EXCLUDED(mutex_) {
+    Lock lock{&mutex_};
+    if (n_queued_ == n_shutdown_signals_) {
+      return false;
+    }
+    auto now = read_clock();
+    take_front(*select_lane(now), now, task);
+    return true;
+  }
+
+  /**
+   * Move up to @p max_tasks tasks to the back of @p tasks under a single lock,
+   * taking no more than a fair share of the queued tasks between
+   * @p n_consumers consumers and leaving any shutdown signals. Tasks are taken
+   * in the same order as by try_pop.
+   *
+   * @return The number of tasks taken.
+   */
+  template <typename Container>
+  size_t try_pop_bulk(Container& tasks, size_t max_tasks, size_t n_consumers)
+      ABSL_LOCKS_EXCLUDED(mutex_) {
+    Lock lock{&mutex_};
+    auto n_tasks = std::min(
+        max_tasks, fair_share(n_queued_ - n_shutdown_signals_, n_consumers));
+    auto now = read_clock();
+    for (size_t count = 0; count < n_tasks; ++count) {
+      tasks.emplace_back();
+      take_front(*select_lane(now), now, tasks.back());
+    }
+    return n_tasks;
+  }
+
+  /**
+   * Whether the queue currently has no tasks, ignoring shutdown signals. This
+   * does not take the mutex, so spinning workers do not contend with
+   * submitters.
+   */
+  bool empty() const noexcept {
+    return size_.load(std::memory_order_relaxed) == 0;
+  }
+
+  /** Event notified when tasks are pushed. */
+  EventCount& push_event() noexcept { return push_event_; }
+
+  /** Current statistics for the lane holding tasks of @p priority. */
+  TaskLaneStats lane_stats(TaskPriority priority) ABSL_LOCKS_EXCLUDED(mutex_) {
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+    Lock lock{&mutex_};
+    auto const& stats = lane(priority);
+    TaskLaneStats result;
+    result.depth = stats.tasks.size();
+    result.n_dequeued = stats.n_dequeued;
+    result.n_timed = stats.n_timed;
+    result.total_wait = duration_cast<nanoseconds>(stats.total_wait);
+    result.max_wait = duration_cast<nanoseconds>(stats.max_wait);
+    return result;
+  }
+
+ private:
+  Lane& lane(TaskPriority priority) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return lanes_[static_cast<size_t>(priority)];
+  }
+
+  /** The current time if the queue is timing tasks, otherwise the epoch. */
+  Clock::time_point read_clock() const noexcept {
+    return timing_.load(std::memory_order_relaxed) ? Clock::now()
+                                                   : Clock::time_point{};
+  }
+
+  /**
+   * The time to stamp on a task pushed at @p now, as read before taking the
+   * lock. The clock is read again if the queue started timing tasks since.
+   */
+  Clock::time_point stamp(Clock::time_point now) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    if (timing_.load(std::memory_order_relaxed) &&
+        now == Clock::time_point{}) {
+      return Clock::now();
+    }
+    return now;
+  }
+
+  /**
+   * Start timestamping tasks, as a lane other than normal is in use. Tasks
+   * already queued are treated as queued at @p now.
+   */
+  void start_timing(Clock::time_point now)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    if (timing_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    for (auto& queued : lane(TaskPriority::normal).tasks) {
+      queued.enqueued = now;
+    }
+    timing_.store(true, std::memory_order_relaxed);
+  }
+
+  /**
+   * The lane to take the next task from. This is the highest priority lane
+   * with any tasks, unless the front task of a lower lane has waited longer
+   * than the aging limit and no aged task has been taken in the last
+   * PriorityAgingInterval tasks. Until the queue is timing tasks only the
+   * normal lane is in use, so there is nothing to age.
+   */
+  Lane* select_lane(Clock::time_point now)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    if (!timing_.load(std::memory_order_relaxed)) {
+      auto& normal = lane(TaskPriority::normal);
+      return normal.tasks.empty() ? nullptr : &normal;
+    }
+    Lane* highest = nullptr;
+    bool const can_age = n_since_aged_ >= PriorityAgingInterval - 1;
+    for (auto& lane : lanes_) {
+      if (lane.tasks.empty()) {
+        continue;
+      }
+      if (highest == nullptr) {
+        highest = &lane;
+        if (!can_age) {
+          break;
+        }
+      } else if (now - lane.tasks.front().enqueued >= aging_) {
+        n_since_aged_ = 0;
+        return &lane;
+      }
+    }
+    if (highest != nullptr && n_since_aged_ < PriorityAgingInterval) {
+      ++n_since_aged_;
+    }
+    return highest;
+  }
+
+  /** Move the front task of @p from into @p task, recording its wait. */
+  void take_front(Lane& from, Clock::time_point now, PoolTask& task)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    auto& front = from.tasks.front();
+    if (front.enqueued != Clock::time_point{}) {
+      auto wait = now - front.enqueued;
+      ++from.n_timed;
+      from.total_wait += wait;
+      from.max_wait = std::max(from.max_wait, wait);
+    }
+    task = std::move(front.task);
+    from.tasks.pop_front();
+    ++from.n_dequeued;
+    --n_queued_;
+    update_size();
+  }
+
+  void update_size() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    size_.store(n_queued_ - n_shutdown_signals_, std::memory_order_relaxed);
+  }
+
+  /**
+   * Mutex to guard the shared task queue, so that only one thread will execute
+   * a given task, and queued tasks will not get lost. This means that not only
+   * can this handle multiple workers it can also handle getting tasks from
+   * multiple threads at once.
+   */
+  Mutex mutex_;
+  /** The lanes of tasks to be done, indexed by TaskPriority. */
+  Lane lanes_[NumTaskPriorities] ABSL_GUARDED_BY(mutex_);
+  /** Number of empty tasks pushed but not yet popped. */
+  size_t n_shutdown_signals_ ABSL_GUARDED_BY(mutex_) = 0;
+  /** Total number of tasks and shutdown signals queued. */
+  size_t n_queued_ ABSL_GUARDED_BY(mutex_) = 0;
+  /** Number of queued tasks, not counting shutdown signals, for empty(). */
+  std::atomic<size_t> size_{0};
+  /**
+   * Whether tasks are timestamped, which starts once a task is pushed to a
+   * lane other than normal. This is only changed under the mutex, but read
+   * before taking it to decide whether to read the clock.
+   */
+  std::atomic<bool> timing_{false};
+  /** Number of tasks taken since an aged task was taken ahead of its lane. */
+  unsigned n_since_aged_ ABSL_GUARDED_BY(mutex_) = PriorityAgingInterval;
+  /** How long a task waits before it is taken ahead of higher lanes. */
+  std::chrono::nanoseconds const aging_ = PoolOptions{}.priority_aging;
+  /** Event notified when tasks are pushed. */
+  EventCount push_event_;
+};
+
+/**
+ * Task queue policy for the SharedThreadPool using a lock-free, bounded ring
+ * buffer.
+ *
+ * Producers and consumers only touch the ring's atomics while there is space
+ * available. A producer parks only when the ring is full, so the mutex is only
+ * taken to sleep and to wake sleeping producers. Consumers park on the push
+ * event only once the ring is empty.
+ *
+ * Empty tasks, used to signal shutdown, are counted separately rather than
+ * stored in the ring, and are only handed out once the ring is empty.
+ *
+ * @tparam Capacity Maximum number of queued tasks. Must be a power of two.
+ */
+template <size_t Capacity = 1024>
+struct LockFreeTaskQueue {
+ private:
+  using Mutex = absl::Mutex;
+  using Lock = absl::MutexLock;
+  using CondVar = absl::CondVar;
+
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "LockFreeTaskQueue capacity must be a power of two.");
+
+ public:
+  LockFreeTaskQueue() : ring_{Capacity} {}
+
+  /** Construct a queue for a pool, ignoring @p options. */
+  explicit LockFreeTaskQueue(PoolOptions const& options) : LockFreeTaskQueue{} {
+    static_cast<void>(options);
+  }
+
+  /** Add a task to the back of the queue, waiting for space if it is full. */
+  void push(PoolTask&& task) ABSL_LOCKS_EXCLUDED(mutex_) {
+    if (!task) {
+      n_shutdown_signals_.fetch_add(1);
+    } else {
+      push_without_notifying(std::move(task));
+    }
+    push_event_.notify(1);
+  }
+
+  /**
+   * Move all tasks in the range to the back of the queue, waiting for space
+   * whenever it is full. Consumers are woken once for each batch of tasks
+   * pushed without waiting.
+   */
+  template <typename Iterator>
+  void push_bulk(Iterator first, Iterator last) ABSL_LOCKS_EXCLUDED(mutex_) {
+    size_t n_unnotified = 0;
+    for (; first != last; ++first) {
+      if (!ring_.try_push(std::move(*first))) {
+        // Consumers must be woken for the tasks already pushed before waiting
+        // for space, or the ring may never be drained.
+        push_event_.notify(n_unnotified);
+        n_unnotified = 0;
+        push_without_notifying(std::move(*first));
+      }
+      ++n_unnotified;
+    }
+    push_event_.notify(n_unnotified);
+  }
+
+  /**
+   * Remove the first task from the queue, or a shutdown signal if the ring is
+   * empty.
+   */
+  bool try_pop(PoolTask& task) ABSL_LOCKS_EXCLUDED(mutex_) {
+    if (try_pop_task(task)) {
+      return true;
+    }
+    size_t n_signals = n_shutdown_signals_.load();
+    while (n_signals > 0) {
+      if (n_shutdown_signals_.compare_exchange_weak(n_signals, n_signals - 1)) {
+        task = PoolTask{};
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Remove the first task from the ring, if there is one. */
+  bool try_pop_task(PoolTask& task) ABSL_LOCKS_EXCLUDED(mutex_) {
+    if (!ring_.try_pop(task)) {
+      return false;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (n_waiting_producers_.load(std::memory_order_relaxed) > 0) {
+      Lock lock{&mutex_};
+      not_full_.Signal();
+    }
+    return true;
+  }
+
+  /**
+   * Move up to @p max_tasks tasks from the front of the ring to the back of
+   * @p tasks, taking no more than a fair share of the queued tasks between
+   * @p n_consumers consumers.
+   *
+   * @return The number of tasks taken.
+   */
+  template <typename Container>
+  size_t try_pop_bulk(Container& tasks, size_t max_tasks, size_t n_consumers)
+      ABSL_LOCKS_EXCLUDED(mutex_) {
+    auto n_tasks = std::min(max_tasks, fair_share(ring_.size(), n_consumers));
+    PoolTask task;
+    size_t n_taken = 0;
+    while (n_taken < n_tasks && try_pop_task(task)) {
+      tasks.push_back(std::move(task));
+      ++n_taken;
+    }
+    return n_taken;
+  }
+
+  /** Whether the ring currently has no tasks. */
+  bool empty() const noexcept { return ring_.empty(); }
+
+  /** Event notified when tasks are pushed. */
+  EventCount& push_event() noexcept { return push_event_; }
+
+ private:
+  /** Add a task to the ring, waiting for space if it is full. */
+  void push_without_notifying(PoolTask&& task) ABSL_LOCKS_EXCLUDED(mutex_) {
+    while (!ring_.try_push(std::move(task))) {
+      // Announce the wait before re-checking the ring, so that either this
+      // thread sees the freed space or the consumer sees this thread waiting.
+      n_waiting_producers_.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      {
+        Lock lock{&mutex_};
+        while (ring_.full()) {
+          not_full_.Wait(&mutex_);
+        }
+      }
+      n_waiting_producers_.fetch_sub(1);
+    }
+  }
+
+  /** The ring buffer holding queued tasks. */
+  BoundedMpmcQueue<PoolTask> ring_;
+  /** Number of empty tasks pushed but not yet popped. */
+  std::atomic<size_t> n_shutdown_signals_{0};
+  /** Number of producers parked, or about to park, on a full ring. */
+  std::atomic<size_t> n_waiting_producers_{0};
+  /** Mutex used only to park and wake producers. */
+  Mutex mutex_;
+  /** Signalled when a task is popped and a producer is waiting. */
+  CondVar not_full_;
+  /** Event notified when tasks are pushed. */
+  EventCount push_event_;
+};
+
+/**
+ * Task queue policy for the SharedThreadPool keeping a separate mutex guarded
+ * FIFO queue for each NUMA node.
+ *
+ * Tasks are pushed to the queue of the node that the submitting thread is
+ * running on, and consumers take tasks from their own node's queue first,
+ * only taking tasks from other nodes' queues once their own is empty. This
+ * keeps tasks on the node whose memory they were created with, as long as the
+ * workers are pinned to nodes, such as with per_node_affinity.
+ *
+ * Empty tasks, used to signal shutdown, are only handed out once every node's
+ * queue is empty, so that no worker exits while tasks are still queued on
+ * another node.
+ */
+struct NumaTaskQueue {
+ private:
+  using Mutex = absl::Mutex;
+  using Lock = absl::MutexLock;
+
+  using TaskQueueContainer = std::deque<PoolTask>;
+
+  /** The queue of tasks submitted on a single node. */
+  struct NodeQueue {
+    /** Mutex guarding the node's queue. */
+    Mutex mutex;
+    /** The node's queued tasks. */
+    TaskQueueContainer tasks ABSL_GUARDED_BY(mutex);
+    /** Copy of the queue's size which can be read without the mutex. */
+    std::atomic<size_t> size{0};
+  };
+  using NodeContainer = std::vector<std::unique_ptr<NodeQueue>>;
+
+ public:
+  /** Construct a queue for each NUMA node found on this machine. */
+  NumaTaskQueue() : NumaTaskQueue{CpuTopology::discover()} {}
+
+  /**
+   * Construct a queue for each NUMA node found on this machine, ignoring
+   * @p options.
+   */
+  explicit NumaTaskQueue(PoolOptions const& options) : NumaTaskQueue{} {
+    static_cast<void>(options);
+  }
+
+  /** Construct a queue for each NUMA node in @p topology. */
+  explicit NumaTaskQueue(CpuTopology const& topology) {
+    for (size_t node = 0; node < topology.nodes.size(); ++node) {
+      nodes_.emplace_back(new NodeQueue{});
+      for (unsigned cpu : topology.nodes[node]) {
+        if (cpu >= cpu_to_node_.size()) {
+          cpu_to_node_.resize(cpu + 1, 0);
+        }
+        cpu_to_node_[cpu] = node;
+      }
+    }
+    if (nodes_.empty()) {
+      nodes_.emplace_back(new NodeQueue{});
+    }
+  }
+
+  /** Add a task to the back of the current node's queue. */
+  void push(PoolTask&& task) {
+    if (!task) {
+      n_shutdown_signals_.fetch_add(1);
+    } else {
+      auto& node = *nodes_[current_node()];
+      Lock lock{&node.mutex};
+      node.tasks.emplace_back(std::move(task));
+      node.size.store(node.tasks.size(), std::memory_order_relaxed);
+    }
+    push_event_.notify(1);
+  }
+
+  /**
+   * Move all tasks in the range to the back of the current node's queue, under
+   * a single lock and waking no more consumers than there are new tasks.
+   */
+  template <typename Iterator>
+  void push_bulk(Iterator first, Iterator last) {
+    size_t n_tasks = 0;
+    {
+      auto& node = *nodes_[current_node()];
+      Lock lock{&node.mutex};
+      for (; first != last; ++first, ++n_tasks) {
+        node.tasks.emplace_back(std::move(*first));
+      }
+      node.size.store(node.tasks.size(), std::memory_order_relaxed);
+    }
+    push_event_.notify(n_tasks);
+  }
+
+  /**
+   * Pull the first task from the current node's queue, or if that is empty
+   * from the next node with any queued tasks.
+   */
+  bool try_pop(PoolTask& task) {
+    if (try_pop_task(task)) {
+      return true;
+    }
+    // No tasks are queued anywhere, so a shutdown signal can be handed out.
+    size_t n_signals = n_shutdown_signals_.load();
+    while (n_signals > 0) {
+      if (n_shutdown_signals_.compare_exchange_weak(n_signals, n_signals - 1)) {
+        task = PoolTask{};
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Like try_pop, but never takes a shutdown signal. */
+  bool try_pop_task(PoolTask& task) {
+    size_t const n_nodes = nodes_.size();
+    size_t const home = current_node();
+    for (size_t offset = 0; offset < n_nodes; ++offset) {
+      auto& node = *nodes_[(home + offset) % n_nodes];
+      if (node.size.load(std::memory_order_relaxed) == 0) {
+        continue;
+      }
+      Lock lock{&node.mutex};
+      if (!node.tasks.empty()) {
+        task = std::move(node.tasks.front());
+        node.tasks.pop_front();
+        node.size.store(node.tasks.size(), std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Move up to @p max_tasks tasks from the front of the first node queue that
+   * try_pop_task would take from to the back of @p tasks, under that node's
+   * lock. No more than a fair share of the node's tasks between
+   * @p n_consumers consumers is taken.
+   *
+   * @return The number of tasks taken.
+   */
+  template <typename Container>
+  size_t try_pop_bulk(Container& tasks, size_t max_tasks, size_t n_consumers) {
+    size_t const n_nodes = nodes_.size();
+    size_t const home = current_node();
+    for (size_t offset = 0; offset < n_nodes; ++offset) {
+      auto& node = *nodes_[(home + offset) % n_nodes];
+      if (node.size.load(std::memory_order_relaxed) == 0) {
+        continue;
+      }
+      Lock lock{&node.mutex};
+      auto n_tasks =
+          std::min(max_tasks, fair_share(node.tasks.size(), n_consumers));
+      for (size_t count = 0; count < n_tasks; ++count) {
+        tasks.push_back(std::move(node.tasks.front()));
+        node.tasks.pop_front();
+      }
+      node.size.store(node.tasks.size(), std::memory_order_relaxed);
+      if (n_tasks > 0) {
+        return n_tasks;
+      }
+    }
+    return 0;
+  }
+
+  /**
+   * Whether all of the node queues are currently empty, ignoring shutdown
+   * signals.
+   */
+  bool empty() const noexcept {
+    for (auto const& node : nodes_) {
+      if (node->size.load(std::memory_order_relaxed) != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /** Event notified when tasks are pushed. */
+  EventCount& push_event() noexcept { return push_event_; }
+
+ private:
+  /** Index of the node queue belonging to the CPU the caller is running on. */
+  size_t current_node() const noexcept {
+    int cpu = current_cpu();
+    if (cpu < 0 || static_cast<size_t>(cpu) >= cpu_to_node_.size()) {
+      return 0;
+    }
+    return cpu_to_node_[cpu];
+  }
+
+  /** The task queue for each node. */
+  NodeContainer nodes_;
+  /** Index into nodes_ for each CPU. */
+  std::vector<size_t> cpu_to_node_;
+  /** Number of empty tasks pushed but not yet popped. */
+  std::atomic<size_t> n_shutdown_signals_{0};
+  /** Event notified when tasks are pushed. */
+  EventCount push_event_;
+};
+
+}  // namespace acorn
+
+#endif  // ACORN_THREADS_TASK_QUEUE_H_
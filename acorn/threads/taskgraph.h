@@ -31,86 +31,344 @@
 #ifndef ACORN_THREADS_TASKGRAPH_H_
 #define ACORN_THREADS_TASKGRAPH_H_
 
-#include "acorn/container/slot_map.h"
+#include "acorn/threads/future.h"
 #include "acorn/threads/shared_thread_pool.h"
+#include "acorn/threads/unique_task.h"
 
 #include "absl/base/thread_annotations.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 
+#include <algorithm>
+#include <array>
 #include <atomic>
-#include <condition_variable>
-#include <deque>
-#include <future>
-#include <mutex>
-#include <queue>
-#include <thread>
+#include <exception>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace acorn {
 
+/** The order in which a TaskGraph hands ready tasks to its pool. */
+enum class TaskGraphScheduling {
+  /** Queue each task as soon as it is ready. */
+  fifo,
+  /**
+   * Run the ready task with the highest upward rank first, that is the task
+   * with the most costly path through the tasks depending on it to the end of
+   * the graph, so that long dependency chains are not held up behind
+   * independent tasks. This takes a lock to rank and dispatch each task.
+   */
+  critical_path,
+};
+
+/**
+ * A task's function along with a hint of how long it takes to run, relative to
+ * other tasks in the graph, as used by TaskGraphScheduling::critical_path.
+ */
+template <typename Function>
+struct CostedTask {
+  /** Relative cost of running the task. Tasks without a hint cost 1. */
+  double cost;
+  /** The task's function. */
+  Function func;
+
+  template <typename... Args>
+  auto operator()(Args&&... args)
+      -> decltype(func(std::forward<Args>(args)...)) {
+    return func(std::forward<Args>(args)...);
+  }
+};
+
+/** Attach a cost hint to a task's function, to submit to a TaskGraph. */
+template <typename Function>
+CostedTask<typename std::decay<Function>::type> with_cost(double cost,
+                                                          Function&& func) {
+  return {cost, std::forward<Function>(func)};
+}
+
+/**
+ * Runs tasks on a thread pool once the tasks they depend on have completed.
+ *
+ * Dependencies are tracked without any graph-wide lock. Each task counts its
+ * outstanding dependencies atomically, and keeps a lock-free list of the tasks
+ * depending on it, which it closes when it completes. The task that counts a
+ * dependee down to zero hands it straight to the pool.
+ */
 struct TaskGraph {
-  struct InternalTask {
+  struct InternalTask;
+
+  /** Progress of a task through critical path scheduling. */
+  enum class RankState { pending, ready, started };
+
+  /** Entry in the list of tasks depending on a task. */
+  struct DependeeLink {
+    /* The task waiting on the task holding this link in its list. */
+    InternalTask* dependee;
+    /* The next entry in the list. */
+    DependeeLink* next;
+  };
+
+  struct InternalTask : std::enable_shared_from_this<InternalTask> {
     /* The work required by this task. */
-    std::packaged_task<void()> function;
-    /* Number of tasks that must be completed before running this. */
-    size_t n_dependencies;
-    /* Tasks that depend on this task. */
-    std::vector<size_t> dependees;
+    UniqueTask function;
+    /*
+     * Number of tasks that must be completed before running this, plus one
+     * while the task is still being registered with its dependencies.
+     */
+    std::atomic<size_t> n_dependencies{1};
+    /* Tasks that depend on this task, or closed() once it has completed. */
+    std::atomic<DependeeLink*> dependees{nullptr};
+    /* Entries for this task in the lists of each of its dependencies. */
+    std::unique_ptr<DependeeLink[]> links;
+    /* Keeps the task alive until it completes, even if no handles remain. */
+    std::shared_ptr<InternalTask> self;
+
+    // The following are only used for TaskGraphScheduling::critical_path, and
+    // are guarded by the graph's rank_mutex_.
+
+    /* Hint of the cost of running this task. */
+    double cost = 1;
+    /* Cost of the most costly path from this task to the end of the graph. */
+    double rank = 0;
+    /* Whether the task is waiting on dependencies, ready or started. */
+    RankState rank_state = RankState::pending;
+    /* The task's dependencies, released once it is ready. */
+    std::vector<std::shared_ptr<InternalTask>> parents;
   };
 
   struct BaseTask {
     size_t const task_id;
+    /* The graph's record of the task, shared by every handle to it. */
+    std::shared_ptr<InternalTask> node;
   };
+  /**
+   * A submitted task, holding a future for its result.
+   *
+   * A task can be awaited with @c co_await from a C++20 coroutine, which is
+   * then resumed on one of the graph's workers once the task completes,
+   * rather than blocking a thread while it waits.
+   */
   template <typename ReturnType>
   struct Task : public BaseTask {
-    std::future<ReturnType> future;
+    Future<ReturnType> future;
 
-    Task(size_t id, std::future<ReturnType>&& fut)
-        : BaseTask{id}, future{std::move(fut)} {}
+    Task(BaseTask&& base, Future<ReturnType>&& fut, TaskGraph* graph)
+        : BaseTask{std::move(base)}, future{std::move(fut)}, graph_{graph} {}
+
+    /** Coroutine support: whether the task has already completed. */
+    bool await_ready() const noexcept { return future.is_ready(); }
+
+    /**
+     * Coroutine support: queue @p awaiting on the graph's pool once the task
+     * completes, or resume it straight away if it already has.
+     */
+    template <typename Handle>
+    bool await_suspend(Handle awaiting) {
+      auto* graph = graph_;
+      return future.add_continuation(UniqueTask{[graph, awaiting] {
+        graph->pool_.execute([awaiting]() mutable { awaiting.resume(); });
+      }});
+    }
+
+    /** Coroutine support: the task's result, or rethrow its exception. */
+    ReturnType await_resume() { return future.get(); }
+
+   private:
+    TaskGraph* graph_;
   };
 
-  template <typename Function>
-  struct FuncWrapperBase {
-    Function func_;
-    TaskGraph* const graph_;
-    size_t const task_id_;
+  /** A task whose result is kept in the graph for the tasks consuming it. */
+  template <typename T>
+  struct ValueTask : InternalTask {
+    /* The task's result, written before the task completes. */
+    FutureStorage<T> result;
+    /* The exception thrown by the task, or passed on from one of its inputs. */
+    std::exception_ptr error;
+    /*
+     * Number of Flow handles and consuming tasks that can still read the
+     * result. Only the last of them may move the result out.
+     */
+    std::atomic<size_t> n_readers{1};
+  };
 
-    FuncWrapperBase(Function&& func, TaskGraph* graph, size_t id)
-        : func_{std::move(func)}, graph_{graph}, task_id_{id} {}
+  /**
+   * A submitted task whose result is kept in the graph, and passed to the
+   * tasks it is an input of rather than through a future.
+   *
+   * Each handle, and each consuming task it is passed to, counts as a reader
+   * of the result. The last reader to consume the result moves it out, while
+   * any before it are given copies, so a handle should be moved into the
+   * submit of its sole consumer.
+   */
+  template <typename ReturnType>
+  struct Flow : public BaseTask {
+    explicit Flow(BaseTask&& base) : BaseTask{std::move(base)} {}
 
-    void task_complete() { graph_->task_complete(task_id_); }
-    using ReturnType = decltype(func_());
+    Flow(Flow const& other) : BaseTask{other} {
+      if (node) {
+        value_task().n_readers.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    Flow(Flow&& other) noexcept = default;
+
+    ~Flow() {
+      if (node) {
+        value_task().n_readers.fetch_sub(1, std::memory_order_release);
+      }
+    }
+
+   private:
+    ValueTask<ReturnType>& value_task() const noexcept {
+      return static_cast<ValueTask<ReturnType>&>(*node);
+    }
   };
 
-  template <
-      typename Function,
-      bool = std::is_same<decltype(std::declval<Function&>()()), void>::value>
-  struct FuncWrapper : public FuncWrapperBase<Function> {
-    using FuncWrapperBase<Function>::FuncWrapperBase;
-    void operator()() {
-      this->func_();
-      this->task_complete();
+ private:
+  /**
+   * A task calling @p Function with the results of tasks returning
+   * @p Inputs, keeping its own result for later tasks.
+   */
+  template <typename Return, typename Function, typename... Inputs>
+  struct FlowTask : ValueTask<Return> {
+    /* The work done by this task. */
+    Function func;
+    /* The tasks whose results are passed to func, released once it has run. */
+    std::tuple<std::shared_ptr<ValueTask<Inputs>>...> inputs;
+
+    template <typename F>
+    FlowTask(F&& f, std::shared_ptr<ValueTask<Inputs>>&&... input_tasks)
+        : func{std::forward<F>(f)}, inputs{std::move(input_tasks)...} {}
+
+    /** The input tasks, as dependencies of this one. */
+    std::array<InternalTask*, sizeof...(Inputs)> dependencies() const noexcept {
+      return dependencies(std::index_sequence_for<Inputs...>{});
+    }
+
+    /**
+     * Call func with the input results, storing its result or exception. An
+     * exception from any input is passed on without calling func.
+     */
+    void run() {
+      try {
+        rethrow_input_errors(std::index_sequence_for<Inputs...>{});
+        auto call = [this] {
+          return call_func(std::index_sequence_for<Inputs...>{});
+        };
+        store_result(this->result, call);
+      } catch (...) {
+        this->error = std::current_exception();
+      }
+      inputs = {};
+    }
+
+   private:
+    template <size_t... Index>
+    std::array<InternalTask*, sizeof...(Inputs)> dependencies(
+        std::index_sequence<Index...>) const noexcept {
+      return {{std::get<Index>(inputs).get()...}};
+    }
+
+    template <size_t... Index>
+    void rethrow_input_errors(std::index_sequence<Index...>) {
+      bool ignored[] = {false, rethrow_error(*std::get<Index>(inputs))...};
+      (void)ignored;
+    }
+
+    template <size_t... Index>
+    Return call_func(std::index_sequence<Index...>) {
+      return func(take_result(*std::get<Index>(inputs))...);
     }
   };
 
+  /** Rethrow the exception held by @p task, if any. */
+  template <typename T>
+  static bool rethrow_error(ValueTask<T> const& task) {
+    if (task.error) {
+      std::rethrow_exception(task.error);
+    }
+    return false;
+  }
+
+  /**
+   * The result of @p task, for a reader which then gives up its reference.
+   *
+   * The result is moved out if this is the last reader, as then nothing else
+   * can read it, and copied otherwise. Every other reader copies the result
+   * before releasing its reference, so those copies happen before the move.
+   */
+  template <typename T>
+  static T take_result(ValueTask<T>& task) {
+    if (task.n_readers.load(std::memory_order_acquire) == 1) {
+      task.n_readers.store(0, std::memory_order_relaxed);
+      return task.result.take();
+    }
+    T result = task.result.copy();
+    task.n_readers.fetch_sub(1, std::memory_order_release);
+    return result;
+  }
+
+  /** @copydoc take_result */
+  static void take_result(ValueTask<void>&) noexcept {}
+
+  /** Store the result of calling @p call in @p result. */
+  template <typename T, typename Call>
+  static void store_result(FutureStorage<T>& result, Call& call) {
+    result.emplace(call());
+  }
+
+  /** @copydoc store_result */
+  template <typename Call>
+  static void store_result(FutureStorage<void>& result, Call& call) {
+    call();
+    result.emplace();
+  }
+
+  /** Whether every type in @p Deps is a task of the graph. */
+  template <typename... Deps>
+  struct AreTasks : std::true_type {};
+
+  template <typename Dep, typename... Deps>
+  struct AreTasks<Dep, Deps...>
+      : std::integral_constant<bool, std::is_base_of<BaseTask, Dep>::value &&
+                                         AreTasks<Deps...>::value> {};
+
+  /** The cost hint of a task's function. */
+  template <typename Function>
+  static double cost_of(Function const&) noexcept {
+    return 1;
+  }
+
   template <typename Function>
-  struct FuncWrapper<Function, false> : public FuncWrapperBase<Function> {
-    using FuncWrapperBase<Function>::FuncWrapperBase;
-    using ReturnType = typename FuncWrapperBase<Function>::ReturnType;
-    ReturnType operator()() {
-      auto ret = this->func_();
-      this->task_complete();
-      return ret;
+  static double cost_of(CostedTask<Function> const& task) noexcept {
+    return task.cost;
+  }
+
+  /** Orders ready tasks so that the highest ranked is at the top of a heap. */
+  struct RankOrder {
+    bool operator()(InternalTask const* lhs, InternalTask const* rhs) const
+        noexcept {
+      return lhs->rank < rhs->rank;
     }
   };
 
-  using TaskMap = SlotMap<InternalTask>;
   using Mutex = absl::Mutex;
   using Lock = absl::MutexLock;
 
  public:
-  TaskGraph(unsigned n_threads = 8)
-      : pool_{n_threads}, mutex_{}, holding_queue_{} {}
+  /**
+   * Construct a graph running its tasks on @p n_threads threads, handing
+   * ready tasks to them in the order given by @p scheduling.
+   *
+   * Any submitted function can be wrapped with with_cost to give a hint of its
+   * cost, which critical path scheduling uses to rank tasks.
+   */
+  TaskGraph(unsigned n_threads = 8,
+            TaskGraphScheduling scheduling = TaskGraphScheduling::fifo)
+      : scheduling_{scheduling}, next_task_id_{0}, pool_{n_threads} {}
 
   /**
    * Submit a task to be executed once its dependencies are fulfilled.
@@ -118,69 +376,363 @@ struct TaskGraph {
    * @return A Task object containing both a task ID and a future for the task's
    * returned value. This task can be used as a dependency for further tasks.
    */
-  template <typename Function, typename... Deps>
+  template <typename Function, typename... Deps,
+            typename std::enable_if<AreTasks<Deps...>::value, int>::type = 0>
   auto submit(Function&& func, Deps const&... deps) -> Task<decltype(func())> {
+    std::array<BaseTask const*, sizeof...(Deps)> task_deps{{&deps...}};
+    return submit_after(std::forward<Function>(func), task_deps);
+  }
+
+  /**
+   * Submit a task to be executed once all of @p deps have completed, where the
+   * number of dependencies is only known at runtime. The dependencies are all
+   * registered in a single pass.
+   *
+   * @return A Task object as for the variadic submit.
+   */
+  template <typename Function>
+  auto submit(Function&& func, absl::Span<BaseTask const> deps)
+      -> Task<decltype(func())> {
+    return submit_after(std::forward<Function>(func), deps);
+  }
+
+  /**
+   * Submit a task with no dependencies whose result is kept in the graph, to
+   * be passed to the tasks it is an input of.
+   *
+   * @return A Flow for the task's result, to pass as an input to submit.
+   */
+  template <typename Function>
+  auto source(Function&& func) -> Flow<decltype(func())> {
+    return submit_flow<decltype(func())>(std::forward<Function>(func));
+  }
+
+  /**
+   * Submit a task called with the results of @p input and @p inputs once they
+   * have completed, as in @c func(result_of_input, result_of_inputs...).
+   *
+   * Each result is stored once in the graph, and moved into its consumer if
+   * that is the only task, or handle, left referring to it. If any input threw
+   * an exception the task is not called, and passes the exception on instead.
+   *
+   * @return A Flow for the task's result, to pass on to further tasks or to
+   * get_future at the graph's exits.
+   */
+  template <typename Function, typename Input, typename... Inputs>
+  auto submit(Function&& func, Flow<Input> input, Flow<Inputs>... inputs)
+      -> Flow<decltype(func(std::declval<Input>(),
+                            std::declval<Inputs>()...))> {
+    using Return =
+        decltype(func(std::declval<Input>(), std::declval<Inputs>()...));
+    return submit_flow<Return>(std::forward<Function>(func),
+                               value_task(std::move(input)),
+                               value_task(std::move(inputs))...);
+  }
+
+  /**
+   * A future for the result of @p flow, or the exception it passes on. This
+   * consumes the result, as any other task it is an input of.
+   */
+  template <typename T>
+  Future<T> get_future(Flow<T> flow) {
+    Promise<T> promise;
+    auto future = promise.get_future();
+    auto input = value_task(std::move(flow));
+    std::array<InternalTask*, 1> deps{{input.get()}};
+    auto node = std::make_shared<InternalTask>();
+    node->function = UniqueTask{[promise = std::move(promise),
+                                 input = std::move(input)]() mutable {
+      auto take = [&input] {
+        rethrow_error(*input);
+        return take_result(*input);
+      };
+      fulfil_promise(promise, take);
+    }};
+    add_task(std::move(node), deps);
+    return future;
+  }
+
+  /**
+   * Add a barrier which completes once all of @p deps have completed.
+   *
+   * The barrier has no work or future, and is never queued on the pool. It is
+   * completed by whichever thread completes its last dependency, so costs no
+   * more than its dependency counters. Tasks depending on the barrier then
+   * depend on every task in @p deps, without each registering with all of
+   * them.
+   */
+  BaseTask join(absl::Span<BaseTask const> deps) {
+    auto node = std::make_shared<InternalTask>();
+    node->cost = 0;
+    return add_task(std::move(node), deps);
+  }
+
+ private:
+  /** The graph's record of the task in an element of a dependency range. */
+  static InternalTask& node_of(BaseTask const& task) noexcept {
+    return *task.node;
+  }
+  static InternalTask& node_of(BaseTask const* task) noexcept {
+    return *task->node;
+  }
+  static InternalTask& node_of(InternalTask* task) noexcept { return *task; }
+
+  /**
+   * Take the graph's record of the task from @p flow, along with its
+   * reference to the task's result.
+   */
+  template <typename T>
+  static std::shared_ptr<ValueTask<T>> value_task(Flow<T>&& flow) noexcept {
+    // Casting does not move from the pointer before C++20, so reset the
+    // handle to hand over its reference.
+    auto task = std::static_pointer_cast<ValueTask<T>>(flow.node);
+    flow.node.reset();
+    return task;
+  }
+
+  /**
+   * Submit a task calling @p func with the results of @p inputs once they
+   * have completed, and keeping its own result.
+   */
+  template <typename Return, typename Function, typename... Inputs>
+  Flow<Return> submit_flow(Function&& func,
+                           std::shared_ptr<ValueTask<Inputs>>&&... inputs) {
+    using Node =
+        FlowTask<Return, typename std::decay<Function>::type, Inputs...>;
+    auto node = std::make_shared<Node>(std::forward<Function>(func),
+                                       std::move(inputs)...);
+    node->cost = cost_of(node->func);
+    auto* flow_task = node.get();
+    node->function = UniqueTask{[flow_task] { flow_task->run(); }};
+    auto deps = node->dependencies();
+    return Flow<Return>{add_task(std::move(node), deps)};
+  }
+
+  /**
+   * Submit a task running @p func once every task in @p deps, which holds
+   * either tasks or pointers to tasks, has completed.
+   */
+  template <typename Function, typename Range>
+  auto submit_after(Function&& func, Range const& deps)
+      -> Task<decltype(func())> {
     using Return = decltype(func());
-    using TypedTask = std::packaged_task<Return()>;
-    constexpr size_t NumDeps = sizeof...(Deps);
 
-    size_t task_id;
-    {
-      Lock lock{&mutex_};
-      task_id = holding_queue_.insert(InternalTask{{}, NumDeps, {}});
+    Promise<Return> promise;
+    auto future = promise.get_future();
+    // The promise is only a pointer to its shared state, so with a small
+    // callable this fits in the UniqueTask without any further allocation.
+    auto node = std::make_shared<InternalTask>();
+    node->cost = cost_of(func);
+    node->function =
+        UniqueTask{[promise = std::move(promise),
+                    func = std::forward<Function>(func)]() mutable {
+          fulfil_promise(promise, func);
+        }};
+    return {add_task(std::move(node), deps), std::move(future), this};
+  }
+
+  /**
+   * Add @p node to the graph, registering it with each of @p deps, and queue
+   * it straight away if they have all completed.
+   */
+  template <typename Range>
+  BaseTask add_task(std::shared_ptr<InternalTask>&& node, Range const& deps) {
+    size_t const n_deps = deps.size();
+    node->self = node;
+    if (scheduling_ == TaskGraphScheduling::critical_path) {
+      rank_task(*node, deps);
+    }
+    // The task holds one extra count until it is registered with all of its
+    // dependencies, so it cannot be queued while that is still going on.
+    if (n_deps != 0) {
+      node->n_dependencies.store(n_deps + 1, std::memory_order_relaxed);
+      node->links.reset(new DependeeLink[n_deps]);
+      size_t index = 0;
+      for (auto&& dep : deps) {
+        add_dependee(node_of(dep), node->links[index++], *node);
+      }
     }
+    dependency_done(*node);
+    return {next_task_id_.fetch_add(1, std::memory_order_relaxed),
+            std::move(node)};
+  }
+
+  /** Marker for the dependee list of a task which has completed. */
+  static DependeeLink* closed() noexcept {
+    static DependeeLink marker{nullptr, nullptr};
+    return &marker;
+  }
+
+  /**
+   * Register @p dependee, through its entry @p link, as waiting on
+   * @p dependency. If the dependency has already completed this counts the
+   * dependee down straight away.
+   */
+  void add_dependee(InternalTask& dependency, DependeeLink& link,
+                    InternalTask& dependee) {
+    link.dependee = &dependee;
+    auto* head = dependency.dependees.load(std::memory_order_acquire);
+    do {
+      if (head == closed()) {
+        dependency_done(dependee);
+        return;
+      }
+      link.next = head;
+    } while (!dependency.dependees.compare_exchange_weak(
+        head, &link, std::memory_order_acq_rel, std::memory_order_acquire));
+  }
 
-    std::array<BaseTask, NumDeps> task_deps{deps...};
-    for (auto&& dep : task_deps) {
-      Lock lock{&mutex_};
-      auto dep_id = dep.task_id;
-      auto& dep_task = holding_queue_[dep_id];
-      dep_task.dependees.push_back(task_id);
+  /**
+   * Count down one dependency of @p task, queuing it once none remain. A
+   * barrier, which has no work, is completed straight away instead.
+   */
+  void dependency_done(InternalTask& task) {
+    if (task.n_dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      if (!task.function) {
+        if (scheduling_ == TaskGraphScheduling::critical_path) {
+          std::vector<std::shared_ptr<InternalTask>> parents;
+          Lock lock{&rank_mutex_};
+          parents = advance_rank_state(task, RankState::started);
+        }
+        task_complete(task);
+        return;
+      }
+      if (scheduling_ == TaskGraphScheduling::critical_path) {
+        queue_by_rank(task);
+        return;
+      }
+      auto* ready = &task;
+      pool_.execute([this, ready] { run_task(*ready); });
     }
+  }
 
-    auto base_task = TypedTask{
-        FuncWrapper<Function>{std::forward<Function>(func), this, task_id}};
-    auto future = base_task.get_future();
+  /**
+   * Rank the new task @p task, then raise the ranks of its @p deps, and of
+   * their dependencies in turn, to cover the paths through it.
+   */
+  template <typename Range>
+  void rank_task(InternalTask& task, Range const& deps)
+      ABSL_LOCKS_EXCLUDED(rank_mutex_) {
+    Lock lock{&rank_mutex_};
+    task.rank = task.cost;
+    task.parents.reserve(deps.size());
+    for (auto&& dep : deps) {
+      auto& parent = node_of(dep);
+      task.parents.push_back(parent.shared_from_this());
+      rank_updates_.emplace_back(&parent, task.rank);
+    }
+    bool reorder = false;
+    while (!rank_updates_.empty()) {
+      InternalTask* update;
+      double child_rank;
+      std::tie(update, child_rank) = rank_updates_.back();
+      rank_updates_.pop_back();
+      // Ranks only ever increase, so stop at any task whose rank already
+      // covers this path, or which has started and no longer needs ranking.
+      double rank = update->cost + child_rank;
+      if (update->rank_state == RankState::started || rank <= update->rank) {
+        continue;
+      }
+      update->rank = rank;
+      if (update->rank_state == RankState::ready) {
+        reorder = true;
+        continue;
+      }
+      for (auto&& parent : update->parents) {
+        rank_updates_.emplace_back(parent.get(), rank);
+      }
+    }
+    if (reorder) {
+      std::make_heap(ready_.begin(), ready_.end(), RankOrder{});
+    }
+  }
+
+  /**
+   * Move @p task to @p state, returning its dependencies, which are no longer
+   * needed for ranking once it is ready. The caller should release them
+   * without holding the lock.
+   */
+  std::vector<std::shared_ptr<InternalTask>> advance_rank_state(
+      InternalTask& task, RankState state)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(rank_mutex_) {
+    task.rank_state = state;
+    return std::move(task.parents);
+  }
+
+  /** Push the ready @p task onto the ready queue, ordered by its rank. */
+  void queue_by_rank(InternalTask& task) ABSL_LOCKS_EXCLUDED(rank_mutex_) {
+    {
+      std::vector<std::shared_ptr<InternalTask>> parents;
+      Lock lock{&rank_mutex_};
+      parents = advance_rank_state(task, RankState::ready);
+      ready_.push_back(&task);
+      std::push_heap(ready_.begin(), ready_.end(), RankOrder{});
+    }
+    // Each task queued on the pool runs whichever ready task ranks highest
+    // when it starts, so there is always one queued for each ready task.
+    pool_.execute([this] { run_highest_rank(); });
+  }
 
-    if (NumDeps == 0) {
-      // This task has no dependencies, so forward directly to the executor. The
-      // task stored in the queue will be needed to track tasks depending on
-      // this but won't contain information about the task itself.
-      pool_.add_task(std::move(base_task));
-    } else {
-      // The task has dependencies, so store the task in the holding queue
-      // until they have been met.
-      holding_queue_[task_id].function = std::move(base_task);
+  /** Run the ready task with the highest rank. */
+  void run_highest_rank() ABSL_LOCKS_EXCLUDED(rank_mutex_) {
+    InternalTask* task;
+    {
+      Lock lock{&rank_mutex_};
+      std::pop_heap(ready_.begin(), ready_.end(), RankOrder{});
+      task = ready_.back();
+      ready_.pop_back();
+      task->rank_state = RankState::started;
     }
+    run_task(*task);
+  }
 
-    return {task_id, std::move(future)};
+  /** Run @p task, then mark it as complete. */
+  void run_task(InternalTask& task) {
+    task.function();
+    task_complete(task);
   }
 
- private:
   /**
-   * Mark the task with provided ID as complete.
+   * Mark the provided task as complete.
    *
-   * Update any tasks that depend on the one just finished, and queue up any
+   * Close its list of dependees, so that tasks submitted later see it has
+   * completed, then count down every task already in the list, queuing any
    * that become unblocked.
    */
-  void task_complete(int id) {
-    Lock lock{&mutex_};
-    auto& finished_task = holding_queue_[id];
-    for (auto&& task_id : finished_task.dependees) {
-      auto& task = holding_queue_[task_id];
-      if (--task.n_dependencies == 0) {
-        pool_.add_task(std::move(task.function));
-      }
+  void task_complete(InternalTask& task) {
+    auto* link = task.dependees.exchange(closed(), std::memory_order_acq_rel);
+    // Nothing else in the task is needed, so release the graph's reference to
+    // it before queuing its dependees.
+    task.function.reset();
+    task.self.reset();
+    while (link != nullptr) {
+      // Read the next entry first, as the dependee, which owns the entry, can
+      // run and be released as soon as it is counted down.
+      auto* next = link->next;
+      dependency_done(*link->dependee);
+      link = next;
     }
-    holding_queue_.erase(id);
   }
 
-  /** Executor to handle executing tasks. */
+  /** How ready tasks are handed to the pool. */
+  TaskGraphScheduling const scheduling_;
+  /** Mutex guarding task ranks and the ready queue, used to rank tasks. */
+  Mutex rank_mutex_;
+  /** Ready tasks waiting to run, as a heap ordered by rank. */
+  std::vector<InternalTask*> ready_ ABSL_GUARDED_BY(rank_mutex_);
+  /**
+   * Tasks whose rank is still to be raised, with the rank of their dependee,
+   * kept between calls to reuse its memory.
+   */
+  std::vector<std::pair<InternalTask*, double>> rank_updates_
+      ABSL_GUARDED_BY(rank_mutex_);
+  /** Source of the IDs given to submitted tasks. */
+  std::atomic<size_t> next_task_id_;
+  /**
+   * Executor to handle executing tasks. This is destroyed first, so that any
+   * running tasks can still complete and queue their dependees.
+   */
   SharedThreadPool pool_;
-  /** Mutex guarding multi-threaded access to the task queue. */
-  Mutex mutex_;
-  /** Queue of all pending, queued and running tasks, indexed by their ID. */
-  TaskMap holding_queue_ ABSL_GUARDED_BY(mutex_);
 };
 
 }  // namespace acorn
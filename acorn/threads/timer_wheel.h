@@ -0,0 +1,502 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_TIMER_WHEEL_H_
+#define ACORN_THREADS_TIMER_WHEEL_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+#include "acorn/threads/unique_task.h"
+
+namespace acorn {
+
+struct TimerWheel;
+
+/**
+ * A task scheduled on a TimerWheel.
+ *
+ * Apart from the task itself, which is only touched by whichever thread runs
+ * it, the fields are guarded by the owning wheel's mutex.
+ */
+struct TimerNode {
+  using Clock = std::chrono::steady_clock;
+  using NodeList = std::list<std::shared_ptr<TimerNode>>;
+
+  /** The task to run, called repeatedly for a periodic timer. */
+  UniqueTask task;
+  /** When the task is next due. */
+  Clock::time_point deadline;
+  /** Interval between runs of a periodic timer, or zero for a one-shot. */
+  std::chrono::nanoseconds interval{0};
+  /** The wheel tick at which the task is due. */
+  std::uint64_t tick = 0;
+  /** The level and slot of the wheel holding the node, while scheduled. */
+  unsigned level = 0;
+  unsigned slot = 0;
+  /** Position in the slot's list, so that cancelling is constant time. */
+  NodeList::iterator position;
+  /** Whether the node is currently held in one of the wheel's slots. */
+  bool scheduled = false;
+  /** Set when the timer is cancelled, so that it is never run or re-armed. */
+  bool cancelled = false;
+};
+
+/**
+ * Handle to a timer scheduled on a TimerWheel, used to cancel it.
+ *
+ * Handles may outlive the timer and the wheel, in which case cancelling does
+ * nothing, but cancel must not race with the wheel's destruction.
+ */
+struct TimerHandle {
+  TimerHandle() noexcept = default;
+  TimerHandle(TimerWheel* wheel, std::weak_ptr<TimerNode> node) noexcept
+      : wheel_{wheel}, node_{std::move(node)} {}
+
+  /**
+   * Cancel the timer in constant time.
+   *
+   * A periodic timer whose task is running when cancelled finishes that run
+   * but is not run again.
+   *
+   * @return Whether the timer was still scheduled to run.
+   */
+  bool cancel();
+
+ private:
+  TimerWheel* wheel_ = nullptr;
+  std::weak_ptr<TimerNode> node_;
+};
+
+/**
+ * Hierarchical timing wheel with its own timer thread, which hands each task
+ * to a dispatch function once its deadline has passed.
+ *
+ * Time is split into ticks of a fixed resolution. The wheel has four levels of
+ * 64 slots, where a slot on level @c n covers @c 64^n ticks, so timers up to
+ * @c 64^4 ticks ahead (over 190 days at millisecond resolution) are placed
+ * directly and later ones are re-placed as time moves on. Scheduling and
+ * cancelling a timer are constant time, and timers only move down a level when
+ * the slot holding them is reached, rather than being kept in sorted order.
+ *
+ * Tasks never run before their deadline, but may run up to one tick after it
+ * plus however long the dispatched task then waits to run.
+ */
+struct TimerWheel {
+ private:
+  using Mutex = absl::Mutex;
+  using Lock = absl::MutexLock;
+  using CondVar = absl::CondVar;
+  using NodePtr = std::shared_ptr<TimerNode>;
+  using NodeList = TimerNode::NodeList;
+
+  static constexpr unsigned SlotBits = 6;
+  static constexpr unsigned NumSlots = 1u << SlotBits;
+  static constexpr unsigned NumLevels = 4;
+
+ public:
+  using Clock = TimerNode::Clock;
+  /** Function called on the timer thread with each task that is due. */
+  using Dispatch = std::function<void(UniqueTask&&)>;
+
+  /**
+   * Start a timer wheel and its timer thread.
+   *
+   * @param dispatch [in] Function handed each task once it is due. This is
+   *        called on the timer thread, so should only hand the task to some
+   *        other thread to run, such as by adding it to a thread pool.
+   * @param resolution [in] Length of each tick of the wheel.
+   */
+  explicit TimerWheel(Dispatch dispatch,
+                      std::chrono::nanoseconds resolution =
+                          std::chrono::milliseconds{1})
+      : dispatch_{std::move(dispatch)},
+        resolution_{std::max(resolution, std::chrono::nanoseconds{1})},
+        start_{Clock::now()},
+        thread_{[this] { timer_loop(); }} {}
+
+  TimerWheel(TimerWheel const&) = delete;
+  TimerWheel& operator=(TimerWheel const&) = delete;
+
+  /** Stop the timer thread, dropping any timers still scheduled. */
+  ~TimerWheel() { stop(); }
+
+  /**
+   * Schedule @p task to be dispatched once @p deadline has passed.
+   *
+   * @return A handle to cancel the timer, which does nothing if the wheel has
+   * been stopped.
+   */
+  TimerHandle schedule(Clock::time_point deadline, UniqueTask&& task)
+      ABSL_LOCKS_EXCLUDED(mutex_) {
+    return add(deadline, std::chrono::nanoseconds{0}, std::move(task));
+  }
+
+  /**
+   * Schedule @p task to be run every @p interval, starting at @p first.
+   *
+   * Each run is dispatched once the previous run has finished, so runs never
+   * overlap. Runs are kept to a fixed rate, except that any runs missed while
+   * a run was late are skipped rather than run back to back.
+   */
+  TimerHandle schedule_periodic(Clock::time_point first,
+                                std::chrono::nanoseconds interval,
+                                UniqueTask&& task) ABSL_LOCKS_EXCLUDED(mutex_) {
+    return add(first, std::max(interval, resolution_), std::move(task));
+  }
+
+  /**
+   * Cancel the timer held in @p node.
+   *
+   * @return Whether the timer was still scheduled to run.
+   */
+  bool cancel(TimerNode& node) ABSL_LOCKS_EXCLUDED(mutex_) {
+    Lock lock{&mutex_};
+    if (node.cancelled) {
+      return false;
+    }
+    node.cancelled = true;
+    if (node.scheduled) {
+      unlink(node);
+      return true;
+    }
+    // A periodic timer that is running is still active until cancelled.
+    return node.interval.count() != 0 && !stopping_;
+  }
+
+  /** The number of timers waiting in the wheel. */
+  size_t size() const ABSL_LOCKS_EXCLUDED(mutex_) {
+    Lock lock{&mutex_};
+    return n_timers_;
+  }
+
+  /**
+   * Stop the timer thread and drop all scheduled timers. Periodic timers
+   * whose task is running are not re-armed, and later calls to schedule do
+   * nothing.
+   */
+  void stop() ABSL_LOCKS_EXCLUDED(mutex_) {
+    {
+      Lock lock{&mutex_};
+      if (stopping_) {
+        return;
+      }
+      stopping_ = true;
+      for (auto& level : slots_) {
+        for (auto& slot : level) {
+          for (auto& node : slot) {
+            node->scheduled = false;
+          }
+          slot.clear();
+        }
+      }
+      n_timers_ = 0;
+      wake_.Signal();
+    }
+    thread_.join();
+  }
+
+ private:
+  TimerHandle add(Clock::time_point deadline, std::chrono::nanoseconds interval,
+                  UniqueTask&& task) ABSL_LOCKS_EXCLUDED(mutex_) {
+    auto node = std::make_shared<TimerNode>();
+    node->task = std::move(task);
+    node->deadline = deadline;
+    node->interval = interval;
+    Lock lock{&mutex_};
+    if (stopping_) {
+      return TimerHandle{};
+    }
+    if (n_timers_ == 0) {
+      // The timer thread does not advance an empty wheel, so catch up here
+      // rather than stepping through every tick since it was last used.
+      current_tick_ = std::max(current_tick_, tick_at(Clock::now()));
+    }
+    link(node);
+    if (node->tick < next_wake_tick_) {
+      wake_.Signal();
+    }
+    return TimerHandle{this, node};
+  }
+
+  /** Re-arm a periodic timer after a run, unless it has been cancelled. */
+  void rearm(NodePtr const& node) ABSL_LOCKS_EXCLUDED(mutex_) {
+    auto now = Clock::now();
+    Lock lock{&mutex_};
+    if (node->cancelled || stopping_) {
+      return;
+    }
+    node->deadline += node->interval;
+    if (node->deadline < now) {
+      node->deadline = now;
+    }
+    if (n_timers_ == 0) {
+      current_tick_ = std::max(current_tick_, tick_at(now));
+    }
+    link(node);
+    if (node->tick < next_wake_tick_) {
+      wake_.Signal();
+    }
+  }
+
+  /** The tick in progress at @p time. */
+  std::uint64_t tick_at(Clock::time_point time) const noexcept {
+    return time <= start_ ? 0 : (time - start_) / resolution_;
+  }
+
+  /** The first tick starting at or after @p time. */
+  std::uint64_t tick_after(Clock::time_point time) const noexcept {
+    return time <= start_
+               ? 0
+               : (time - start_ + resolution_ - std::chrono::nanoseconds{1}) /
+                     resolution_;
+  }
+
+  /** The time at which @p tick starts. */
+  Clock::time_point time_of(std::uint64_t tick) const noexcept {
+    return start_ + std::chrono::duration_cast<Clock::duration>(
+                        resolution_ * static_cast<Clock::rep>(tick));
+  }
+
+  /** Add a node to the wheel for its deadline. */
+  void link(NodePtr const& node) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    node->tick = tick_after(node->deadline);
+    auto& slot = slot_for(*node);
+    occupied_[node->level] |= std::uint64_t{1} << node->slot;
+    slot.push_back(node);
+    node->position = std::prev(slot.end());
+    node->scheduled = true;
+    ++n_timers_;
+  }
+
+  /** Remove a scheduled node from the wheel. */
+  void unlink(TimerNode& node) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    node.scheduled = false;
+    --n_timers_;
+    auto const level = node.level;
+    auto const slot = node.slot;
+    // Erasing may destroy the node, so it must not be touched after this.
+    slots_[level][slot].erase(node.position);
+    if (slots_[level][slot].empty()) {
+      occupied_[level] &= ~(std::uint64_t{1} << slot);
+    }
+  }
+
+  /**
+   * The slot that @p node belongs in, given the current tick, storing its
+   * level and slot index in the node.
+   */
+  NodeList& slot_for(TimerNode& node) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    // Timers already due are placed in the next slot to be expired.
+    auto tick = std::max(node.tick, current_tick_ + 1);
+    auto delta = tick - current_tick_;
+    unsigned level = 0;
+    while (level + 1 < NumLevels && delta >= level_span(level + 1)) {
+      ++level;
+    }
+    if (delta >= level_span(NumLevels)) {
+      // Too far ahead for the wheel, so park the node in the furthest slot,
+      // from where it is placed again once that slot is reached.
+      tick = current_tick_ + level_span(NumLevels) - 1;
+    }
+    node.level = level;
+    node.slot = (tick >> (SlotBits * level)) & (NumSlots - 1);
+    return slots_[level][node.slot];
+  }
+
+  /** The number of ticks covered by each slot on @p level. */
+  static std::uint64_t level_span(unsigned level) noexcept {
+    return std::uint64_t{1} << (SlotBits * level);
+  }
+
+  /**
+   * Move the wheel on to @p target, moving any nodes that are due to
+   * @p expired.
+   */
+  void advance(std::uint64_t target, std::vector<NodePtr>& expired)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    while (current_tick_ < target) {
+      // Ticks with nothing due and no upper level slot to move down are
+      // skipped, so a fine resolution does not cost a step for every tick.
+      auto const tick = std::min(next_event_tick(), target);
+      current_tick_ = tick;
+      // Higher levels are placed first, so that nodes moving down onto a
+      // slot that is also being reached this tick are placed again with it.
+      for (unsigned level = NumLevels - 1; level > 0; --level) {
+        if ((tick & (level_span(level) - 1)) == 0) {
+          cascade(level, (tick >> (SlotBits * level)) & (NumSlots - 1));
+        }
+      }
+      auto const slot = tick & (NumSlots - 1);
+      auto& due = slots_[0][slot];
+      for (auto& node : due) {
+        node->scheduled = false;
+        expired.push_back(std::move(node));
+      }
+      n_timers_ -= due.size();
+      due.clear();
+      occupied_[0] &= ~(std::uint64_t{1} << slot);
+    }
+  }
+
+  /** Place each node in a slot again relative to the current tick. */
+  void cascade(unsigned level, std::uint64_t slot_index)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    auto& slot = slots_[level][slot_index];
+    occupied_[level] &= ~(std::uint64_t{1} << slot_index);
+    while (!slot.empty()) {
+      auto node = slot.begin();
+      auto& target = slot_for(**node);
+      occupied_[(*node)->level] |= std::uint64_t{1} << (*node)->slot;
+      // Splicing keeps the node's list entry, and so its position, valid.
+      target.splice(target.end(), slot, node);
+    }
+  }
+
+  /**
+   * The tick at which the timer thread next needs to wake: the next level
+   * zero slot with any nodes, or the end of the current level zero rotation
+   * when the upper levels need to be moved down.
+   */
+  std::uint64_t next_event_tick() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    auto const rotation_end = (current_tick_ | (NumSlots - 1)) + 1;
+    auto const next_slot = (current_tick_ + 1) & (NumSlots - 1);
+    if (next_slot == 0) {
+      return rotation_end;
+    }
+    auto const later = occupied_[0] & (~std::uint64_t{0} << next_slot);
+    if (later == 0) {
+      return rotation_end;
+    }
+    return (current_tick_ & ~std::uint64_t{NumSlots - 1}) +
+           __builtin_ctzll(later);
+  }
+
+  /** Main loop of the timer thread. */
+  void timer_loop() ABSL_LOCKS_EXCLUDED(mutex_) {
+    std::vector<NodePtr> expired;
+    mutex_.Lock();
+    while (!stopping_) {
+      auto now = Clock::now();
+      if (n_timers_ == 0) {
+        current_tick_ = std::max(current_tick_, tick_at(now));
+        next_wake_tick_ = UINT64_MAX;
+        wake_.Wait(&mutex_);
+        continue;
+      }
+      advance(tick_at(now), expired);
+      if (!expired.empty()) {
+        mutex_.Unlock();
+        for (auto& node : expired) {
+          run(node);
+        }
+        expired.clear();
+        mutex_.Lock();
+        continue;
+      }
+      next_wake_tick_ = next_event_tick();
+      wake_.WaitWithTimeout(&mutex_,
+                            absl::FromChrono(time_of(next_wake_tick_) - now));
+    }
+    mutex_.Unlock();
+  }
+
+  /** Dispatch the task of an expired node. */
+  void run(NodePtr& node) ABSL_LOCKS_EXCLUDED(mutex_) {
+    if (node->interval.count() == 0) {
+      dispatch_(std::move(node->task));
+      return;
+    }
+    dispatch_(UniqueTask{[this, node] {
+      {
+        Lock lock{&mutex_};
+        if (node->cancelled) {
+          return;
+        }
+      }
+      try {
+        node->task();
+      } catch (...) {
+        rearm(node);
+        throw;
+      }
+      rearm(node);
+    }});
+  }
+
+  /** Function called with each task that is due. */
+  Dispatch const dispatch_;
+  /** Length of each tick. */
+  std::chrono::nanoseconds const resolution_;
+  /** Time of the start of tick zero. */
+  Clock::time_point const start_;
+  /** Mutex guarding the wheel. */
+  mutable Mutex mutex_;
+  /** Signalled to wake the timer thread when a timer is due sooner. */
+  CondVar wake_;
+  /** The slots of each level of the wheel. */
+  NodeList slots_[NumLevels][NumSlots] ABSL_GUARDED_BY(mutex_);
+  /** Bitmask of the slots on each level holding any nodes. */
+  std::uint64_t occupied_[NumLevels] ABSL_GUARDED_BY(mutex_) = {};
+  /** The last tick that the wheel has been moved on to. */
+  std::uint64_t current_tick_ ABSL_GUARDED_BY(mutex_) = 0;
+  /** The tick the timer thread is sleeping until. */
+  std::uint64_t next_wake_tick_ ABSL_GUARDED_BY(mutex_) = 0;
+  /** The number of timers in the wheel. */
+  size_t n_timers_ ABSL_GUARDED_BY(mutex_) = 0;
+  /** Set once the wheel is stopped. */
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+  /** The timer thread, started last once the wheel is set up. */
+  std::thread thread_;
+};
+
+inline bool TimerHandle::cancel() {
+  auto node = node_.lock();
+  if (!node) {
+    return false;
+  }
+  return wheel_->cancel(*node);
+}
+
+}  // namespace acorn
+
+#endif  // ACORN_THREADS_TIMER_WHEEL_H_
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_UNIQUE_TASK_H_
+#define ACORN_THREADS_UNIQUE_TASK_H_
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace acorn {
+
+template <typename Return>
+struct UniqueFunctionInvokeHelper {
+  template <typename Function, typename... Args>
+  static Return invoke(Function& func, Args&&... args) {
+    return func(std::forward<Args>(args)...);
+  }
+};
+
+template <>
+struct UniqueFunctionInvokeHelper<void> {
+  template <typename Function, typename... Args>
+  static void invoke(Function& func, Args&&... args) {
+    // Any returned value is discarded.
+    func(std::forward<Args>(args)...);
+  }
+};
+
+template <typename Signature, size_t InlineSize = 48>
+struct UniqueFunction;
+
+/**
+ * A move-only, type-erased callable wrapper.
+ *
+ * Unlike @c std::function this does not require the callable to be copyable,
+ * so can hold lambdas capturing move-only state such as a
+ * @c std::packaged_task. Callables no larger than @p InlineSize bytes, and
+ * which can be moved without throwing, are stored inline in the wrapper
+ * rather than being allocated on the heap.
+ *
+ * @tparam Return Return type of the wrapped call.
+ * @tparam Args Argument types of the wrapped call.
+ * @tparam InlineSize Number of bytes available to store a callable inline.
+ */
+template <typename Return, typename... Args, size_t InlineSize>
+struct UniqueFunction<Return(Args...), InlineSize> {
+ private:
+  using Storage = typename std::aligned_storage<InlineSize>::type;
+
+  /** Type specific operations on the stored callable. */
+  struct Operations {
+    Return (*invoke)(Storage& storage, Args&&... args);
+    /** Move construct into @c to from @c from, and destroy @c from. */
+    void (*relocate)(Storage& from, Storage& to) noexcept;
+    void (*destroy)(Storage& storage) noexcept;
+  };
+
+  template <typename Function>
+  struct InlineOperations {
+    static Function& get(Storage& storage) noexcept {
+      return *reinterpret_cast<Function*>(&storage);
+    }
+    static Return invoke(Storage& storage, Args&&... args) {
+      return UniqueFunctionInvokeHelper<Return>::invoke(
+          get(storage), std::forward<Args>(args)...);
+    }
+    static void relocate(Storage& from, Storage& to) noexcept {
+      ::new (static_cast<void*>(&to)) Function(std::move(get(from)));
+      get(from).~Function();
+    }
+    static void destroy(Storage& storage) noexcept { get(storage).~Function(); }
+    static Operations const* operations() noexcept {
+      static constexpr Operations ops{&invoke, &relocate, &destroy};
+      return &ops;
+    }
+  };
+
+  template <typename Function>
+  struct HeapOperations {
+    static Function*& get(Storage& storage) noexcept {
+      return *reinterpret_cast<Function**>(&storage);
+    }
+    static Return invoke(Storage& storage, Args&&... args) {
+      return UniqueFunctionInvokeHelper<Return>::invoke(
+          *get(storage), std::forward<Args>(args)...);
+    }
+    static void relocate(Storage& from, Storage& to) noexcept {
+      ::new (static_cast<void*>(&to)) Function*{get(from)};
+    }
+    static void destroy(Storage& storage) noexcept { delete get(storage); }
+    static Operations const* operations() noexcept {
+      static constexpr Operations ops{&invoke, &relocate, &destroy};
+      return &ops;
+    }
+  };
+
+  template <typename Function>
+  using StoredInline = std::integral_constant<
+      bool, sizeof(Function) <= sizeof(Storage) &&
+                alignof(Function) <= alignof(Storage) &&
+                std::is_nothrow_move_constructible<Function>::value>;
+
+  template <typename Function>
+  using IsCallable = std::integral_constant<
+      bool,
+      !std::is_same<typename std::decay<Function>::type,
+                    UniqueFunction>::value &&
+          (std::is_void<Return>::value ||
+           std::is_convertible<decltype(std::declval<Function&>()(
+                                   std::declval<Args>()...)),
+                               Return>::value)>;
+
+ public:
+  /** Construct an empty wrapper, which must not be called. */
+  UniqueFunction() noexcept = default;
+
+  /** Wrap the given callable. */
+  template <typename Function,
+            typename std::enable_if<IsCallable<Function>::value, int>::type = 0>
+  UniqueFunction(Function&& func) {
+    using Stored = typename std::decay<Function>::type;
+    store(std::forward<Function>(func), StoredInline<Stored>{});
+  }
+
+  UniqueFunction(UniqueFunction const&) = delete;
+  UniqueFunction& operator=(UniqueFunction const&) = delete;
+
+  UniqueFunction(UniqueFunction&& other) noexcept : ops_{other.ops_} {
+    if (ops_ != nullptr) {
+      ops_->relocate(other.storage_, storage_);
+      other.ops_ = nullptr;
+    }
+  }
+
+  UniqueFunction& operator=(UniqueFunction&& other) noexcept {
+    if (this != &other) {
+      reset();
+      if (other.ops_ != nullptr) {
+        other.ops_->relocate(other.storage_, storage_);
+        ops_ = other.ops_;
+        other.ops_ = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  ~UniqueFunction() { reset(); }
+
+  /** Call the wrapped callable. The wrapper must not be empty. */
+  Return operator()(Args... args) {
+    return ops_->invoke(storage_, std::forward<Args>(args)...);
+  }
+
+  /** Whether the wrapper holds a callable. */
+  explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+  /** Destroy any wrapped callable, leaving the wrapper empty. */
+  void reset() noexcept {
+    if (ops_ != nullptr) {
+      ops_->destroy(storage_);
+      ops_ = nullptr;
+    }
+  }
+
+ private:
+  template <typename Function>
+  void store(Function&& func, std::true_type /* inline */) {
+    using Stored = typename std::decay<Function>::type;
+    ::new (static_cast<void*>(&storage_)) Stored(std::forward<Function>(func));
+    ops_ = InlineOperations<Stored>::operations();
+  }
+
+  template <typename Function>
+  void store(Function&& func, std::false_type /* inline */) {
+    using Stored = typename std::decay<Function>::type;
+    ::new (static_cast<void*>(&storage_))
+        Stored*{new Stored(std::forward<Function>(func))};
+    ops_ = HeapOperations<Stored>::operations();
+  }
+
+  /** Operations for the stored callable, or null if there is none. */
+  Operations const* ops_ = nullptr;
+  /** Storage for the callable, or a pointer to it if held on the heap. */
+  Storage storage_;
+};
+
+/**
+ * A move-only task with no arguments or return value.
+ *
+ * This is the type-erased task held in the thread pool task queues, and fits
+ * small lambdas, such as those capturing a few pointers, without allocating.
+ */
+using UniqueTask = UniqueFunction<void()>;
+
+}  // namespace acorn
+
+#endif  // ACORN_THREADS_UNIQUE_TASK_H_
@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ACORN_THREADS_WORK_STEALING_THREAD_POOL_H_
+#define ACORN_THREADS_WORK_STEALING_THREAD_POOL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+#include "acorn/threads/cpu_topology.h"
+
+namespace acorn {
+
+/**
+ * A thread pool executor where each worker has its own task deque.
+ *
+ * Workers push and pop tasks from the back of their own deque, and when that
+ * is empty they steal from the front of the deques of other, randomly chosen,
+ * workers. Tasks submitted from a worker thread are added to that worker's
+ * deque, while tasks submitted from outside the pool are spread across the
+ * workers in turn.
+ *
+ * Compared to the SharedThreadPool this avoids every submission and every
+ * dequeue contending on a single lock.
+ */
+struct WorkStealingThreadPool {
+ private:
+  using Mutex = absl::Mutex;
+  using Lock = absl::MutexLock;
+  using CondVar = absl::CondVar;
+
+  using Task = std::packaged_task<void()>;
+  using TaskDeque = std::deque<Task>;
+
+  using Thread = std::thread;
+  using ThreadContainer = std::vector<Thread>;
+
+  /** The task deque owned by a single worker. */
+  struct Worker {
+    /**
+     * Mutex guarding the worker's deque. This is only contended when another
+     * worker is trying to steal from this one.
+     */
+    Mutex mutex;
+    /**
+     * The worker's queued tasks. The owner uses the back, thieves the front.
+     */
+    TaskDeque deque ABSL_GUARDED_BY(mutex);
+  };
+  using WorkerContainer = std::vector<std::unique_ptr<Worker>>;
+
+  /** Identifies the pool and worker that the current thread belongs to. */
+  struct WorkerContext {
+    WorkStealingThreadPool const* pool = nullptr;
+    size_t index = 0;
+  };
+
+ public:
+  /** Construct a WorkStealingThreadPool with a set number of threads. */
+  explicit WorkStealingThreadPool(unsigned n_threads)
+      : WorkStealingThreadPool{n_threads, {}} {}
+
+  /**
+   * Construct a WorkStealingThreadPool with a set number of threads, pinning
+   * worker @c i to the CPUs in @c worker_affinity[i % worker_affinity.size()].
+   * Workers are left unpinned if @p worker_affinity is empty.
+   */
+  WorkStealingThreadPool(unsigned n_threads,
+                         std::vector<CpuSet> const& worker_affinity) {
+    workers_.reserve(n_threads);
+    for (unsigned count = 0; count < n_threads; ++count) {
+      workers_.emplace_back(new Worker{});
+    }
+    // All worker deques must exist before any thread starts trying to steal
+    // from them.
+    thread_pool_.reserve(n_threads);
+    for (unsigned count = 0; count < n_threads; ++count) {
+      thread_pool_.emplace_back(
+          &WorkStealingThreadPool::worker_loop, this, count,
+          worker_affinity.empty()
+              ? CpuSet{}
+              : worker_affinity[count % worker_affinity.size()]);
+    }
+  }
+
+  WorkStealingThreadPool() = delete;
+  WorkStealingThreadPool(WorkStealingThreadPool const&) = delete;
+  WorkStealingThreadPool& operator=(WorkStealingThreadPool const&) = delete;
+
+  /**
+   * Tear down the thread pool and wait for all currently queued tasks to be
+   * completed.
+   */
+  ~WorkStealingThreadPool() ABSL_LOCKS_EXCLUDED(sleep_mutex_) {
+    {
+      Lock lock{&sleep_mutex_};
+      shutting_down_ = true;
+      sleep_cv_.SignalAll();
+    }
+    for (auto& thread : thread_pool_) {
+      thread.join();
+    }
+  }
+
+  /**
+   * Add a task to be run on the ThreadPool.
+   * @return A @c std::future which will be filled in with the return value of
+   * the task once completed.
+   */
+  template <typename Function>
+  auto add_task(Function&& func) -> std::future<decltype(func())> {
+    using Return = decltype(func());
+    using TypedTask = std::packaged_task<Return()>;
+
+    auto new_task = TypedTask{std::move(func)};
+    auto future = new_task.get_future();
+    add_task(std::move(new_task));
+    return future;
+  }
+
+  /**
+   * Add a packaged task to run on the WorkStealingThreadPool.
+   *
+   * If called from one of this pool's workers the task is pushed onto that
+   * worker's deque, otherwise the deques are filled in a round robin.
+   */
+  template <typename ReturnType>
+  void add_task(std::packaged_task<ReturnType()>&& task) {
+    auto const& context = current_worker();
+    size_t index = context.pool == this
+                       ? context.index
+                       : next_worker_.fetch_add(1, std::memory_order_relaxed) %
+                             workers_.size();
+    auto& worker = *workers_[index];
+    {
+      Lock lock{&worker.mutex};
+      // The task is counted under the same lock that a pop or steal takes
+      // before uncounting it, so the count never drops below zero. A worker
+      // which sees the count before the lock is released finds the task once
+      // it can take the lock.
+      pending_.fetch_add(1);
+      worker.deque.emplace_back(std::move(task));
+    }
+    if (n_sleeping_.load() > 0) {
+      Lock lock{&sleep_mutex_};
+      sleep_cv_.Signal();
+    }
+  }
+
+  /** The number of worker threads in the pool. */
+  size_t size() const noexcept { return thread_pool_.size(); }
+
+ private:
+  /** The worker context for the calling thread. */
+  static WorkerContext& current_worker() noexcept {
+    static thread_local WorkerContext context{};
+    return context;
+  }
+
+  /**
+   * The main loop for each of the worker threads.
+   *
+   * Run tasks from the worker's own deque until it is empty, then try to steal
+   * tasks from other workers. Only once there are no tasks queued anywhere in
+   * the pool will the worker sleep. The worker exits once the pool is shutting
+   * down and all queued tasks have been taken.
+   *
+   * @param index [in] Index of the worker's deque.
+   * @param affinity [in] CPUs to pin the worker to, or empty to leave it
+   * unpinned.
+   */
+  void worker_loop(size_t index, CpuSet const& affinity) {
+    if (!affinity.empty()) {
+      pin_current_thread(affinity);
+    }
+    current_worker() = WorkerContext{this, index};
+    uint32_t rng_state = static_cast<uint32_t>(index) * 2654435761u + 1u;
+    Task task;
+    while (true) {
+      if (pop_local(index, task) || steal(index, rng_state, task)) {
+        task();
+        continue;
+      }
+      if (!wait_for_work()) {
+        break;
+      }
+    }
+    current_worker() = WorkerContext{};
+  }
+
+  /** Take the most recently pushed task from the worker's own deque. */
+  bool pop_local(size_t index, Task& task) {
+    auto& worker = *workers_[index];
+    Lock lock{&worker.mutex};
+    if (worker.deque.empty()) {
+      return false;
+    }
+    task = std::move(worker.deque.back());
+    worker.deque.pop_back();
+    pending_.fetch_sub(1);
+    return true;
+  }
+
+  /**
+   * Try to take the oldest task from another worker's deque. Victims are
+   * visited in turn, starting from a randomly chosen one.
+   */
+  bool steal(size_t index, uint32_t& rng_state, Task& task) {
+    size_t const n_workers = workers_.size();
+    if (pending_.load() == 0 || n_workers < 2) {
+      return false;
+    }
+    // xorshift32 is plenty to spread thieves across the victims.
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    size_t start = rng_state % n_workers;
+    for (size_t offset = 0; offset < n_workers; ++offset) {
+      size_t victim_index = (start + offset) % n_workers;
+      if (victim_index == index) {
+        continue;
+      }
+      auto& victim = *workers_[victim_index];
+      Lock lock{&victim.mutex};
+      if (victim.deque.empty()) {
+        continue;
+      }
+      task = std::move(victim.deque.front());
+      victim.deque.pop_front();
+      pending_.fetch_sub(1);
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * Sleep until there are tasks queued in the pool.
+   *
+   * @return Whether the worker should keep running, which is false only once
+   * the pool is shutting down and there is no work left.
+   */
+  bool wait_for_work() ABSL_LOCKS_EXCLUDED(sleep_mutex_) {
+    // Announcing that this worker is about to sleep before checking for work
+    // pairs with add_task counting the task before checking for sleepers, so
+    // either the worker sees the task or the submitter sees the worker.
+    n_sleeping_.fetch_add(1);
+    Lock lock{&sleep_mutex_};
+    while (pending_.load() == 0 && !shutting_down_) {
+      sleep_cv_.Wait(&sleep_mutex_);
+    }
+    n_sleeping_.fetch_sub(1);
+    return pending_.load() > 0 || !shutting_down_;
+  }
+
+  /** Per-worker task deques, indexed by the worker's index. */
+  WorkerContainer workers_;
+  /**
+   * Pool of worker threads, used to execute queued tasks. Each worker thread
+   * should invoke the WorkStealingThreadPool::worker_loop.
+   */
+  ThreadContainer thread_pool_;
+  /** Number of tasks queued across all worker deques. */
+  std::atomic<size_t> pending_{0};
+  /** Number of workers that are sleeping, or about to sleep. */
+  std::atomic<size_t> n_sleeping_{0};
+  /** Counter used to spread external submissions across the workers. */
+  std::atomic<size_t> next_worker_{0};
+  /** Mutex used by idle workers to sleep until there is work to do. */
+  Mutex sleep_mutex_;
+  /** Condition variable signalled when work is added or the pool shuts down. */
+  CondVar sleep_cv_;
+  /** Whether the pool is being torn down. */
+  bool shutting_down_ ABSL_GUARDED_BY(sleep_mutex_) = false;
+};
+
+}  // namespace acorn
+
+#endif  // ACORN_THREADS_WORK_STEALING_THREAD_POOL_H_
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "acorn/macros.h"
+#include "acorn/threads/idle_policy.h"
+#include "acorn/threads/pool_options.h"
+#include "acorn/threads/shared_thread_pool.h"
+
+#include "benchmark/benchmark.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+acorn::IdlePolicy idle_policy_for(int64_t selector) {
+  return selector == 0 ? acorn::IdlePolicy::park()
+                       : acorn::IdlePolicy::spin_then_park();
+}
+
+void busy_wait(std::chrono::microseconds duration) {
+  auto end = std::chrono::steady_clock::now() + duration;
+  while (std::chrono::steady_clock::now() < end) {
+    acorn::cpu_relax();
+  }
+}
+}  // namespace
+
+/**
+ * Time from submitting a tiny task to it starting on a worker, when the
+ * workers have been idle for a short gap since their last task.
+ *
+ * Arguments are the idle gap in microseconds, and the idle policy where 0 is
+ * park and 1 is spin then park.
+ */
+static void SubmitToStartLatency(::benchmark::State& state) {
+  using Clock = std::chrono::steady_clock;
+  auto gap = std::chrono::microseconds{state.range(0)};
+  acorn::PoolOptions options;
+  options.idle_policy = idle_policy_for(state.range(1));
+  acorn::SharedThreadPool pool{1, options};
+
+  std::atomic<bool> started{false};
+  Clock::time_point start_time;
+
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    busy_wait(gap);
+    started.store(false, std::memory_order_relaxed);
+    auto submit_time = Clock::now();
+    pool.execute([&] {
+      start_time = Clock::now();
+      started.store(true, std::memory_order_release);
+    });
+    while (!started.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+    std::chrono::duration<double> latency = start_time - submit_time;
+    state.SetIterationTime(latency.count());
+  }
+}
+static void LatencyArguments(::benchmark::internal::Benchmark* bench) {
+  for (int64_t gap : {1, 10, 1000}) {
+    for (int64_t policy : {0, 1}) {
+      bench->Args({gap, policy});
+    }
+  }
+}
+BENCHMARK(SubmitToStartLatency)->Apply(LatencyArguments)->UseManualTime();
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "acorn/macros.h"
+#include "acorn/threads/parallel_for.h"
+#include "acorn/threads/shared_thread_pool.h"
+
+#include "benchmark/benchmark.h"
+
+#include <cmath>
+#include <future>
+#include <vector>
+
+namespace {
+/** Work for an index, where the cost grows with the index. */
+float skewed_work(int64_t index) {
+  float value = 0.0f;
+  for (int64_t i = 0; i < index; ++i) {
+    value += std::sqrt(static_cast<float>(i));
+  }
+  return value;
+}
+}  // namespace
+
+static void SkewedLoopHandChunked(::benchmark::State& state) {
+  auto n_threads = std::thread::hardware_concurrency();
+  auto n_values = state.range(0);
+  acorn::SharedThreadPool pool{n_threads};
+  std::vector<float> data(n_values);
+  std::vector<std::future<void>> futures(n_threads);
+
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    auto chunk_size = (n_values + n_threads - 1) / n_threads;
+    for (unsigned chunk = 0; chunk < n_threads; ++chunk) {
+      futures[chunk] = pool.add_task([&, chunk] {
+        auto first = chunk * chunk_size;
+        auto last = std::min<int64_t>(first + chunk_size, n_values);
+        for (auto index = first; index < last; ++index) {
+          data[index] = skewed_work(index);
+        }
+      });
+    }
+    for (auto&& future : futures) {
+      future.wait();
+    }
+    ::benchmark::DoNotOptimize(data.data());
+  }
+}
+BENCHMARK(SkewedLoopHandChunked)->Range(1 << 8, 1 << 12)->UseRealTime();
+
+static void SkewedLoopParallelFor(::benchmark::State& state) {
+  auto n_threads = std::thread::hardware_concurrency();
+  auto n_values = state.range(0);
+  acorn::SharedThreadPool pool{n_threads};
+  std::vector<float> data(n_values);
+
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    acorn::parallel_for(
+        pool, int64_t{0}, n_values,
+        [&](int64_t index) { data[index] = skewed_work(index); });
+    ::benchmark::DoNotOptimize(data.data());
+  }
+}
+BENCHMARK(SkewedLoopParallelFor)->Range(1 << 8, 1 << 12)->UseRealTime();
+
+static void ParallelReduceSum(::benchmark::State& state) {
+  auto n_threads = std::thread::hardware_concurrency();
+  auto n_values = state.range(0);
+  acorn::SharedThreadPool pool{n_threads};
+  std::vector<float> data(n_values, 1.0f);
+
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    auto sum = acorn::parallel_reduce(
+        pool, int64_t{0}, n_values, 0.0f,
+        [&](int64_t index) { return data[index]; },
+        [](float lhs, float rhs) { return lhs + rhs; });
+    ::benchmark::DoNotOptimize(sum);
+  }
+}
+BENCHMARK(ParallelReduceSum)->Range(1 << 10, 1 << 20)->UseRealTime();
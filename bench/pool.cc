@@ -31,23 +31,59 @@
 
 #include "acorn/macros.h"
 #include "acorn/threads/shared_thread_pool.h"
+#include "acorn/threads/strand.h"
+#include "acorn/threads/work_stealing_thread_pool.h"
 
 #include "benchmark/benchmark.h"
 
+#include <atomic>
 #include <chrono>
+#include <functional>
 #include <future>
+#include <memory>
+#include <mutex>
 #include <numeric>
+#include <type_traits>
 #include <vector>
 
+/**
+ * Construct a pool for ManySmallTasks, with workers taking up to the second
+ * argument's number of tasks from the queue at once where the pool supports
+ * PoolOptions.
+ */
+template <typename Pool,
+          typename std::enable_if<
+              std::is_constructible<Pool, unsigned, acorn::PoolOptions>::value,
+              int>::type = 0>
+static std::unique_ptr<Pool> make_batched_pool(unsigned n_threads,
+                                               ::benchmark::State& state) {
+  acorn::PoolOptions options;
+  options.dequeue_batch = static_cast<size_t>(state.range(1));
+  return std::unique_ptr<Pool>{new Pool{n_threads, options}};
+}
+template <typename Pool,
+          typename std::enable_if<
+              !std::is_constructible<Pool, unsigned, acorn::PoolOptions>::value,
+              int>::type = 0>
+static std::unique_ptr<Pool> make_batched_pool(
+    unsigned n_threads, ACORN_MAYBE_UNUSED ::benchmark::State& state) {
+  return std::unique_ptr<Pool>{new Pool{n_threads}};
+}
+
+/**
+ * Add many short tasks to the pool and wait for them all. The second argument
+ * is the pool's dequeue batch size, where one takes a single task at a time.
+ */
+template <typename Pool>
 static void ManySmallTasks(::benchmark::State& state) {
   auto n_threads = std::thread::hardware_concurrency();
   auto n_tasks = state.range(0);
-  acorn::SharedThreadPool pool{n_threads};
+  auto pool = make_batched_pool<Pool>(n_threads, state);
   std::vector<std::future<void>> futures(n_tasks);
 
   for (ACORN_MAYBE_UNUSED auto&& _ : state) {
     for (int i = 0; i < n_tasks; ++i) {
-      auto future = pool.add_task(
+      auto future = pool->add_task(
           [] { std::this_thread::sleep_for(std::chrono::nanoseconds{100}); });
       futures[i] = std::move(future);
     }
@@ -56,13 +92,76 @@ static void ManySmallTasks(::benchmark::State& state) {
     }
   }
 }
-BENCHMARK(ManySmallTasks)->Ranges({{1 << 8, 1 << 14}})->UseRealTime();
+BENCHMARK_TEMPLATE(ManySmallTasks, acorn::SharedThreadPool)
+    ->Ranges({{1 << 8, 1 << 14}, {1, 32}})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(ManySmallTasks, acorn::LockFreeSharedThreadPool<>)
+    ->Ranges({{1 << 8, 1 << 14}, {1, 32}})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(ManySmallTasks, acorn::NumaSharedThreadPool)
+    ->Ranges({{1 << 8, 1 << 14}, {1, 32}})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(ManySmallTasks, acorn::WorkStealingThreadPool)
+    ->Ranges({{1 << 8, 1 << 14}, {1, 1}})
+    ->UseRealTime();
+
+template <typename Pool>
+static void ManySmallExecutes(::benchmark::State& state) {
+  auto n_threads = std::thread::hardware_concurrency();
+  auto n_tasks = state.range(0);
+  Pool pool{n_threads};
+  std::atomic<int64_t> n_done{0};
+
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    n_done = 0;
+    for (int i = 0; i < n_tasks; ++i) {
+      pool.execute([&n_done] {
+        std::this_thread::sleep_for(std::chrono::nanoseconds{100});
+        n_done++;
+      });
+    }
+    while (n_done.load() < n_tasks) {
+      std::this_thread::yield();
+    }
+  }
+}
+BENCHMARK_TEMPLATE(ManySmallExecutes, acorn::SharedThreadPool)
+    ->Ranges({{1 << 8, 1 << 14}})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(ManySmallExecutes, acorn::LockFreeSharedThreadPool<>)
+    ->Ranges({{1 << 8, 1 << 14}})
+    ->UseRealTime();
+
+template <typename Pool>
+static void ManySmallTasksInBulk(::benchmark::State& state) {
+  auto n_threads = std::thread::hardware_concurrency();
+  auto n_tasks = state.range(0);
+  Pool pool{n_threads};
+  auto task = [] {
+    std::this_thread::sleep_for(std::chrono::nanoseconds{100});
+  };
+  std::vector<decltype(task)> tasks(n_tasks, task);
+
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    auto futures = pool.add_tasks(tasks.begin(), tasks.end());
+    for (auto&& future : futures) {
+      future.wait();
+    }
+  }
+}
+BENCHMARK_TEMPLATE(ManySmallTasksInBulk, acorn::SharedThreadPool)
+    ->Ranges({{1 << 8, 1 << 14}})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(ManySmallTasksInBulk, acorn::LockFreeSharedThreadPool<>)
+    ->Ranges({{1 << 8, 1 << 14}})
+    ->UseRealTime();
 
+template <typename Pool>
 static void FewLargeTasks(::benchmark::State& state) {
   auto n_threads = std::thread::hardware_concurrency();
   auto n_tasks = state.range(0);
   auto n_values = state.range(1);
-  acorn::SharedThreadPool pool{n_threads};
+  Pool pool{n_threads};
   std::vector<std::future<float>> futures(n_tasks);
   std::vector<float> data(n_values);
 
@@ -80,4 +179,128 @@ static void FewLargeTasks(::benchmark::State& state) {
     }
   }
 }
-BENCHMARK(FewLargeTasks)->Ranges({{4, 16}, {1 << 10, 1 << 15}})->UseRealTime();
+BENCHMARK_TEMPLATE(FewLargeTasks, acorn::SharedThreadPool)
+    ->Ranges({{4, 16}, {1 << 10, 1 << 15}})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(FewLargeTasks, acorn::LockFreeSharedThreadPool<>)
+    ->Ranges({{4, 16}, {1 << 10, 1 << 15}})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(FewLargeTasks, acorn::NumaSharedThreadPool)
+    ->Ranges({{4, 16}, {1 << 10, 1 << 15}})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(FewLargeTasks, acorn::WorkStealingThreadPool)
+    ->Ranges({{4, 16}, {1 << 10, 1 << 15}})
+    ->UseRealTime();
+
+template <typename Pool>
+static void ScheduleAndCancelTimeouts(::benchmark::State& state) {
+  auto n_timers = state.range(0);
+  Pool pool{1};
+  std::vector<acorn::TimerHandle> handles(n_timers);
+
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    for (int i = 0; i < n_timers; ++i) {
+      handles[i] = pool.add_task_after(std::chrono::seconds{1 + i % 60}, [] {});
+    }
+    for (auto& handle : handles) {
+      handle.cancel();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n_timers);
+}
+BENCHMARK_TEMPLATE(ScheduleAndCancelTimeouts, acorn::SharedThreadPool)
+    ->Ranges({{1 << 10, 1 << 17}})
+    ->UseRealTime();
+
+/**
+ * Chains of tasks where each link works on the buffer left by the previous
+ * link and then submits the next link, with and without run_next slots.
+ */
+template <typename Pool>
+static void ChainedTasks(::benchmark::State& state) {
+  auto n_threads = std::thread::hardware_concurrency();
+  auto chain_length = state.range(0);
+  acorn::PoolOptions options;
+  options.run_next = state.range(1) != 0;
+  Pool pool{n_threads, options};
+  auto n_chains = static_cast<int64_t>(n_threads) * 4;
+  std::vector<std::vector<int>> buffers(n_chains, std::vector<int>(4096));
+  std::atomic<int64_t> n_done{0};
+
+  std::function<void(std::vector<int>*, int64_t)> link =
+      [&](std::vector<int>* buffer, int64_t remaining) {
+        for (auto& value : *buffer) {
+          ++value;
+        }
+        if (remaining > 1) {
+          pool.execute(
+              [&link, buffer, remaining] { link(buffer, remaining - 1); });
+        } else {
+          n_done++;
+        }
+      };
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    n_done = 0;
+    for (auto& buffer : buffers) {
+      pool.execute([&link, &buffer, chain_length] {
+        link(&buffer, chain_length);
+      });
+    }
+    while (n_done.load() < n_chains) {
+      std::this_thread::yield();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n_chains * chain_length);
+}
+BENCHMARK_TEMPLATE(ChainedTasks, acorn::SharedThreadPool)
+    ->Ranges({{16, 256}, {0, 1}})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(ChainedTasks, acorn::LockFreeSharedThreadPool<>)
+    ->Ranges({{16, 256}, {0, 1}})
+    ->UseRealTime();
+
+/**
+ * Ordered tasks spread over many keys, serialised either by a Strand per key
+ * or, with a second argument of zero, by a mutex per key held in each task.
+ */
+static void OrderedTasksPerKey(::benchmark::State& state) {
+  auto n_threads = std::thread::hardware_concurrency();
+  auto n_keys = state.range(0);
+  bool use_strands = state.range(1) != 0;
+  constexpr int64_t NumTasksPerKey = 64;
+  acorn::SharedThreadPool pool{n_threads};
+  std::vector<std::unique_ptr<acorn::Strand>> strands;
+  std::vector<std::mutex> mutexes(n_keys);
+  std::vector<int64_t> values(n_keys);
+  for (int64_t key = 0; key < n_keys; ++key) {
+    strands.emplace_back(new acorn::Strand{pool});
+  }
+  std::atomic<int64_t> n_done{0};
+
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    n_done = 0;
+    for (int64_t i = 0; i < NumTasksPerKey; ++i) {
+      for (int64_t key = 0; key < n_keys; ++key) {
+        auto* value = &values[key];
+        if (use_strands) {
+          strands[key]->execute([value, &n_done] {
+            ++*value;
+            n_done++;
+          });
+        } else {
+          auto* mutex = &mutexes[key];
+          pool.execute([value, mutex, &n_done] {
+            std::lock_guard<std::mutex> lock{*mutex};
+            ++*value;
+            n_done++;
+          });
+        }
+      }
+    }
+    while (n_done.load() < n_keys * NumTasksPerKey) {
+      std::this_thread::yield();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n_keys * NumTasksPerKey);
+}
+BENCHMARK(OrderedTasksPerKey)->Ranges({{1, 1 << 12}, {0, 1}})->UseRealTime();
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "acorn/macros.h"
+#include "acorn/threads/shared_thread_pool.h"
+#include "acorn/threads/static_taskgraph.h"
+#include "acorn/threads/taskgraph.h"
+
+#include "benchmark/benchmark.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+/** Number of nodes in each layer of the benchmark graphs. */
+constexpr int64_t GraphWidth = 16;
+
+/**
+ * Add @p n_layers layers of nodes to @p graph, where each node depends on two
+ * nodes of the layer before.
+ */
+void build_layers(acorn::StaticTaskGraph& graph, int64_t n_layers,
+                  std::atomic<int64_t>& count) {
+  std::vector<acorn::StaticTaskGraph::Node> previous;
+  std::vector<acorn::StaticTaskGraph::Node> layer;
+  for (int64_t depth = 0; depth < n_layers; ++depth) {
+    layer.clear();
+    for (int64_t i = 0; i < GraphWidth; ++i) {
+      if (depth == 0) {
+        layer.push_back(graph.add([&count] { count++; }));
+      } else {
+        layer.push_back(graph.add([&count] { count++; }, previous[i],
+                                  previous[(i + 1) % GraphWidth]));
+      }
+    }
+    std::swap(previous, layer);
+  }
+}
+}  // namespace
+
+/**
+ * A layered graph, where each node depends on two nodes of the layer before,
+ * submitted to a TaskGraph on every iteration.
+ */
+static void SubmittedTaskGraph(::benchmark::State& state) {
+  auto n_layers = state.range(0);
+  acorn::TaskGraph graph{std::thread::hardware_concurrency()};
+  std::atomic<int64_t> count{0};
+  std::vector<acorn::TaskGraph::Task<void>> previous;
+  std::vector<acorn::TaskGraph::Task<void>> layer;
+
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    previous.clear();
+    for (int64_t depth = 0; depth < n_layers; ++depth) {
+      layer.clear();
+      for (int64_t i = 0; i < GraphWidth; ++i) {
+        if (depth == 0) {
+          layer.push_back(graph.submit([&count] { count++; }));
+        } else {
+          layer.push_back(graph.submit([&count] { count++; }, previous[i],
+                                       previous[(i + 1) % GraphWidth]));
+        }
+      }
+      std::swap(previous, layer);
+    }
+    for (auto&& task : previous) {
+      task.future.wait();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n_layers * GraphWidth);
+}
+BENCHMARK(SubmittedTaskGraph)->Range(1, 64)->UseRealTime();
+
+/** The same layered graph built afresh as a StaticTaskGraph for every run. */
+static void RebuiltTaskGraph(::benchmark::State& state) {
+  auto n_layers = state.range(0);
+  acorn::SharedThreadPool pool{std::thread::hardware_concurrency()};
+  std::atomic<int64_t> count{0};
+
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    acorn::StaticTaskGraph graph{pool};
+    build_layers(graph, n_layers, count);
+    graph.run();
+  }
+  state.SetItemsProcessed(state.iterations() * n_layers * GraphWidth);
+}
+BENCHMARK(RebuiltTaskGraph)->Range(1, 64)->UseRealTime();
+
+/** The same layered graph built once and then run repeatedly. */
+static void ReusedTaskGraph(::benchmark::State& state) {
+  auto n_layers = state.range(0);
+  acorn::SharedThreadPool pool{std::thread::hardware_concurrency()};
+  acorn::StaticTaskGraph graph{pool};
+  std::atomic<int64_t> count{0};
+  build_layers(graph, n_layers, count);
+
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    graph.run();
+  }
+  state.SetItemsProcessed(state.iterations() * n_layers * GraphWidth);
+}
+BENCHMARK(ReusedTaskGraph)->Range(1, 64)->UseRealTime();
+
+/**
+ * A chain of tasks each adding one to its predecessor's result, read through
+ * the predecessor's future.
+ */
+static void ValueChainThroughFutures(::benchmark::State& state) {
+  auto n_tasks = state.range(0);
+  acorn::TaskGraph graph{std::thread::hardware_concurrency()};
+  std::vector<acorn::TaskGraph::Task<int64_t>> tasks;
+  tasks.reserve(n_tasks);
+
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    tasks.clear();
+    tasks.push_back(graph.submit([] { return int64_t{0}; }));
+    for (int64_t i = 1; i < n_tasks; ++i) {
+      auto* previous = &tasks.back().future;
+      tasks.push_back(graph.submit([previous] { return previous->get() + 1; },
+                                   tasks.back()));
+    }
+    ::benchmark::DoNotOptimize(tasks.back().future.get());
+  }
+  state.SetItemsProcessed(state.iterations() * n_tasks);
+}
+BENCHMARK(ValueChainThroughFutures)->Range(8, 512)->UseRealTime();
+
+/** The same chain of tasks, passing each result along a dataflow edge. */
+static void ValueChainThroughFlows(::benchmark::State& state) {
+  auto n_tasks = state.range(0);
+  acorn::TaskGraph graph{std::thread::hardware_concurrency()};
+  std::vector<acorn::TaskGraph::Flow<int64_t>> flows;
+  flows.reserve(n_tasks);
+
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    flows.clear();
+    flows.push_back(graph.source([] { return int64_t{0}; }));
+    for (int64_t i = 1; i < n_tasks; ++i) {
+      flows.push_back(graph.submit([](int64_t value) { return value + 1; },
+                                   std::move(flows.back())));
+    }
+    ::benchmark::DoNotOptimize(graph.get_future(std::move(flows.back())).get());
+  }
+  state.SetItemsProcessed(state.iterations() * n_tasks);
+}
+BENCHMARK(ValueChainThroughFlows)->Range(8, 512)->UseRealTime();
+
+/**
+ * Makespan of a graph of independent leaf tasks submitted ahead of a long
+ * chain, scheduled in FIFO order or, with an argument of one, critical path
+ * first. The tasks sleep, so that the benchmark measures scheduling order
+ * rather than the machine's number of cores.
+ */
+static void LeavesAndChain(::benchmark::State& state) {
+  constexpr int64_t NumLeaves = 64;
+  constexpr int64_t ChainLength = 16;
+  auto scheduling = state.range(0) != 0
+                        ? acorn::TaskGraphScheduling::critical_path
+                        : acorn::TaskGraphScheduling::fifo;
+  acorn::TaskGraph graph{4, scheduling};
+  auto work = [] { std::this_thread::sleep_for(std::chrono::milliseconds{1}); };
+  std::vector<acorn::TaskGraph::BaseTask> tasks;
+  std::vector<acorn::TaskGraph::BaseTask> chain;
+
+  for (ACORN_MAYBE_UNUSED auto&& _ : state) {
+    tasks.clear();
+    chain.clear();
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    auto gate = graph.submit([released] { released.wait(); });
+    for (int64_t i = 0; i < NumLeaves; ++i) {
+      tasks.push_back(graph.submit(work, gate));
+    }
+    chain.push_back(graph.submit(work, gate));
+    for (int64_t i = 1; i < ChainLength; ++i) {
+      chain.push_back(graph.submit(work, chain.back()));
+    }
+    tasks.push_back(chain.back());
+    release.set_value();
+    graph.submit([] {}, tasks).future.wait();
+  }
+}
+BENCHMARK(LeavesAndChain)->Arg(0)->Arg(1)->UseRealTime();
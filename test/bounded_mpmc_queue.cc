@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gtest/gtest.h"
+
+#include "acorn/container/bounded_mpmc_queue.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+TEST(BoundedMpmcQueue, PushAndPopInOrder) {
+  acorn::BoundedMpmcQueue<int> queue{8};
+  EXPECT_TRUE(queue.empty());
+  EXPECT_EQ(0u, queue.size());
+
+  for (int i = 0; i < 5; ++i) {
+    ASSERT_TRUE(queue.try_push(int{i}));
+  }
+  EXPECT_FALSE(queue.empty());
+  EXPECT_EQ(5u, queue.size());
+
+  for (int i = 0; i < 5; ++i) {
+    int value = -1;
+    ASSERT_TRUE(queue.try_pop(value));
+    EXPECT_EQ(i, value);
+  }
+  EXPECT_TRUE(queue.empty());
+  EXPECT_EQ(0u, queue.size());
+}
+
+TEST(BoundedMpmcQueue, PushFailsWhenFull) {
+  acorn::BoundedMpmcQueue<int> queue{4};
+  EXPECT_EQ(4u, queue.capacity());
+
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(queue.try_push(int{i}));
+  }
+  EXPECT_TRUE(queue.full());
+  EXPECT_FALSE(queue.try_push(4));
+
+  int value = -1;
+  ASSERT_TRUE(queue.try_pop(value));
+  EXPECT_EQ(0, value);
+  EXPECT_FALSE(queue.full());
+  EXPECT_TRUE(queue.try_push(4));
+}
+
+TEST(BoundedMpmcQueue, PopFailsWhenEmpty) {
+  acorn::BoundedMpmcQueue<int> queue{4};
+  int value = -1;
+  EXPECT_FALSE(queue.try_pop(value));
+  EXPECT_EQ(-1, value);
+}
+
+TEST(BoundedMpmcQueue, FailedPushDoesNotMoveValue) {
+  acorn::BoundedMpmcQueue<std::unique_ptr<int>> queue{2};
+  ASSERT_TRUE(queue.try_push(std::make_unique<int>(1)));
+  ASSERT_TRUE(queue.try_push(std::make_unique<int>(2)));
+
+  auto value = std::make_unique<int>(3);
+  EXPECT_FALSE(queue.try_push(std::move(value)));
+  ASSERT_NE(nullptr, value);
+  EXPECT_EQ(3, *value);
+}
+
+TEST(BoundedMpmcQueue, WrapsAroundManyLaps) {
+  acorn::BoundedMpmcQueue<size_t> queue{4};
+  for (size_t i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(queue.try_push(size_t{i}));
+    size_t value = 0;
+    ASSERT_TRUE(queue.try_pop(value));
+    EXPECT_EQ(i, value);
+  }
+}
+
+TEST(BoundedMpmcQueue, ConcurrentProducersAndConsumers) {
+  constexpr size_t n_producers = 4;
+  constexpr size_t n_consumers = 4;
+  constexpr size_t n_per_producer = 10000;
+  acorn::BoundedMpmcQueue<size_t> queue{64};
+
+  std::vector<std::thread> threads;
+  for (size_t p = 0; p < n_producers; ++p) {
+    threads.emplace_back([&queue, p] {
+      for (size_t i = 0; i < n_per_producer; ++i) {
+        size_t value = p * n_per_producer + i;
+        while (!queue.try_push(std::move(value))) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  std::vector<std::vector<size_t>> popped(n_consumers);
+  std::atomic<size_t> n_popped{0};
+  for (size_t c = 0; c < n_consumers; ++c) {
+    threads.emplace_back([&, c] {
+      size_t value;
+      while (n_popped.load() < n_producers * n_per_producer) {
+        if (queue.try_pop(value)) {
+          popped[c].push_back(value);
+          n_popped++;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Every value is popped exactly once, and values from a single producer are
+  // popped in the order they were pushed.
+  std::vector<int> seen(n_producers * n_per_producer, 0);
+  for (auto const& values : popped) {
+    std::vector<size_t> last(n_producers, 0);
+    std::vector<bool> any(n_producers, false);
+    for (auto value : values) {
+      seen[value]++;
+      size_t producer = value / n_per_producer;
+      if (any[producer]) {
+        EXPECT_LT(last[producer], value);
+      }
+      any[producer] = true;
+      last[producer] = value;
+    }
+  }
+  for (auto count : seen) {
+    ASSERT_EQ(1, count);
+  }
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gtest/gtest.h"
+
+#include "acorn/macros.h"
+#include "acorn/threads/coroutine.h"
+#include "acorn/threads/shared_thread_pool.h"
+#include "acorn/threads/taskgraph.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if ACORN_HAS_COROUTINES
+
+namespace {
+
+acorn::task<int> answer() { co_return 42; }
+
+acorn::task<int> add_answers() {
+  int first = co_await answer();
+  int second = co_await answer();
+  co_return first + second;
+}
+
+acorn::task<void> throws() {
+  throw std::runtime_error{"failed"};
+  co_return;
+}
+
+template <typename Pool>
+acorn::task<std::thread::id> hop_to(Pool& pool) {
+  co_await pool.schedule();
+  co_return std::this_thread::get_id();
+}
+
+}  // namespace
+
+TEST(Coroutine, TaskIsLazy) {
+  bool started = false;
+  auto make = [&started]() -> acorn::task<void> {
+    started = true;
+    co_return;
+  };
+  {
+    auto unstarted = make();
+    EXPECT_FALSE(started);
+  }
+  EXPECT_FALSE(started);
+  acorn::spawn(make()).get();
+  EXPECT_TRUE(started);
+}
+
+TEST(Coroutine, AwaitingTasks) {
+  EXPECT_EQ(84, acorn::spawn(add_answers()).get());
+}
+
+TEST(Coroutine, ExceptionsPropagate) {
+  auto rethrows = []() -> acorn::task<void> { co_await throws(); };
+  EXPECT_THROW(acorn::spawn(rethrows()).get(), std::runtime_error);
+}
+
+TEST(Coroutine, ScheduleHopsOntoWorker) {
+  acorn::SharedThreadPool pool{2};
+  auto worker = acorn::spawn(hop_to(pool)).get();
+  EXPECT_NE(std::this_thread::get_id(), worker);
+}
+
+TEST(Coroutine, AwaitingFutureResumesWhenReady) {
+  acorn::SharedThreadPool pool{1};
+  acorn::Promise<int> promise;
+  auto future = promise.get_future();
+  auto waits = [](acorn::Future<int>& future) -> acorn::task<int> {
+    co_return co_await future + 1;
+  };
+  auto result = acorn::spawn(waits(future));
+  EXPECT_FALSE(result.is_ready());
+  pool.execute([&promise] { promise.set_value(1); });
+  EXPECT_EQ(2, result.get());
+}
+
+TEST(Coroutine, ManyCoroutinesOnFewThreads) {
+  acorn::SharedThreadPool pool{2};
+  constexpr int NumCoroutines = 1000;
+  std::atomic<int> n_done{0};
+  auto work = [](acorn::SharedThreadPool& pool,
+                 std::atomic<int>& n_done) -> acorn::task<void> {
+    co_await pool.schedule();
+    auto inner = pool.submit([] { return 1; });
+    n_done += co_await inner;
+  };
+  std::vector<acorn::Future<void>> futures;
+  for (int i = 0; i < NumCoroutines; ++i) {
+    futures.push_back(acorn::spawn(work(pool, n_done)));
+  }
+  for (auto& future : futures) {
+    future.get();
+  }
+  EXPECT_EQ(NumCoroutines, n_done.load());
+}
+
+TEST(Coroutine, AwaitTaskGraphTask) {
+  acorn::TaskGraph graph{2};
+  auto first = graph.submit([] {
+    std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    return 20;
+  });
+  auto second = graph.submit([] { return 22; }, first);
+  auto waits = [](acorn::TaskGraph::Task<int>& first,
+                  acorn::TaskGraph::Task<int>& second)
+      -> acorn::task<std::thread::id> {
+    int sum = co_await first;
+    sum += co_await second;
+    EXPECT_EQ(42, sum);
+    co_return std::this_thread::get_id();
+  };
+  auto resumed_on = acorn::spawn(waits(first, second)).get();
+  EXPECT_NE(std::this_thread::get_id(), resumed_on);
+}
+
+#endif  // ACORN_HAS_COROUTINES
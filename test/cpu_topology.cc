@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gtest/gtest.h"
+
+#include "acorn/threads/cpu_topology.h"
+
+#include <algorithm>
+#include <thread>
+
+TEST(CpuTopology, ParseCpuList) {
+  EXPECT_EQ((acorn::CpuSet{0, 1, 2, 3, 8, 10, 11}),
+            acorn::parse_cpu_list("0-3,8,10-11\n"));
+  EXPECT_EQ((acorn::CpuSet{5}), acorn::parse_cpu_list("5"));
+  EXPECT_EQ((acorn::CpuSet{1, 2, 3}), acorn::parse_cpu_list("3,1-2"));
+  EXPECT_TRUE(acorn::parse_cpu_list("").empty());
+}
+
+TEST(CpuTopology, ParseMalformedCpuList) {
+  EXPECT_TRUE(acorn::parse_cpu_list("a-b").empty());
+  EXPECT_TRUE(acorn::parse_cpu_list("3-1").empty());
+  EXPECT_TRUE(acorn::parse_cpu_list("1-").empty());
+}
+
+TEST(CpuTopology, DiscoverCoversAvailableCpus) {
+  auto topology = acorn::CpuTopology::discover();
+  ASSERT_FALSE(topology.nodes.empty());
+  for (auto const& node : topology.nodes) {
+    EXPECT_FALSE(node.empty());
+  }
+  EXPECT_EQ(acorn::available_cpus(), topology.cpus());
+}
+
+TEST(CpuTopology, Affinities) {
+  acorn::CpuTopology topology{{{0, 1}, {2, 3, 4}}};
+  auto per_cpu = acorn::per_cpu_affinity(topology);
+  ASSERT_EQ(5u, per_cpu.size());
+  for (unsigned cpu = 0; cpu < 5; ++cpu) {
+    EXPECT_EQ(acorn::CpuSet{cpu}, per_cpu[cpu]);
+  }
+  EXPECT_EQ(topology.nodes, acorn::per_node_affinity(topology));
+}
+
+TEST(CpuTopology, PinCurrentThread) {
+  auto cpus = acorn::available_cpus();
+  ASSERT_FALSE(cpus.empty());
+  std::thread thread{[&cpus] {
+    ASSERT_TRUE(acorn::pin_current_thread({cpus.back()}));
+    EXPECT_EQ(acorn::CpuSet{cpus.back()}, acorn::available_cpus());
+    EXPECT_EQ(static_cast<int>(cpus.back()), acorn::current_cpu());
+  }};
+  thread.join();
+}
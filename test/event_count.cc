@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gtest/gtest.h"
+
+#include "acorn/threads/event_count.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST(EventCount, NotifyWithoutWaitersIsNoOp) {
+  acorn::EventCount event;
+  event.notify();
+  event.notify(10);
+  event.notify_all();
+}
+
+TEST(EventCount, CancelledWaitDoesNotSleep) {
+  acorn::EventCount event;
+  auto key = event.prepare_wait();
+  (void)key;
+  event.cancel_wait();
+}
+
+TEST(EventCount, NotifyBetweenPrepareAndCommitIsNotLost) {
+  acorn::EventCount event;
+  auto key = event.prepare_wait();
+  event.notify();
+  // The epoch has moved on, so this returns straight away.
+  event.commit_wait(key);
+}
+
+TEST(EventCount, WakesWaitingThreads) {
+  constexpr int n_threads = 4;
+  constexpr int n_rounds = 1000;
+  acorn::EventCount event;
+  std::atomic<int> available{0};
+  std::atomic<int> taken{0};
+
+  auto consumer = [&] {
+    while (taken.load() < n_threads * n_rounds) {
+      int value = available.load();
+      if (value > 0 && available.compare_exchange_weak(value, value - 1)) {
+        taken++;
+        continue;
+      }
+      auto key = event.prepare_wait();
+      if (available.load() > 0 || taken.load() >= n_threads * n_rounds) {
+        event.cancel_wait();
+        continue;
+      }
+      event.commit_wait(key);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int count = 0; count < n_threads; ++count) {
+    threads.emplace_back(consumer);
+  }
+  for (int round = 0; round < n_threads * n_rounds; ++round) {
+    available++;
+    event.notify();
+  }
+  while (taken.load() < n_threads * n_rounds) {
+    std::this_thread::yield();
+  }
+  event.notify_all();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(0, available.load());
+}
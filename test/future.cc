@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gtest/gtest.h"
+
+#include "acorn/threads/future.h"
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+TEST(Future, DefaultIsInvalid) {
+  acorn::Future<int> future;
+  EXPECT_FALSE(future.valid());
+}
+
+TEST(Future, SetValueBeforeGet) {
+  acorn::Promise<int> promise;
+  auto future = promise.get_future();
+  ASSERT_TRUE(future.valid());
+  EXPECT_FALSE(future.is_ready());
+  promise.set_value(5);
+  EXPECT_TRUE(future.is_ready());
+  EXPECT_EQ(5, future.get());
+  EXPECT_FALSE(future.valid());
+}
+
+TEST(Future, GetWaitsForValue) {
+  acorn::Promise<std::unique_ptr<int>> promise;
+  auto future = promise.get_future();
+  std::thread thread{[&promise] {
+    std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    promise.set_value(new int{7});
+  }};
+  auto value = future.get();
+  thread.join();
+  ASSERT_NE(nullptr, value);
+  EXPECT_EQ(7, *value);
+}
+
+TEST(Future, VoidFuture) {
+  acorn::Promise<void> promise;
+  auto future = promise.get_future();
+  promise.set_value();
+  future.wait();
+  EXPECT_TRUE(future.is_ready());
+  future.get();
+}
+
+TEST(Future, ExceptionIsRethrown) {
+  acorn::Promise<int> promise;
+  auto future = promise.get_future();
+  promise.set_exception(
+      std::make_exception_ptr(std::runtime_error{"failed"}));
+  EXPECT_THROW(future.get(), std::runtime_error);
+}
+
+TEST(Future, BrokenPromise) {
+  acorn::Future<int> future;
+  {
+    acorn::Promise<int> promise;
+    future = promise.get_future();
+  }
+  ASSERT_TRUE(future.is_ready());
+  try {
+    future.get();
+    FAIL() << "Expected a broken promise.";
+  } catch (std::future_error const& error) {
+    EXPECT_EQ(std::future_errc::broken_promise, error.code());
+  }
+}
+
+TEST(Future, WaitForTimesOut) {
+  acorn::Promise<int> promise;
+  auto future = promise.get_future();
+  EXPECT_EQ(std::future_status::timeout,
+            future.wait_for(std::chrono::milliseconds{5}));
+  promise.set_value(1);
+  EXPECT_EQ(std::future_status::ready,
+            future.wait_for(std::chrono::milliseconds{5}));
+}
+
+TEST(Future, FulfilPromise) {
+  acorn::Promise<int> promise;
+  auto future = promise.get_future();
+  auto func = [] { return 3; };
+  acorn::fulfil_promise(promise, func);
+  EXPECT_EQ(3, future.get());
+
+  acorn::Promise<void> void_promise;
+  auto void_future = void_promise.get_future();
+  auto throwing = [] { throw std::runtime_error{"failed"}; };
+  acorn::fulfil_promise(void_promise, throwing);
+  EXPECT_THROW(void_future.get(), std::runtime_error);
+}
+
+TEST(Future, ContinuationRunsWhenReady) {
+  acorn::Promise<int> promise;
+  auto future = promise.get_future();
+  bool ran = false;
+  EXPECT_TRUE(future.add_continuation([&ran] { ran = true; }));
+  EXPECT_FALSE(ran);
+  promise.set_value(1);
+  EXPECT_TRUE(ran);
+  EXPECT_FALSE(future.add_continuation([] {}));
+  EXPECT_EQ(1, future.get());
+}
+
+TEST(Future, ThenChainsValues) {
+  acorn::Promise<int> promise;
+  auto future = promise.get_future()
+                    .then([](int value) { return value * 2; })
+                    .then([](int value) { return std::to_string(value); });
+  EXPECT_FALSE(future.is_ready());
+  promise.set_value(21);
+  ASSERT_TRUE(future.is_ready());
+  EXPECT_EQ("42", future.get());
+}
+
+TEST(Future, ThenOnReadyFutureRunsInline) {
+  acorn::Promise<void> promise;
+  auto future = promise.get_future();
+  promise.set_value();
+  bool ran = false;
+  auto chained = future.then([&ran] { ran = true; });
+  EXPECT_FALSE(future.valid());
+  EXPECT_TRUE(ran);
+  chained.get();
+}
+
+TEST(Future, ThenSkipsContinuationOnException) {
+  acorn::Promise<int> promise;
+  bool ran = false;
+  auto future = promise.get_future().then([&ran](int value) {
+    ran = true;
+    return value;
+  });
+  promise.set_exception(std::make_exception_ptr(std::runtime_error{"failed"}));
+  EXPECT_THROW(future.get(), std::runtime_error);
+  EXPECT_FALSE(ran);
+
+  acorn::Promise<int> other;
+  auto throwing = other.get_future().then(
+      [](int) -> int { throw std::logic_error{"failed"}; });
+  other.set_value(1);
+  EXPECT_THROW(throwing.get(), std::logic_error);
+}
+
+namespace {
+
+/** Executor holding tasks until they are run by the test. */
+struct ManualExecutor {
+  void execute(acorn::UniqueTask&& task) { tasks.push_back(std::move(task)); }
+
+  void run_all() {
+    auto pending = std::move(tasks);
+    tasks.clear();
+    for (auto& task : pending) {
+      task();
+    }
+  }
+
+  std::vector<acorn::UniqueTask> tasks;
+};
+
+}  // namespace
+
+TEST(Future, ThenOnExecutorQueuesContinuation) {
+  ManualExecutor executor;
+  acorn::Promise<int> promise;
+  auto future =
+      promise.get_future().then(executor, [](int value) { return value + 1; });
+  promise.set_value(1);
+  EXPECT_EQ(1u, executor.tasks.size());
+  EXPECT_FALSE(future.is_ready());
+  executor.run_all();
+  EXPECT_EQ(2, future.get());
+}
+
+TEST(Future, WhenAllOfVector) {
+  std::vector<acorn::Promise<int>> promises(3);
+  std::vector<acorn::Future<int>> futures;
+  for (auto& promise : promises) {
+    futures.push_back(promise.get_future());
+  }
+  auto all = acorn::when_all(futures.begin(), futures.end());
+  promises[2].set_value(2);
+  promises[0].set_value(0);
+  EXPECT_FALSE(all.is_ready());
+  promises[1].set_exception(
+      std::make_exception_ptr(std::runtime_error{"failed"}));
+  ASSERT_TRUE(all.is_ready());
+  auto ready = all.get();
+  ASSERT_EQ(3u, ready.size());
+  EXPECT_EQ(0, ready[0].get());
+  EXPECT_THROW(ready[1].get(), std::runtime_error);
+  EXPECT_EQ(2, ready[2].get());
+}
+
+TEST(Future, WhenAllOfNothingIsReady) {
+  std::vector<acorn::Future<int>> futures;
+  auto all = acorn::when_all(futures.begin(), futures.end());
+  EXPECT_TRUE(all.is_ready());
+  EXPECT_TRUE(all.get().empty());
+}
+
+TEST(Future, WhenAllOfTuple) {
+  acorn::Promise<int> first;
+  acorn::Promise<void> second;
+  auto all = acorn::when_all(first.get_future(), second.get_future());
+  second.set_value();
+  EXPECT_FALSE(all.is_ready());
+  first.set_value(5);
+  auto ready = all.get();
+  EXPECT_EQ(5, std::get<0>(ready).get());
+  std::get<1>(ready).get();
+}
+
+TEST(Future, WhenAnyOfVector) {
+  std::vector<acorn::Promise<int>> promises(3);
+  std::vector<acorn::Future<int>> futures;
+  for (auto& promise : promises) {
+    futures.push_back(promise.get_future());
+  }
+  auto any = acorn::when_any(futures.begin(), futures.end());
+  EXPECT_FALSE(any.is_ready());
+  promises[1].set_value(1);
+  ASSERT_TRUE(any.is_ready());
+  promises[0].set_value(0);
+  auto result = any.get();
+  EXPECT_EQ(1u, result.index);
+  ASSERT_EQ(3u, result.futures.size());
+  EXPECT_EQ(1, result.futures[1].get());
+  EXPECT_FALSE(result.futures[2].is_ready());
+}
+
+TEST(Future, WhenAnyOfTuple) {
+  acorn::Promise<int> first;
+  acorn::Promise<std::string> second;
+  second.set_value("ready");
+  auto any = acorn::when_any(first.get_future(), second.get_future());
+  ASSERT_TRUE(any.is_ready());
+  auto result = any.get();
+  EXPECT_EQ(1u, result.index);
+  EXPECT_EQ("ready", std::get<1>(result.futures).get());
+}
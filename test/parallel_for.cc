@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gtest/gtest.h"
+
+#include "acorn/threads/parallel_for.h"
+#include "acorn/threads/shared_thread_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(ParallelFor, VisitsEveryIndexOnce) {
+  acorn::SharedThreadPool pool{4};
+
+  constexpr int n_values = 10000;
+  std::vector<std::atomic<int>> visits(n_values);
+  acorn::parallel_for(pool, 0, n_values, 7,
+                      [&](int index) { visits[index]++; });
+
+  for (auto& count : visits) {
+    ASSERT_EQ(1, count.load());
+  }
+}
+
+TEST(ParallelFor, DefaultGrain) {
+  acorn::SharedThreadPool pool{3};
+
+  std::vector<size_t> data(1000, 0);
+  acorn::parallel_for(pool, size_t{0}, data.size(),
+                      [&](size_t index) { data[index] = index * 2; });
+
+  for (size_t index = 0; index < data.size(); ++index) {
+    ASSERT_EQ(index * 2, data[index]);
+  }
+}
+
+TEST(ParallelFor, EmptyAndSingleChunkRanges) {
+  acorn::SharedThreadPool pool{2};
+
+  int calls = 0;
+  acorn::parallel_for(pool, 5, 5, [&](int) { calls++; });
+  acorn::parallel_for(pool, 5, 3, [&](int) { calls++; });
+  EXPECT_EQ(0, calls);
+
+  // A single chunk runs entirely on the calling thread.
+  auto caller = std::this_thread::get_id();
+  acorn::parallel_for(pool, 0, 10, 100, [&](int) {
+    EXPECT_EQ(caller, std::this_thread::get_id());
+    calls++;
+  });
+  EXPECT_EQ(10, calls);
+}
+
+TEST(ParallelFor, SkewedWorkIsBalanced) {
+  acorn::SharedThreadPool pool{4};
+
+  // The first few indices are much slower than the rest, so a static split of
+  // the range would leave most threads idle.
+  std::atomic<int> sum{0};
+  acorn::parallel_for(pool, 0, 400, 1, [&](int index) {
+    if (index < 4) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    }
+    sum += index;
+  });
+  EXPECT_EQ(399 * 400 / 2, sum.load());
+}
+
+TEST(ParallelFor, RethrowsException) {
+  acorn::SharedThreadPool pool{2};
+
+  std::atomic<int> calls{0};
+  EXPECT_THROW(acorn::parallel_for(pool, 0, 100, 1,
+                                   [&](int index) {
+                                     calls++;
+                                     if (index == 50) {
+                                       throw std::runtime_error{"failed"};
+                                     }
+                                   }),
+               std::runtime_error);
+  // The remaining chunks are still run.
+  EXPECT_EQ(100, calls.load());
+}
+
+TEST(ParallelFor, NestedInsidePoolTask) {
+  acorn::SharedThreadPool pool{1};
+
+  // The only worker is busy running the outer task, so the nested loop must be
+  // run by the calling thread.
+  auto future = pool.add_task([&pool] {
+    std::atomic<int> sum{0};
+    acorn::parallel_for(pool, 0, 100, 3, [&](int index) { sum += index; });
+    return sum.load();
+  });
+  auto status = future.wait_for(std::chrono::seconds{5});
+  ASSERT_EQ(std::future_status::ready, status);
+  EXPECT_EQ(99 * 100 / 2, future.get());
+}
+
+TEST(ParallelReduce, Sum) {
+  acorn::SharedThreadPool pool{4};
+
+  auto sum = acorn::parallel_reduce(
+      pool, int64_t{0}, int64_t{100000}, int64_t{0},
+      [](int64_t index) { return index; },
+      [](int64_t lhs, int64_t rhs) { return lhs + rhs; });
+  EXPECT_EQ(int64_t{99999} * 100000 / 2, sum);
+}
+
+TEST(ParallelReduce, CombinesInOrder) {
+  acorn::SharedThreadPool pool{4};
+
+  // String concatenation is associative but not commutative.
+  auto result = acorn::parallel_reduce(
+      pool, 0, 26, 2, std::string{},
+      [](int index) { return std::string(1, static_cast<char>('a' + index)); },
+      [](std::string lhs, std::string const& rhs) { return lhs + rhs; });
+  EXPECT_EQ("abcdefghijklmnopqrstuvwxyz", result);
+}
+
+TEST(ParallelReduce, EmptyRangeGivesIdentity) {
+  acorn::SharedThreadPool pool{2};
+
+  auto result = acorn::parallel_reduce(
+      pool, 0, 0, 42, [](int) { return 1; },
+      [](int lhs, int rhs) { return lhs + rhs; });
+  EXPECT_EQ(42, result);
+}
@@ -33,12 +33,31 @@
 
 #include "acorn/threads/shared_thread_pool.h"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
 
-TEST(ThreadPool, BasicCaptures) {
+template <typename Pool>
+class ThreadPool : public ::testing::Test {};
+
+using PoolTypes = ::testing::Types<acorn::SharedThreadPool,
+                                   acorn::LockFreeSharedThreadPool<>,
+                                   acorn::NumaSharedThreadPool>;
+TYPED_TEST_SUITE(ThreadPool, PoolTypes);
+
+TYPED_TEST(ThreadPool, BasicCaptures) {
   int data1 = 0;
   int data2 = 0;
-  acorn::SharedThreadPool pool{1};
+  TypeParam pool{1};
 
   auto future1 = pool.add_task([&] { data1 = 1; });
   auto future2 = pool.add_task([&] { data2 = 2; });
@@ -59,8 +78,8 @@ TEST(ThreadPool, BasicCaptures) {
   EXPECT_EQ(3, data1);
 }
 
-TEST(ThreadPool, FutureReturnsType) {
-  acorn::SharedThreadPool pool{1};
+TYPED_TEST(ThreadPool, FutureReturnsType) {
+  TypeParam pool{1};
 
   auto future1 = pool.add_task([] { return 100u; });
   auto future2 = pool.add_task([] { return "Hello"; });
@@ -90,8 +109,8 @@ TEST(ThreadPool, FutureReturnsType) {
   EXPECT_EQ(0.0, data3);
 }
 
-TEST(ThreadPool, LotsOfSmallTasks) {
-  acorn::SharedThreadPool pool{2};
+TYPED_TEST(ThreadPool, LotsOfSmallTasks) {
+  TypeParam pool{2};
 
   constexpr int data_size = 1024;
   std::vector<int> data(data_size, 0);
@@ -109,8 +128,8 @@ TEST(ThreadPool, LotsOfSmallTasks) {
   }
 }
 
-TEST(ThreadPool, SequentialLargerTasks) {
-  acorn::SharedThreadPool pool{2};
+TYPED_TEST(ThreadPool, SequentialLargerTasks) {
+  TypeParam pool{2};
 
   constexpr int n_tasks = 48;
   std::array<std::future<int>, n_tasks> futures{};
@@ -130,8 +149,8 @@ TEST(ThreadPool, SequentialLargerTasks) {
   }
 }
 
-TEST(ThreadPool, ParallelEnqueue) {
-  acorn::SharedThreadPool pool{2};
+TYPED_TEST(ThreadPool, ParallelEnqueue) {
+  TypeParam pool{2};
 
   auto enqueue_and_test = [&pool] {
     constexpr int n_tasks = 48;
@@ -162,8 +181,8 @@ TEST(ThreadPool, ParallelEnqueue) {
   thread5.join();
 }
 
-TEST(ThreadPool, StdFunctionAliveOutOfScope) {
-  acorn::SharedThreadPool pool{1};
+TYPED_TEST(ThreadPool, StdFunctionAliveOutOfScope) {
+  TypeParam pool{1};
 
   auto enqueue = [&pool](int retval) {
     std::function<int()> func1 = [retval] { return retval; };
@@ -183,10 +202,10 @@ TEST(ThreadPool, StdFunctionAliveOutOfScope) {
   EXPECT_EQ(2, data2);
 }
 
-TEST(ThreadPool, PoolDestructorWaits) {
+TYPED_TEST(ThreadPool, PoolDestructorWaits) {
   std::future<int> future;
   {
-    acorn::SharedThreadPool pool{1};
+    TypeParam pool{1};
     future = pool.add_task([] {
       std::this_thread::sleep_for(std::chrono::milliseconds{25});
       return 10;
@@ -197,3 +216,1086 @@ TEST(ThreadPool, PoolDestructorWaits) {
   auto data = future.get();
   EXPECT_EQ(10, data);
 }
+
+TEST(LockFreeThreadPool, SubmitBlocksWhileQueueIsFull) {
+  acorn::LockFreeSharedThreadPool<2> pool{1};
+
+  constexpr int n_tasks = 64;
+  std::vector<std::future<int>> futures(n_tasks);
+
+  for (int count = 0; count < n_tasks; ++count) {
+    futures[count] = pool.add_task([count] { return count; });
+  }
+
+  for (int count = 0; count < n_tasks; ++count) {
+    auto status = futures[count].wait_for(std::chrono::milliseconds{500});
+    ASSERT_EQ(std::future_status::ready, status);
+    EXPECT_EQ(count, futures[count].get());
+  }
+}
+
+TYPED_TEST(ThreadPool, ExecuteRunsTasks) {
+  constexpr int n_tasks = 256;
+  std::atomic<int> count{0};
+  {
+    TypeParam pool{2};
+    for (int i = 0; i < n_tasks; ++i) {
+      pool.execute([&count] { count++; });
+    }
+  }
+  EXPECT_EQ(n_tasks, count.load());
+}
+
+TYPED_TEST(ThreadPool, ExecuteDiscardsReturnValue) {
+  std::promise<int> promise;
+  auto future = promise.get_future();
+  {
+    TypeParam pool{1};
+    pool.execute([&promise] {
+      promise.set_value(4);
+      return 10;
+    });
+  }
+  auto status = future.wait_for(std::chrono::milliseconds{0});
+  ASSERT_EQ(std::future_status::ready, status);
+  EXPECT_EQ(4, future.get());
+}
+
+TYPED_TEST(ThreadPool, ExecuteExceptionsGoToErrorHandler) {
+  std::atomic<int> n_errors{0};
+  std::atomic<int> n_runs{0};
+  {
+    TypeParam pool{2, [&n_errors](std::exception_ptr error) {
+                     try {
+                       std::rethrow_exception(error);
+                     } catch (std::runtime_error const&) {
+                       n_errors++;
+                     }
+                   }};
+    for (int i = 0; i < 10; ++i) {
+      pool.execute([&n_runs, i] {
+        n_runs++;
+        if (i % 2 == 0) {
+          throw std::runtime_error{"task failed"};
+        }
+      });
+    }
+  }
+  EXPECT_EQ(10, n_runs.load());
+  EXPECT_EQ(5, n_errors.load());
+}
+
+TYPED_TEST(ThreadPool, AddTaskExceptionsGoToFuture) {
+  std::atomic<bool> handler_called{false};
+  TypeParam pool{1, [&handler_called](std::exception_ptr) {
+                   handler_called = true;
+                 }};
+  auto future =
+      pool.add_task([]() -> int { throw std::runtime_error{"oops"}; });
+  auto status = future.wait_for(std::chrono::seconds{1});
+  ASSERT_EQ(std::future_status::ready, status);
+  EXPECT_THROW(future.get(), std::runtime_error);
+  EXPECT_FALSE(handler_called.load());
+}
+
+TYPED_TEST(ThreadPool, AddTasksInBulk) {
+  TypeParam pool{2};
+
+  constexpr int n_tasks = 500;
+  std::vector<std::function<int()>> funcs;
+  for (int count = 0; count < n_tasks; ++count) {
+    funcs.emplace_back([count] { return count; });
+  }
+
+  auto futures = pool.add_tasks(funcs.begin(), funcs.end());
+  ASSERT_EQ(static_cast<size_t>(n_tasks), futures.size());
+  for (int count = 0; count < n_tasks; ++count) {
+    auto status = futures[count].wait_for(std::chrono::milliseconds{500});
+    ASSERT_EQ(std::future_status::ready, status);
+    EXPECT_EQ(count, futures[count].get());
+  }
+}
+
+TYPED_TEST(ThreadPool, AddTasksFromSpan) {
+  TypeParam pool{2};
+
+  auto make_task = [](int value) { return [value] { return value * 2; }; };
+  std::vector<decltype(make_task(0))> funcs;
+  for (int count = 0; count < 10; ++count) {
+    funcs.push_back(make_task(count));
+  }
+
+  auto futures = pool.add_tasks(absl::MakeSpan(funcs));
+  ASSERT_EQ(10u, futures.size());
+  for (int count = 0; count < 10; ++count) {
+    EXPECT_EQ(count * 2, futures[count].get());
+  }
+}
+
+TYPED_TEST(ThreadPool, ExecuteTasksInBulk) {
+  constexpr int n_tasks = 2000;
+  std::atomic<int> count{0};
+  {
+    TypeParam pool{4};
+    std::vector<std::function<void()>> funcs1(n_tasks, [&count] { count++; });
+    std::vector<std::function<void()>> funcs2(n_tasks, [&count] { count++; });
+    pool.execute_tasks(funcs1.begin(), funcs1.end());
+    pool.execute_tasks(absl::MakeSpan(funcs2));
+  }
+  EXPECT_EQ(2 * n_tasks, count.load());
+}
+
+TYPED_TEST(ThreadPool, SpinThenParkIdlePolicy) {
+  acorn::PoolOptions options;
+  options.idle_policy = acorn::IdlePolicy::spin_then_park();
+  TypeParam pool{2, options};
+
+  for (int round = 0; round < 3; ++round) {
+    auto future = pool.add_task([round] { return round; });
+    auto status = future.wait_for(std::chrono::seconds{1});
+    ASSERT_EQ(std::future_status::ready, status);
+    EXPECT_EQ(round, future.get());
+    // Give the workers time to go through spinning and yielding to parking.
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+  }
+}
+
+TYPED_TEST(ThreadPool, WorkersArePinned) {
+  auto cpus = acorn::available_cpus();
+  ASSERT_FALSE(cpus.empty());
+  acorn::CpuSet pinned{cpus.front()};
+  acorn::PoolOptions options;
+  options.worker_affinity = {pinned};
+  TypeParam pool{2, options};
+
+  auto future1 = pool.add_task([] { return acorn::available_cpus(); });
+  auto future2 = pool.add_task([] { return acorn::available_cpus(); });
+  EXPECT_EQ(pinned, future1.get());
+  EXPECT_EQ(pinned, future2.get());
+}
+
+TYPED_TEST(ThreadPool, PerNodeAffinity) {
+  acorn::PoolOptions options;
+  options.worker_affinity =
+      acorn::per_node_affinity(acorn::CpuTopology::discover());
+  TypeParam pool{4, options};
+
+  std::atomic<int> count{0};
+  std::vector<std::future<void>> futures;
+  for (int i = 0; i < 100; ++i) {
+    futures.push_back(pool.add_task([&count] { count++; }));
+  }
+  for (auto& future : futures) {
+    future.wait();
+  }
+  EXPECT_EQ(100, count.load());
+}
+
+TEST(NumaTaskQueue, ShutdownSignalsComeAfterQueuedTasks) {
+  auto cpus = acorn::available_cpus();
+  acorn::CpuTopology topology{{cpus, {1u << 20}}};
+  acorn::NumaTaskQueue queue{topology};
+
+  int data = 0;
+  queue.push(acorn::PoolTask{});
+  queue.push(acorn::PoolTask{[&data] { data = 1; }});
+  EXPECT_FALSE(queue.empty());
+
+  acorn::PoolTask task;
+  ASSERT_TRUE(queue.try_pop(task));
+  ASSERT_TRUE(static_cast<bool>(task));
+  task();
+  EXPECT_EQ(1, data);
+
+  ASSERT_TRUE(queue.try_pop(task));
+  EXPECT_FALSE(static_cast<bool>(task));
+  EXPECT_TRUE(queue.empty());
+  EXPECT_FALSE(queue.try_pop(task));
+}
+
+template <typename Queue>
+static void check_try_pop_task_leaves_shutdown_signals(Queue& queue) {
+  queue.push(acorn::PoolTask{});
+  EXPECT_TRUE(queue.empty());
+  acorn::PoolTask task;
+  EXPECT_FALSE(queue.try_pop_task(task));
+
+  queue.push(acorn::PoolTask{[] {}});
+  EXPECT_FALSE(queue.empty());
+  ASSERT_TRUE(queue.try_pop_task(task));
+  EXPECT_TRUE(static_cast<bool>(task));
+  EXPECT_FALSE(queue.try_pop_task(task));
+
+  ASSERT_TRUE(queue.try_pop(task));
+  EXPECT_FALSE(static_cast<bool>(task));
+  EXPECT_FALSE(queue.try_pop(task));
+}
+
+/** Check that try_pop_bulk takes a fair share of tasks and no signals. */
+template <typename Queue>
+static void check_try_pop_bulk_takes_fair_share(Queue& queue) {
+  for (int i = 0; i < 8; ++i) {
+    queue.push(acorn::PoolTask{[] {}});
+  }
+  queue.push(acorn::PoolTask{});
+  std::deque<acorn::PoolTask> tasks;
+  EXPECT_EQ(3u, queue.try_pop_bulk(tasks, 3, 1));
+  EXPECT_EQ(2u, queue.try_pop_bulk(tasks, 8, 4));
+  EXPECT_EQ(3u, queue.try_pop_bulk(tasks, 8, 1));
+  EXPECT_EQ(0u, queue.try_pop_bulk(tasks, 8, 1));
+  ASSERT_EQ(8u, tasks.size());
+  for (auto& task : tasks) {
+    EXPECT_TRUE(static_cast<bool>(task));
+  }
+
+  acorn::PoolTask task;
+  ASSERT_TRUE(queue.try_pop(task));
+  EXPECT_FALSE(static_cast<bool>(task));
+}
+
+TEST(TaskQueue, TryPopBulkTakesFairShare) {
+  acorn::PoolOptions options;
+  acorn::LockedTaskQueue locked{options};
+  check_try_pop_bulk_takes_fair_share(locked);
+  acorn::LockFreeTaskQueue<> lock_free{options};
+  check_try_pop_bulk_takes_fair_share(lock_free);
+  acorn::NumaTaskQueue numa{options};
+  check_try_pop_bulk_takes_fair_share(numa);
+}
+
+TEST(TaskQueue, TryPopTaskLeavesShutdownSignals) {
+  acorn::PoolOptions options;
+  acorn::LockedTaskQueue locked{options};
+  check_try_pop_task_leaves_shutdown_signals(locked);
+  acorn::LockFreeTaskQueue<> lock_free{options};
+  check_try_pop_task_leaves_shutdown_signals(lock_free);
+  acorn::NumaTaskQueue numa{options};
+  check_try_pop_task_leaves_shutdown_signals(numa);
+}
+
+/** Start a task which holds a single-worker pool's worker until released. */
+template <typename Pool>
+static std::promise<void> block_worker(Pool& pool) {
+  std::promise<void> release;
+  std::promise<void> started;
+  auto released = release.get_future().share();
+  pool.execute([released, &started] {
+    started.set_value();
+    released.wait();
+  });
+  started.get_future().wait();
+  return release;
+}
+
+TEST(PrioritySharedThreadPool, HigherLanesDrainFirst) {
+  acorn::PoolOptions options;
+  options.priority_aging = std::chrono::hours{1};
+  acorn::SharedThreadPool pool{1, options};
+  std::vector<int> order;
+
+  auto release = block_worker(pool);
+  pool.execute(acorn::TaskPriority::background, [&] { order.push_back(3); });
+  pool.execute(acorn::TaskPriority::normal, [&] { order.push_back(2); });
+  pool.execute([&] { order.push_back(2); });
+  auto last = pool.add_task(acorn::TaskPriority::high,
+                            [&] { order.push_back(1); });
+  release.set_value();
+  last.wait();
+  auto done = pool.add_task(acorn::TaskPriority::background, [] {});
+  done.wait();
+
+  EXPECT_EQ((std::vector<int>{1, 2, 2, 3}), order);
+}
+
+TEST(PrioritySharedThreadPool, AgingPreventsStarvation) {
+  acorn::PoolOptions options;
+  options.priority_aging = std::chrono::milliseconds{1};
+  acorn::SharedThreadPool pool{1, options};
+  std::vector<int> order;
+
+  auto release = block_worker(pool);
+  pool.execute(acorn::TaskPriority::background, [&] { order.push_back(3); });
+  std::this_thread::sleep_for(std::chrono::milliseconds{5});
+  pool.execute(acorn::TaskPriority::high, [&] { order.push_back(1); });
+  release.set_value();
+  auto done = pool.add_task(acorn::TaskPriority::background, [] {});
+  done.wait();
+
+  EXPECT_EQ((std::vector<int>{3, 1}), order);
+}
+
+TEST(PrioritySharedThreadPool, AgedBacklogDoesNotStarveHighLane) {
+  constexpr int NumBackground = 20;
+  acorn::PoolOptions options;
+  options.priority_aging = std::chrono::milliseconds{1};
+  acorn::SharedThreadPool pool{1, options};
+  std::vector<int> order;
+
+  auto release = block_worker(pool);
+  for (int i = 0; i < NumBackground; ++i) {
+    pool.execute(acorn::TaskPriority::background, [&] { order.push_back(3); });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds{5});
+  pool.execute(acorn::TaskPriority::high, [&] { order.push_back(1); });
+  pool.execute(acorn::TaskPriority::high, [&] { order.push_back(1); });
+  release.set_value();
+  auto done = pool.add_task(acorn::TaskPriority::background, [] {});
+  done.wait();
+
+  ASSERT_EQ(NumBackground + 2u, order.size());
+  auto first_high = std::find(order.begin(), order.end(), 1) - order.begin();
+  auto last_high = std::find(order.rbegin(), order.rend(), 1) - order.rbegin();
+  EXPECT_LT(first_high, acorn::PriorityAgingInterval);
+  EXPECT_LT(order.size() - 1 - last_high, 2 * acorn::PriorityAgingInterval);
+}
+
+TEST(PrioritySharedThreadPool, LaneStats) {
+  acorn::SharedThreadPool pool{1};
+
+  auto release = block_worker(pool);
+  auto future1 = pool.add_task(acorn::TaskPriority::background, [] {});
+  auto future2 = pool.add_task(acorn::TaskPriority::background, [] {});
+  auto stats = pool.lane_stats(acorn::TaskPriority::background);
+  EXPECT_EQ(2u, stats.depth);
+  EXPECT_EQ(0u, stats.n_dequeued);
+  EXPECT_EQ(0u, pool.lane_stats(acorn::TaskPriority::high).depth);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds{5});
+  release.set_value();
+  future1.wait();
+  future2.wait();
+  stats = pool.lane_stats(acorn::TaskPriority::background);
+  EXPECT_EQ(0u, stats.depth);
+  EXPECT_EQ(2u, stats.n_dequeued);
+  EXPECT_EQ(2u, stats.n_timed);
+  EXPECT_GE(stats.max_wait, std::chrono::milliseconds{5});
+  EXPECT_GE(stats.mean_wait(), std::chrono::milliseconds{5});
+  EXPECT_LE(stats.mean_wait(), stats.max_wait);
+}
+
+TEST(PrioritySharedThreadPool, NormalLaneIsOnlyTimedOncePrioritiesAreUsed) {
+  acorn::SharedThreadPool pool{1};
+  pool.add_task([] {}).wait();
+  auto stats = pool.lane_stats(acorn::TaskPriority::normal);
+  EXPECT_EQ(1u, stats.n_dequeued);
+  EXPECT_EQ(0u, stats.n_timed);
+
+  auto release = block_worker(pool);
+  auto normal = pool.add_task([] {});
+  auto high = pool.add_task(acorn::TaskPriority::high, [] {});
+  release.set_value();
+  high.wait();
+  normal.wait();
+  pool.add_task([] {}).wait();
+  stats = pool.lane_stats(acorn::TaskPriority::normal);
+  EXPECT_EQ(4u, stats.n_dequeued);
+  // The blocking task was taken before the high priority task started timing.
+  EXPECT_EQ(2u, stats.n_timed);
+}
+
+TEST(PrioritySharedThreadPool, PoolDestructorRunsAllLanes) {
+  std::atomic<int> count{0};
+  {
+    acorn::PoolOptions options;
+    options.priority_aging = std::chrono::nanoseconds{0};
+    acorn::SharedThreadPool pool{2, options};
+    for (int i = 0; i < 100; ++i) {
+      pool.execute(acorn::TaskPriority::background, [&count] { count++; });
+      pool.execute(acorn::TaskPriority::high, [&count] { count++; });
+    }
+  }
+  EXPECT_EQ(200, count.load());
+}
+
+TYPED_TEST(ThreadPool, SnapshotOnlyEnabledWithPoolStats) {
+  TypeParam pool{1};
+  pool.add_task([] {}).wait();
+  auto snapshot = pool.snapshot();
+#ifdef ACORN_POOL_STATS
+  EXPECT_TRUE(snapshot.enabled);
+  EXPECT_EQ(1u, snapshot.workers.size());
+#else
+  EXPECT_FALSE(snapshot.enabled);
+  EXPECT_TRUE(snapshot.workers.empty());
+#endif
+}
+
+/** Count down latch, where every thread blocks until all have arrived. */
+struct Barrier {
+  explicit Barrier(int n_threads) : remaining{n_threads} {}
+
+  void arrive_and_wait() {
+    remaining--;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+    while (remaining.load() > 0 &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::microseconds{100});
+    }
+  }
+
+  std::atomic<int> remaining;
+};
+
+/** Wait up to ten seconds for the pool to reach the given size. */
+template <typename Pool>
+static bool wait_for_size(Pool& pool, size_t size) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+  while (pool.size() != size && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+  return pool.size() == size;
+}
+
+TYPED_TEST(ThreadPool, ResizeGrowsAndShrinks) {
+  TypeParam pool{1};
+  pool.resize(4);
+  EXPECT_EQ(4u, pool.size());
+
+  // All four tasks can only finish if they run on four separate workers.
+  Barrier barrier{4};
+  std::vector<std::future<void>> futures;
+  for (int i = 0; i < 4; ++i) {
+    futures.push_back(pool.add_task([&barrier] { barrier.arrive_and_wait(); }));
+  }
+  for (auto& future : futures) {
+    future.get();
+  }
+  EXPECT_EQ(0, barrier.remaining.load());
+
+  pool.resize(2);
+  EXPECT_EQ(2u, pool.size());
+  EXPECT_EQ(5, pool.add_task([] { return 5; }).get());
+  pool.resize(3);
+  EXPECT_EQ(3u, pool.size());
+  EXPECT_EQ(6, pool.add_task([] { return 6; }).get());
+}
+
+TYPED_TEST(ThreadPool, ResizeDoesNotDrainQueue) {
+  TypeParam pool{2};
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  for (int i = 0; i < 2; ++i) {
+    pool.execute([released] { released.wait(); });
+  }
+  std::atomic<int> count{0};
+  for (int i = 0; i < 10; ++i) {
+    pool.execute([&count] { count++; });
+  }
+
+  pool.resize(1);
+  EXPECT_EQ(1u, pool.size());
+  EXPECT_EQ(0, count.load());
+  release.set_value();
+  pool.add_task([] {}).wait();
+  EXPECT_EQ(10, count.load());
+}
+
+TYPED_TEST(ThreadPool, ElasticPoolGrowsAndShrinks) {
+  acorn::PoolOptions options;
+  options.max_threads = 3;
+  options.grow_after = std::chrono::milliseconds{1};
+  options.idle_timeout = std::chrono::milliseconds{20};
+  TypeParam pool{1, options};
+
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+  while (pool.size() < 3 && std::chrono::steady_clock::now() < deadline) {
+    pool.execute([released] { released.wait(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds{5});
+  }
+  EXPECT_EQ(3u, pool.size());
+  for (int i = 0; i < 5; ++i) {
+    pool.execute([] {});
+    std::this_thread::sleep_for(std::chrono::milliseconds{5});
+  }
+  EXPECT_EQ(3u, pool.size());
+
+  release.set_value();
+  EXPECT_TRUE(wait_for_size(pool, 1));
+  EXPECT_EQ(7, pool.add_task([] { return 7; }).get());
+}
+
+TYPED_TEST(ThreadPool, ElasticPoolScalesFromZero) {
+  acorn::PoolOptions options;
+  options.max_threads = 2;
+  options.idle_timeout = std::chrono::milliseconds{5};
+  TypeParam pool{0, options};
+  EXPECT_EQ(0u, pool.size());
+
+  EXPECT_EQ(1, pool.add_task([] { return 1; }).get());
+  EXPECT_TRUE(wait_for_size(pool, 0));
+  EXPECT_EQ(2, pool.add_task([] { return 2; }).get());
+}
+
+TYPED_TEST(ThreadPool, ElasticPoolFromZeroShutsDownWhileSubmitting) {
+  // Workers retire as soon as they idle, so shutdown races the last worker
+  // leaving and then staying for a newly submitted task.
+  acorn::PoolOptions options;
+  options.max_threads = 2;
+  options.idle_timeout = std::chrono::microseconds{1};
+  for (int round = 0; round < 200; ++round) {
+    TypeParam pool{0, options};
+    std::atomic<bool> stop{false};
+    std::thread submitter{[&pool, &stop] {
+      while (!stop) {
+        pool.execute([] {});
+        std::this_thread::yield();
+      }
+    }};
+    std::this_thread::sleep_for(std::chrono::microseconds{round * 5});
+    pool.shutdown();
+    stop = true;
+    submitter.join();
+  }
+}
+
+TYPED_TEST(ThreadPool, SubmitReturnsFuture) {
+  TypeParam pool{2};
+  auto future = pool.submit([] { return 42; });
+  EXPECT_EQ(42, future.get());
+
+  auto failing = pool.submit([] { throw std::runtime_error{"failed"}; });
+  EXPECT_THROW(failing.get(), std::runtime_error);
+}
+
+/** Recursive Fibonacci where every call waits on tasks it submitted. */
+template <typename Pool>
+static int nested_fibonacci(Pool& pool, int n) {
+  if (n < 2) {
+    return n;
+  }
+  auto first =
+      pool.submit([&pool, n] { return nested_fibonacci(pool, n - 1); });
+  auto second =
+      pool.submit([&pool, n] { return nested_fibonacci(pool, n - 2); });
+  return first.get() + second.get();
+}
+
+TYPED_TEST(ThreadPool, WaitingOnWorkerRunsQueuedTasks) {
+  // With one worker, waiting on a nested task would deadlock if the worker
+  // blocked instead of running the queued tasks itself.
+  TypeParam pool{1};
+  auto future = pool.submit([&pool] { return nested_fibonacci(pool, 12); });
+  ASSERT_EQ(std::future_status::ready,
+            future.wait_for(std::chrono::seconds{30}));
+  EXPECT_EQ(144, future.get());
+}
+
+TYPED_TEST(ThreadPool, WaitingWorkersWakeForNewTasks) {
+  TypeParam pool{2};
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  acorn::Promise<int> inner;
+  auto inner_future = inner.get_future();
+  // Both workers end up waiting, with nothing queued, until a new task is
+  // submitted from outside the pool.
+  auto outer1 = pool.submit([&inner_future] { return inner_future.get(); });
+  auto outer2 = pool.submit([released] {
+    released.wait();
+    return 1;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds{5});
+  auto helper = pool.submit([&inner] { inner.set_value(2); });
+  release.set_value();
+  EXPECT_EQ(2, outer1.get());
+  EXPECT_EQ(1, outer2.get());
+  helper.get();
+}
+
+TYPED_TEST(ThreadPool, PoolDestructorWithWaitingWorkers) {
+  acorn::Future<int> future;
+  {
+    TypeParam pool{2};
+    future = pool.submit([&pool] { return nested_fibonacci(pool, 10); });
+  }
+  ASSERT_TRUE(future.is_ready());
+  EXPECT_EQ(55, future.get());
+}
+
+TYPED_TEST(ThreadPool, AddTaskAfterRunsOnWorker) {
+  TypeParam pool{2};
+  std::promise<std::thread::id> ran_on;
+  auto start = std::chrono::steady_clock::now();
+  pool.add_task_after(std::chrono::milliseconds{10}, [&ran_on] {
+    ran_on.set_value(std::this_thread::get_id());
+  });
+  auto future = ran_on.get_future();
+  ASSERT_EQ(std::future_status::ready,
+            future.wait_for(std::chrono::seconds{10}));
+  EXPECT_NE(std::this_thread::get_id(), future.get());
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds{10});
+}
+
+TYPED_TEST(ThreadPool, CancelledDelayedTaskDoesNotRun) {
+  TypeParam pool{2};
+  std::atomic<bool> cancelled_ran{false};
+  std::promise<void> other_ran;
+  auto handle = pool.add_task_at(
+      std::chrono::steady_clock::now() + std::chrono::milliseconds{5},
+      [&cancelled_ran] { cancelled_ran = true; });
+  pool.add_task_after(std::chrono::milliseconds{20},
+                      [&other_ran] { other_ran.set_value(); });
+  EXPECT_TRUE(handle.cancel());
+  other_ran.get_future().wait();
+  EXPECT_FALSE(cancelled_ran);
+}
+
+TYPED_TEST(ThreadPool, PeriodicTaskRunsUntilCancelled) {
+  TypeParam pool{2};
+  std::atomic<int> n_runs{0};
+  auto handle =
+      pool.add_periodic(std::chrono::milliseconds{1}, [&n_runs] { ++n_runs; });
+  while (n_runs < 3) {
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+  EXPECT_TRUE(handle.cancel());
+  // A run already in progress when the timer is cancelled still finishes.
+  std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  auto runs = n_runs.load();
+  std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  EXPECT_EQ(runs, n_runs.load());
+}
+
+TYPED_TEST(ThreadPool, PoolDestructorDropsPendingTimers) {
+  std::atomic<bool> ran{false};
+  acorn::TimerHandle handle;
+  {
+    TypeParam pool{1};
+    handle = pool.add_task_after(std::chrono::seconds{10},
+                                 [&ran] { ran = true; });
+  }
+  EXPECT_FALSE(ran);
+  EXPECT_FALSE(handle.cancel());
+}
+
+TYPED_TEST(ThreadPool, ThenQueuesContinuationOnPool) {
+  TypeParam pool{2};
+  acorn::Promise<int> promise;
+  auto future = promise.get_future().then(pool, [](int value) {
+    return std::make_pair(value + 1, std::this_thread::get_id());
+  });
+  promise.set_value(1);
+  auto result = future.get();
+  EXPECT_EQ(2, result.first);
+  EXPECT_NE(std::this_thread::get_id(), result.second);
+}
+
+TYPED_TEST(ThreadPool, PipelineOfSubmittedTasks) {
+  TypeParam pool{2};
+  std::vector<acorn::Future<int>> stages;
+  for (int i = 0; i < 8; ++i) {
+    stages.push_back(pool.submit([i] { return i; }).then(pool, [](int value) {
+      return value * value;
+    }));
+  }
+  auto total = acorn::when_all(stages.begin(), stages.end())
+                   .then([](std::vector<acorn::Future<int>> ready) {
+                     int sum = 0;
+                     for (auto& stage : ready) {
+                       sum += stage.get();
+                     }
+                     return sum;
+                   });
+  EXPECT_EQ(140, total.get());
+}
+
+/** Whether @p future holds the error for a task dropped without running. */
+template <typename Future>
+static bool is_cancelled(Future& future) {
+  try {
+    future.get();
+  } catch (acorn::TaskCancelled const&) {
+    return true;
+  } catch (...) {
+  }
+  return false;
+}
+
+TYPED_TEST(ThreadPool, DiscardShutdownDropsQueuedTasks) {
+  TypeParam pool{1};
+  std::atomic<int> n_runs{0};
+  auto release = block_worker(pool);
+  auto submitted = pool.submit([&n_runs] { return ++n_runs; });
+  auto added = pool.add_task([&n_runs] { return ++n_runs; });
+  pool.execute([&n_runs] { ++n_runs; });
+
+  std::thread stopper{[&pool] { pool.shutdown(acorn::ShutdownMode::discard); }};
+  // Give the shutdown time to start before the blocked task finishes.
+  std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  release.set_value();
+  stopper.join();
+
+  EXPECT_EQ(0, n_runs.load());
+  EXPECT_TRUE(is_cancelled(submitted));
+  EXPECT_TRUE(is_cancelled(added));
+}
+
+TEST(SharedThreadPool, DiscardShutdownCancelsEveryKindOfTask) {
+  acorn::SharedThreadPool pool{1};
+  auto release = block_worker(pool);
+  std::vector<std::function<int()>> funcs(2, [] { return 1; });
+  auto batch = pool.add_tasks(absl::MakeSpan(funcs));
+  auto prioritised = pool.add_task(acorn::TaskPriority::high, [] {});
+
+  std::thread stopper{[&pool] { pool.shutdown(acorn::ShutdownMode::discard); }};
+  std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  release.set_value();
+  stopper.join();
+
+  for (auto& future : batch) {
+    EXPECT_TRUE(is_cancelled(future));
+  }
+  EXPECT_TRUE(is_cancelled(prioritised));
+}
+
+TYPED_TEST(ThreadPool, DrainShutdownRunsQueuedTasks) {
+  TypeParam pool{1};
+  auto release = block_worker(pool);
+  auto submitted = pool.submit([] { return 1; });
+  std::thread stopper{[&pool] { pool.shutdown(); }};
+  std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  release.set_value();
+  stopper.join();
+  EXPECT_EQ(1, submitted.get());
+}
+
+TYPED_TEST(ThreadPool, DestructorUsesShutdownMode) {
+  acorn::PoolOptions options;
+  options.shutdown_mode = acorn::ShutdownMode::discard;
+  acorn::Future<int> submitted;
+  std::promise<void> release;
+  std::thread releaser;
+  {
+    TypeParam pool{1, options};
+    release = block_worker(pool);
+    submitted = pool.submit([] { return 1; });
+    releaser = std::thread{[&release] {
+      std::this_thread::sleep_for(std::chrono::milliseconds{10});
+      release.set_value();
+    }};
+  }
+  releaser.join();
+  EXPECT_TRUE(is_cancelled(submitted));
+}
+
+TYPED_TEST(ThreadPool, TasksAddedAfterShutdownAreRefused) {
+  TypeParam pool{1};
+  pool.shutdown();
+  std::atomic<int> n_runs{0};
+  auto submitted = pool.submit([&n_runs] { return ++n_runs; });
+  auto added = pool.add_task([&n_runs] { return ++n_runs; });
+  pool.execute([&n_runs] { ++n_runs; });
+  std::vector<std::function<int()>> funcs(2, [&n_runs] { return ++n_runs; });
+  auto batch = pool.add_tasks(absl::MakeSpan(funcs));
+  pool.shutdown();
+
+  EXPECT_TRUE(is_cancelled(submitted));
+  EXPECT_TRUE(is_cancelled(added));
+  for (auto& future : batch) {
+    EXPECT_TRUE(is_cancelled(future));
+  }
+  EXPECT_EQ(0, n_runs.load());
+  EXPECT_EQ(5u, pool.n_rejected());
+}
+
+TYPED_TEST(ThreadPool, DrainRunsTasksWaitedOnDuringShutdown) {
+  TypeParam pool{1};
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  auto parent = pool.submit([&pool, released] {
+    released.wait();
+    // The pool is shutting down by now, but its own tasks can still add work.
+    return pool.submit([] { return 1; }).get() + 1;
+  });
+  std::thread stopper{[&pool] { pool.shutdown(); }};
+  std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  release.set_value();
+  stopper.join();
+  EXPECT_EQ(2, parent.get());
+}
+
+TYPED_TEST(ThreadPool, CancelledTasksAreSkipped) {
+  TypeParam pool{1};
+  acorn::CancellationToken request;
+  std::atomic<int> n_runs{0};
+  auto release = block_worker(pool);
+  auto submitted = pool.submit(request, [&n_runs] { return ++n_runs; });
+  auto added = pool.add_task(request, [&n_runs] { return ++n_runs; });
+  pool.execute(request, [&n_runs] { ++n_runs; });
+  auto other = pool.submit(acorn::CancellationToken{}, [] { return 2; });
+  request.cancel();
+  release.set_value();
+
+  EXPECT_EQ(2, other.get());
+  EXPECT_TRUE(is_cancelled(submitted));
+  EXPECT_TRUE(is_cancelled(added));
+  EXPECT_EQ(0, n_runs.load());
+}
+
+TYPED_TEST(ThreadPool, RunningTasksSeeCancellation) {
+  TypeParam pool{1};
+  acorn::CancellationToken token;
+  std::promise<void> started;
+  auto future = pool.submit(token, [token, &started] {
+    started.set_value();
+    int spins = 0;
+    while (!token.is_cancelled()) {
+      ++spins;
+      std::this_thread::yield();
+    }
+    return spins >= 0;
+  });
+  started.get_future().wait();
+  token.cancel();
+  EXPECT_TRUE(future.get());
+}
+
+static acorn::PoolOptions run_next_options() {
+  acorn::PoolOptions options;
+  options.run_next = true;
+  return options;
+}
+
+TYPED_TEST(ThreadPool, RunNextRunsFollowUpOnSameWorker) {
+  TypeParam pool{2, run_next_options()};
+  TypeParam other_pool{1, run_next_options()};
+  // With no idle worker to steal the slot, the follow-up waits for its parent.
+  auto release = block_worker(pool);
+  for (int round = 0; round < 20; ++round) {
+    auto parent = pool.submit([&pool, &other_pool] {
+      auto child = pool.submit([] { return std::this_thread::get_id(); });
+      // Tasks for another pool must still run on that pool's workers.
+      auto other = other_pool.submit([] { return std::this_thread::get_id(); });
+      return std::make_tuple(std::this_thread::get_id(), std::move(child),
+                             std::move(other));
+    });
+    auto result = parent.get();
+    EXPECT_EQ(std::get<0>(result), std::get<1>(result).get());
+    EXPECT_NE(std::get<0>(result), std::get<2>(result).get());
+  }
+  release.set_value();
+}
+
+TYPED_TEST(ThreadPool, RunNextSlotIsStolenByIdleWorker) {
+  TypeParam pool{2, run_next_options()};
+  for (int round = 0; round < 20; ++round) {
+    auto parent = pool.submit([&pool] {
+      auto ran = std::make_shared<std::promise<void>>();
+      auto ran_future = ran->get_future();
+      pool.execute([ran] { ran->set_value(); });
+      // The child is in this worker's slot, so only the idle worker can run
+      // it while this one is blocked.
+      return ran_future.wait_for(std::chrono::seconds{10}) ==
+             std::future_status::ready;
+    });
+    EXPECT_TRUE(parent.get());
+  }
+}
+
+TYPED_TEST(ThreadPool, RunNextSlotIsLastInFirstOut) {
+  TypeParam pool{1, run_next_options()};
+  std::vector<int> order;
+  std::promise<void> done;
+  pool.execute([&pool, &order, &done] {
+    // The second task takes the slot, moving the first to the shared queue.
+    pool.execute([&order, &done] {
+      order.push_back(1);
+      done.set_value();
+    });
+    pool.execute([&order] { order.push_back(2); });
+  });
+  done.get_future().wait();
+  EXPECT_EQ((std::vector<int>{2, 1}), order);
+}
+
+TYPED_TEST(ThreadPool, RunNextChainsDoNotStarveQueue) {
+  TypeParam pool{1, run_next_options()};
+  std::atomic<bool> stop{false};
+  std::atomic<int> n_links{0};
+  std::promise<void> started;
+  std::function<void()> link = [&] {
+    if (n_links++ == 0) {
+      started.set_value();
+    }
+    if (!stop) {
+      pool.execute(link);
+    }
+  };
+  pool.execute(link);
+  started.get_future().wait();
+  auto stopper = pool.submit([&stop] { stop = true; });
+  ASSERT_EQ(std::future_status::ready,
+            stopper.wait_for(std::chrono::seconds{10}));
+  pool.shutdown();
+  EXPECT_GT(n_links.load(), 0);
+}
+
+TYPED_TEST(ThreadPool, RunNextWaitingOnNestedTasks) {
+  // Waiting workers must run the task in their own slot when there is no
+  // other worker to steal it.
+  TypeParam pool{1, run_next_options()};
+  auto future = pool.submit([&pool] { return nested_fibonacci(pool, 12); });
+  ASSERT_EQ(std::future_status::ready,
+            future.wait_for(std::chrono::seconds{30}));
+  EXPECT_EQ(144, future.get());
+}
+
+static acorn::PoolOptions batched_options() {
+  acorn::PoolOptions options;
+  options.dequeue_batch = 16;
+  return options;
+}
+
+TYPED_TEST(ThreadPool, BatchedDequeueRunsAllTasks) {
+  std::atomic<int> count{0};
+  {
+    TypeParam pool{4, batched_options()};
+    std::vector<std::function<void()>> funcs(1000, [&count] { count++; });
+    pool.execute_tasks(funcs.begin(), funcs.end());
+  }
+  EXPECT_EQ(1000, count.load());
+}
+
+TYPED_TEST(ThreadPool, BatchedTasksAreStolenFromBlockedWorkers) {
+  TypeParam pool{2, batched_options()};
+  for (int round = 0; round < 20; ++round) {
+    // A worker taking both the waiting task and the task it waits for must not
+    // stop the other worker from running it.
+    std::promise<void> ready;
+    auto ready_future = ready.get_future().share();
+    std::vector<std::function<void()>> funcs;
+    funcs.emplace_back([ready_future] { ready_future.wait(); });
+    funcs.emplace_back([&ready] { ready.set_value(); });
+    funcs.emplace_back([] {});
+    funcs.emplace_back([] {});
+    auto futures = pool.add_tasks(funcs.begin(), funcs.end());
+    ASSERT_EQ(std::future_status::ready,
+              futures[0].wait_for(std::chrono::seconds{10}));
+  }
+}
+
+TYPED_TEST(ThreadPool, BatchedWaitingOnNestedTasks) {
+  TypeParam pool{2, batched_options()};
+  auto future = pool.submit([&pool] { return nested_fibonacci(pool, 12); });
+  ASSERT_EQ(std::future_status::ready,
+            future.wait_for(std::chrono::seconds{30}));
+  EXPECT_EQ(144, future.get());
+}
+
+static acorn::PoolOptions bounded_options(acorn::BackpressurePolicy policy) {
+  acorn::PoolOptions options;
+  options.max_queued = 2;
+  options.backpressure = policy;
+  return options;
+}
+
+TYPED_TEST(ThreadPool, TryMethodsFailFastWhenFull) {
+  TypeParam pool{1, bounded_options(acorn::BackpressurePolicy::block)};
+  auto release = block_worker(pool);
+  std::atomic<int> n_runs{0};
+  EXPECT_TRUE(pool.try_execute([&n_runs] { n_runs++; }));
+  auto added = pool.try_add_task([&n_runs] { return ++n_runs; });
+  EXPECT_TRUE(added.valid());
+
+  EXPECT_FALSE(pool.try_execute([&n_runs] { n_runs++; }));
+  EXPECT_FALSE(pool.try_add_task([] { return 0; }).valid());
+  EXPECT_FALSE(pool.try_submit([] { return 0; }).valid());
+  EXPECT_EQ(3u, pool.n_rejected());
+
+  release.set_value();
+  EXPECT_EQ(2, added.get());
+  auto submitted = pool.try_submit([] { return 3; });
+  ASSERT_TRUE(submitted.valid());
+  EXPECT_EQ(3, submitted.get());
+  EXPECT_EQ(2, n_runs.load());
+}
+
+TYPED_TEST(ThreadPool, FullPoolBlocksSubmitter) {
+  TypeParam pool{1, bounded_options(acorn::BackpressurePolicy::block)};
+  auto release = block_worker(pool);
+  pool.execute([] {});
+  pool.execute([] {});
+  std::atomic<bool> added{false};
+  std::thread submitter{[&pool, &added] {
+    pool.execute([] {});
+    added = true;
+  }};
+  std::this_thread::sleep_for(std::chrono::milliseconds{20});
+  EXPECT_FALSE(added.load());
+  release.set_value();
+  submitter.join();
+  EXPECT_TRUE(added.load());
+  EXPECT_EQ(0u, pool.n_rejected());
+}
+
+TYPED_TEST(ThreadPool, BoundedPoolRefusesTasksAfterShutdown) {
+  TypeParam pool{1, bounded_options(acorn::BackpressurePolicy::block)};
+  pool.shutdown();
+  std::atomic<int> n_runs{0};
+  for (int i = 0; i < 5; ++i) {
+    pool.execute([&n_runs] { n_runs++; });
+    auto future = pool.add_task([] { return 1; });
+    ASSERT_EQ(std::future_status::ready,
+              future.wait_for(std::chrono::seconds{0}));
+    EXPECT_THROW(future.get(), acorn::TaskCancelled);
+  }
+  EXPECT_FALSE(pool.try_execute([&n_runs] { n_runs++; }));
+  EXPECT_FALSE(pool.try_add_task([] { return 0; }).valid());
+  EXPECT_FALSE(pool.try_submit([] { return 0; }).valid());
+  EXPECT_EQ(0, n_runs.load());
+  EXPECT_EQ(13u, pool.n_rejected());
+}
+
+TYPED_TEST(ThreadPool, ShutdownWakesBlockedSubmitter) {
+  TypeParam pool{1, bounded_options(acorn::BackpressurePolicy::block)};
+  auto release = block_worker(pool);
+  pool.execute([] {});
+  pool.execute([] {});
+  std::promise<void> added;
+  std::thread submitter{[&pool, &added] {
+    pool.execute([] {});
+    added.set_value();
+  }};
+  std::thread stopper{[&pool] { pool.shutdown(); }};
+  EXPECT_EQ(std::future_status::ready,
+            added.get_future().wait_for(std::chrono::seconds{10}));
+  release.set_value();
+  submitter.join();
+  stopper.join();
+}
+
+TYPED_TEST(ThreadPool, FullPoolRunsTaskOnCaller) {
+  TypeParam pool{1, bounded_options(acorn::BackpressurePolicy::caller_runs)};
+  auto release = block_worker(pool);
+  pool.execute([] {});
+  pool.execute([] {});
+  auto future = pool.add_task([] { return std::this_thread::get_id(); });
+  ASSERT_EQ(std::future_status::ready,
+            future.wait_for(std::chrono::seconds{0}));
+  EXPECT_EQ(std::this_thread::get_id(), future.get());
+  EXPECT_EQ(1u, pool.n_rejected());
+
+  std::vector<std::function<int()>> funcs(4, [] { return 1; });
+  auto futures = pool.add_tasks(funcs.begin(), funcs.end());
+  EXPECT_EQ(5u, pool.n_rejected());
+  release.set_value();
+  for (auto& bulk_future : futures) {
+    EXPECT_EQ(1, bulk_future.get());
+  }
+}
+
+TYPED_TEST(ThreadPool, WorkersQueueOverLimitRatherThanBlock) {
+  TypeParam pool{1, bounded_options(acorn::BackpressurePolicy::block)};
+  auto future = pool.submit([&pool] {
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < 8; ++i) {
+      futures.push_back(pool.add_task([i] { return i; }));
+    }
+    return futures.size();
+  });
+  ASSERT_EQ(std::future_status::ready,
+            future.wait_for(std::chrono::seconds{10}));
+  EXPECT_EQ(8u, future.get());
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gtest/gtest.h"
+
+#include "acorn/threads/pool_stats.h"
+#include "acorn/threads/shared_thread_pool.h"
+
+#include <chrono>
+#include <future>
+#include <thread>
+
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+
+TEST(DurationHistogram, Buckets) {
+  using acorn::DurationHistogram;
+  EXPECT_EQ(0u, DurationHistogram::bucket(nanoseconds{-5}));
+  EXPECT_EQ(0u, DurationHistogram::bucket(nanoseconds{0}));
+  EXPECT_EQ(1u, DurationHistogram::bucket(nanoseconds{1}));
+  EXPECT_EQ(2u, DurationHistogram::bucket(nanoseconds{2}));
+  EXPECT_EQ(2u, DurationHistogram::bucket(nanoseconds{3}));
+  EXPECT_EQ(3u, DurationHistogram::bucket(nanoseconds{4}));
+  EXPECT_EQ(11u, DurationHistogram::bucket(nanoseconds{1024}));
+  EXPECT_EQ(DurationHistogram::NumBuckets - 1,
+            DurationHistogram::bucket(std::chrono::hours{24}));
+  for (size_t index = 1; index < DurationHistogram::NumBuckets - 1; ++index) {
+    auto limit = DurationHistogram::bucket_limit(index);
+    EXPECT_EQ(index, DurationHistogram::bucket(limit - nanoseconds{1}));
+    EXPECT_EQ(index + 1, DurationHistogram::bucket(limit));
+  }
+}
+
+TEST(DurationHistogram, Quantile) {
+  acorn::DurationHistogram histogram;
+  EXPECT_EQ(nanoseconds{0}, histogram.quantile(0.5));
+
+  histogram.counts[acorn::DurationHistogram::bucket(nanoseconds{100})] = 90;
+  histogram.counts[acorn::DurationHistogram::bucket(milliseconds{1})] = 10;
+  EXPECT_EQ(100u, histogram.total());
+  EXPECT_EQ(nanoseconds{128}, histogram.quantile(0.0));
+  EXPECT_EQ(nanoseconds{128}, histogram.quantile(0.5));
+  EXPECT_EQ(nanoseconds{1 << 20}, histogram.quantile(0.95));
+  EXPECT_EQ(nanoseconds{1 << 20}, histogram.quantile(1.0));
+}
+
+/** Wait until the pool has recorded @p n_tasks tasks as finished. */
+template <typename Pool>
+static acorn::PoolStatsSnapshot wait_for_tasks(Pool& pool, uint64_t n_tasks) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+  while (true) {
+    auto snapshot = pool.snapshot();
+    uint64_t n_done = 0;
+    for (auto const& worker : snapshot.workers) {
+      n_done += worker.n_tasks;
+    }
+    if (n_done >= n_tasks || std::chrono::steady_clock::now() > deadline) {
+      return snapshot;
+    }
+    std::this_thread::sleep_for(milliseconds{1});
+  }
+}
+
+template <typename Pool>
+class PoolStats : public ::testing::Test {};
+
+using PoolTypes = ::testing::Types<acorn::SharedThreadPool,
+                                   acorn::LockFreeSharedThreadPool<>,
+                                   acorn::NumaSharedThreadPool>;
+TYPED_TEST_SUITE(PoolStats, PoolTypes);
+
+TYPED_TEST(PoolStats, CountsTasksAndTimes) {
+  TypeParam pool{2};
+  for (int i = 0; i < 10; ++i) {
+    pool.execute([] { std::this_thread::sleep_for(milliseconds{1}); });
+  }
+  auto snapshot = wait_for_tasks(pool, 10);
+
+  ASSERT_TRUE(snapshot.enabled);
+  EXPECT_EQ(10u, snapshot.n_submitted);
+  EXPECT_EQ(0u, snapshot.queue_depth);
+  ASSERT_EQ(2u, snapshot.workers.size());
+  EXPECT_EQ(10u, snapshot.workers[0].n_tasks + snapshot.workers[1].n_tasks);
+  EXPECT_GE(snapshot.workers[0].busy_time + snapshot.workers[1].busy_time,
+            milliseconds{10});
+  EXPECT_EQ(10u, snapshot.queue_wait.total());
+  EXPECT_EQ(10u, snapshot.run_time.total());
+  EXPECT_GE(snapshot.run_time.quantile(0.0), milliseconds{1});
+  EXPECT_GE(snapshot.uptime, milliseconds{5});
+}
+
+TYPED_TEST(PoolStats, QueueDepthAndWait) {
+  TypeParam pool{1};
+  std::promise<void> release;
+  std::promise<void> started;
+  auto released = release.get_future().share();
+  pool.execute([released, &started] {
+    started.set_value();
+    released.wait();
+  });
+  started.get_future().wait();
+  for (int i = 0; i < 3; ++i) {
+    pool.execute([] {});
+  }
+
+  auto snapshot = pool.snapshot();
+  EXPECT_EQ(4u, snapshot.n_submitted);
+  EXPECT_EQ(3u, snapshot.queue_depth);
+
+  std::this_thread::sleep_for(milliseconds{5});
+  release.set_value();
+  snapshot = wait_for_tasks(pool, 4);
+  EXPECT_EQ(0u, snapshot.queue_depth);
+  EXPECT_EQ(4u, snapshot.queue_wait.total());
+  // The three queued tasks waited behind the blocking one.
+  EXPECT_GE(snapshot.queue_wait.quantile(0.5), milliseconds{5});
+}
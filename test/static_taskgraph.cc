@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gtest/gtest.h"
+
+#include "acorn/threads/shared_thread_pool.h"
+#include "acorn/threads/static_taskgraph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+TEST(StaticTaskGraph, EmptyGraphRuns) {
+  acorn::SharedThreadPool pool{1};
+  acorn::StaticTaskGraph graph{pool};
+  graph.run();
+  EXPECT_EQ(graph.size(), 0u);
+}
+
+TEST(StaticTaskGraph, DiamondRunsRepeatedly) {
+  acorn::SharedThreadPool pool{4};
+  acorn::StaticTaskGraph graph{pool};
+
+  std::atomic<int> a_count{0};
+  int b_value = 0;
+  int c_value = 0;
+  int d_value = 0;
+  auto a = graph.add([&] { a_count++; });
+  auto b = graph.add([&] { b_value = a_count.load(); }, a);
+  auto c = graph.add([&] { c_value = a_count.load(); }, a);
+  graph.add([&] { d_value = b_value + c_value; }, b, c);
+  EXPECT_EQ(graph.size(), 4u);
+
+  for (int run = 1; run <= 100; ++run) {
+    graph.run();
+    ASSERT_EQ(a_count.load(), run);
+    ASSERT_EQ(d_value, 2 * run);
+  }
+}
+
+TEST(StaticTaskGraph, RespectsDependencyOrder) {
+  constexpr int NumLayers = 8;
+  constexpr int Width = 16;
+  acorn::SharedThreadPool pool{4};
+  acorn::StaticTaskGraph graph{pool};
+
+  std::atomic<int> clock{0};
+  std::vector<int> finished(NumLayers * Width);
+  std::vector<acorn::StaticTaskGraph::Node> previous;
+  std::vector<acorn::StaticTaskGraph::Node> layer;
+  for (int depth = 0; depth < NumLayers; ++depth) {
+    layer.clear();
+    for (int i = 0; i < Width; ++i) {
+      int index = depth * Width + i;
+      auto* result = &finished[index];
+      auto* first = depth > 0 ? &finished[index - Width] : nullptr;
+      auto* second =
+          depth > 0 ? &finished[(depth - 1) * Width + (i + 1) % Width]
+                    : nullptr;
+      auto task = [&clock, result, first, second] {
+        if (first != nullptr) {
+          EXPECT_GT(*first, 0);
+          EXPECT_GT(*second, 0);
+        }
+        *result = ++clock;
+      };
+      if (depth == 0) {
+        layer.push_back(graph.add(task));
+      } else {
+        layer.push_back(
+            graph.add(task, previous[i], previous[(i + 1) % Width]));
+      }
+    }
+    std::swap(previous, layer);
+  }
+
+  for (int run = 0; run < 20; ++run) {
+    std::fill(finished.begin(), finished.end(), 0);
+    graph.run();
+    for (auto value : finished) {
+      ASSERT_GT(value, 0);
+    }
+  }
+}
+
+TEST(StaticTaskGraph, RethrowsFirstExceptionAfterAllNodesRun) {
+  acorn::SharedThreadPool pool{2};
+  acorn::StaticTaskGraph graph{pool};
+
+  std::atomic<int> count{0};
+  auto a = graph.add([&] {
+    count++;
+    throw std::runtime_error{"failed"};
+  });
+  graph.add([&] { count++; }, a);
+  graph.add([&] { count++; });
+
+  EXPECT_THROW(graph.run(), std::runtime_error);
+  EXPECT_EQ(count.load(), 3);
+  EXPECT_THROW(graph.run(), std::runtime_error);
+  EXPECT_EQ(count.load(), 6);
+}
+
+TEST(StaticTaskGraph, RunFromSingleWorkerHelps) {
+  acorn::SharedThreadPool pool{1};
+  acorn::StaticTaskGraph graph{pool};
+
+  std::atomic<int> count{0};
+  auto a = graph.add([&] { count++; });
+  graph.add([&] { count++; }, a);
+  graph.add([&] { count++; }, a);
+
+  auto future = pool.add_task([&] {
+    for (int run = 0; run < 10; ++run) {
+      graph.run();
+    }
+  });
+  future.get();
+  EXPECT_EQ(count.load(), 30);
+}
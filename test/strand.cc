@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gtest/gtest.h"
+
+#include "acorn/threads/shared_thread_pool.h"
+#include "acorn/threads/strand.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+TEST(Strand, RunsTasksInOrderOneAtATime) {
+  acorn::SharedThreadPool pool{4};
+  std::vector<int> order;
+  std::atomic<int> n_running{0};
+  std::atomic<bool> overlapped{false};
+  {
+    acorn::Strand strand{pool};
+    for (int i = 0; i < 1000; ++i) {
+      strand.execute([&, i] {
+        if (n_running++ != 0) {
+          overlapped = true;
+        }
+        order.push_back(i);
+        n_running--;
+      });
+    }
+  }
+  EXPECT_FALSE(overlapped.load());
+  ASSERT_EQ(1000u, order.size());
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(i, order[i]);
+  }
+}
+
+TEST(Strand, ManyStrandsShareOnePool) {
+  acorn::SharedThreadPool pool{4};
+  constexpr int NumStrands = 500;
+  constexpr int NumTasks = 20;
+  std::vector<std::vector<int>> orders(NumStrands);
+  {
+    std::vector<std::unique_ptr<acorn::Strand>> strands;
+    for (int s = 0; s < NumStrands; ++s) {
+      strands.emplace_back(new acorn::Strand{pool});
+    }
+    for (int i = 0; i < NumTasks; ++i) {
+      for (int s = 0; s < NumStrands; ++s) {
+        auto& order = orders[s];
+        strands[s]->execute([&order, i] { order.push_back(i); });
+      }
+    }
+  }
+  for (auto const& order : orders) {
+    ASSERT_EQ(static_cast<size_t>(NumTasks), order.size());
+    for (int i = 0; i < NumTasks; ++i) {
+      EXPECT_EQ(i, order[i]);
+    }
+  }
+}
+
+TEST(Strand, SubmitReturnsFuture) {
+  acorn::SharedThreadPool pool{2};
+  acorn::Strand strand{pool};
+  auto first = strand.submit([] { return 1; });
+  auto second = strand.submit([] { return std::string{"two"}; });
+  EXPECT_EQ(1, first.get());
+  EXPECT_EQ("two", second.get());
+}
+
+TEST(Strand, TasksCanAddToTheirStrand) {
+  acorn::SharedThreadPool pool{2};
+  acorn::Strand strand{pool};
+  std::vector<int> order;
+  std::promise<void> done;
+  strand.execute([&] {
+    strand.execute([&] {
+      order.push_back(2);
+      done.set_value();
+    });
+    order.push_back(1);
+  });
+  done.get_future().wait();
+  EXPECT_EQ((std::vector<int>{1, 2}), order);
+}
+
+TEST(Strand, ErrorsGoToPoolHandlerAndStrandCarriesOn) {
+  std::atomic<int> n_errors{0};
+  acorn::SharedThreadPool pool{
+      2, [&n_errors](std::exception_ptr) { n_errors++; }};
+  acorn::Strand strand{pool};
+  strand.execute([] { throw std::runtime_error{"Task failed"}; });
+  auto after = strand.submit([] { return 3; });
+  EXPECT_EQ(3, after.get());
+  EXPECT_EQ(1, n_errors.load());
+}
+
+TEST(Strand, LongRunsYieldToOtherWork) {
+  acorn::SharedThreadPool pool{1};
+  std::atomic<bool> stop{false};
+  std::atomic<int> n_runs{0};
+  acorn::Strand strand{pool};
+  for (unsigned i = 0; i < acorn::StrandDrainLimit * 4; ++i) {
+    strand.execute([&] {
+      if (!stop) {
+        n_runs++;
+      }
+    });
+  }
+  // The pool's only worker must get to this task before the strand is done.
+  auto other = pool.submit([&stop] { stop = true; });
+  ASSERT_EQ(std::future_status::ready,
+            other.wait_for(std::chrono::seconds{10}));
+  strand.submit([] {}).wait();
+  EXPECT_LT(n_runs.load(), static_cast<int>(acorn::StrandDrainLimit * 4));
+}
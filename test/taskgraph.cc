@@ -34,7 +34,15 @@
 
 #include "acorn/threads/taskgraph.h"
 
+#include <atomic>
 #include <chrono>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 TEST(TaskGraph, NoDepsSingleExecutor) {
   acorn::TaskGraph graph{1};
@@ -89,3 +97,343 @@ TEST(TaskGraph, TransientDeps) {
 
   EXPECT_EQ(count, 9);
 }
+
+TEST(TaskGraph, DependencyAlreadyComplete) {
+  acorn::TaskGraph graph{2};
+
+  int count = 0;
+  auto a = graph.submit([&] { count++; });
+  a.future.wait();
+  auto b = graph.submit([&] { count *= 10; }, a);
+  b.future.wait();
+
+  EXPECT_EQ(count, 10);
+}
+
+TEST(TaskGraph, DroppedHandlesStillRun) {
+  acorn::TaskGraph graph{2};
+
+  std::atomic<int> count{0};
+  acorn::Future<void> last;
+  {
+    auto a = graph.submit([&] {
+      std::this_thread::sleep_for(std::chrono::milliseconds{10});
+      count++;
+    });
+    auto b = graph.submit([&] { count++; }, a);
+    last = graph.submit([&] { count++; }, b).future;
+  }
+  last.wait();
+
+  EXPECT_EQ(count.load(), 3);
+}
+
+TEST(TaskGraph, WideFanOutAndFanIn) {
+  constexpr int NumLayers = 16;
+  constexpr int Width = 64;
+  acorn::TaskGraph graph{4};
+
+  std::atomic<int> count{0};
+  std::vector<int> finished(NumLayers * Width);
+  std::vector<acorn::TaskGraph::Task<void>> previous;
+  std::vector<acorn::TaskGraph::Task<void>> layer;
+  for (int depth = 0; depth < NumLayers; ++depth) {
+    layer.clear();
+    for (int i = 0; i < Width; ++i) {
+      int index = depth * Width + i;
+      auto* result = &finished[index];
+      if (depth == 0) {
+        layer.push_back(graph.submit([&count, result] { *result = ++count; }));
+        continue;
+      }
+      auto* first = &finished[index - Width];
+      auto* second = &finished[(depth - 1) * Width + (i + 1) % Width];
+      layer.push_back(graph.submit(
+          [&count, result, first, second] {
+            EXPECT_GT(*first, 0);
+            EXPECT_GT(*second, 0);
+            *result = ++count;
+          },
+          previous[i], previous[(i + 1) % Width]));
+    }
+    std::swap(previous, layer);
+  }
+  for (auto&& task : previous) {
+    task.future.wait();
+  }
+
+  EXPECT_EQ(count.load(), NumLayers * Width);
+}
+
+TEST(TaskGraph, SubmitWithRuntimeDeps) {
+  constexpr int NumDeps = 1000;
+  acorn::TaskGraph graph{4};
+
+  std::atomic<int> count{0};
+  std::vector<acorn::TaskGraph::BaseTask> deps;
+  for (int i = 0; i < NumDeps; ++i) {
+    deps.push_back(graph.submit([&] { count++; }));
+  }
+  int seen = 0;
+  auto last = graph.submit([&] { seen = count.load(); }, deps);
+  last.future.wait();
+
+  EXPECT_EQ(seen, NumDeps);
+}
+
+TEST(TaskGraph, JoinWaitsForAllDeps) {
+  constexpr int NumDeps = 100;
+  acorn::TaskGraph graph{4};
+
+  std::atomic<int> count{0};
+  std::vector<acorn::TaskGraph::BaseTask> deps;
+  for (int i = 0; i < NumDeps; ++i) {
+    deps.push_back(graph.submit([&] { count++; }));
+  }
+  auto barrier = graph.join(deps);
+  auto nested = graph.join({&barrier, 1});
+  int seen = 0;
+  auto last = graph.submit([&] { seen = count.load(); }, nested);
+  last.future.wait();
+
+  EXPECT_EQ(seen, NumDeps);
+}
+
+TEST(TaskGraph, JoinWithoutDepsCompletesStraightAway) {
+  acorn::TaskGraph graph{1};
+
+  auto barrier = graph.join({});
+  int count = 0;
+  auto task = graph.submit([&] { count++; }, barrier);
+  task.future.wait();
+
+  EXPECT_EQ(count, 1);
+}
+
+TEST(TaskGraph, FlowPassesResultsToConsumer) {
+  acorn::TaskGraph graph{2};
+
+  auto a = graph.source([] { return 2; });
+  auto b = graph.source([] { return std::string{"x"}; });
+  auto c = graph.submit(
+      [](int count, std::string text) {
+        std::string result;
+        for (int i = 0; i < count; ++i) {
+          result += text;
+        }
+        return result;
+      },
+      std::move(a), std::move(b));
+  auto future = graph.get_future(std::move(c));
+
+  EXPECT_EQ(future.get(), "xx");
+}
+
+namespace {
+/** Counts the copies made of it. */
+struct CopyCounter {
+  explicit CopyCounter(std::atomic<int>& n_copies) : n_copies_{&n_copies} {}
+  CopyCounter(CopyCounter const& other) : n_copies_{other.n_copies_} {
+    ++*n_copies_;
+  }
+  CopyCounter(CopyCounter&& other) noexcept = default;
+
+  std::atomic<int>* n_copies_;
+};
+}  // namespace
+
+TEST(TaskGraph, FlowMovesResultIntoSoleConsumer) {
+  acorn::TaskGraph graph{2};
+
+  std::atomic<int> n_copies{0};
+  auto a = graph.source([&] { return CopyCounter{n_copies}; });
+  auto b = graph.submit([](CopyCounter value) { return value; }, std::move(a));
+  auto c = graph.submit([](CopyCounter value) { return value; }, std::move(b));
+  graph.get_future(std::move(c)).get();
+
+  EXPECT_EQ(n_copies.load(), 0);
+}
+
+TEST(TaskGraph, FlowCopiesResultForSharedInputs) {
+  acorn::TaskGraph graph{2};
+
+  std::atomic<int> n_copies{0};
+  auto a = graph.source([&] { return CopyCounter{n_copies}; });
+  auto b = graph.submit([](CopyCounter const&) { return 1; }, a);
+  auto c = graph.submit([](CopyCounter const&) { return 2; }, a);
+  auto sum = graph.submit([](int x, int y) { return x + y; }, std::move(b),
+                          std::move(c));
+
+  EXPECT_EQ(graph.get_future(std::move(sum)).get(), 3);
+  EXPECT_EQ(n_copies.load(), 2);
+}
+
+TEST(TaskGraph, FlowKeepsResultForLaterConsumers) {
+  acorn::TaskGraph graph{4};
+
+  auto a = graph.source([] { return std::string(64, 'x'); });
+  std::vector<acorn::TaskGraph::Flow<size_t>> sizes;
+  for (int i = 0; i < 32; ++i) {
+    sizes.push_back(
+        graph.submit([](std::string value) { return value.size(); }, a));
+  }
+  graph.get_future(std::move(sizes.front())).wait();
+  auto last = graph.submit([](std::string value) { return value.size(); },
+                           std::move(a));
+
+  for (size_t i = 1; i < sizes.size(); ++i) {
+    EXPECT_EQ(graph.get_future(std::move(sizes[i])).get(), 64u);
+  }
+  EXPECT_EQ(graph.get_future(std::move(last)).get(), 64u);
+}
+
+TEST(TaskGraph, FlowPassesOnExceptions) {
+  acorn::TaskGraph graph{2};
+
+  bool called = false;
+  auto a = graph.source([]() -> int { throw std::runtime_error{"failed"}; });
+  auto b = graph.submit(
+      [&](int value) {
+        called = true;
+        return value;
+      },
+      std::move(a));
+  auto future = graph.get_future(std::move(b));
+
+  EXPECT_THROW(future.get(), std::runtime_error);
+  EXPECT_FALSE(called);
+}
+
+TEST(TaskGraph, FlowOrdersTasksWithoutResults) {
+  acorn::TaskGraph graph{2};
+
+  int count = 0;
+  auto a = graph.source([&] { count++; });
+  auto b = graph.submit([&] { count *= 10; }, a);
+  b.future.wait();
+  graph.get_future(std::move(a)).get();
+
+  EXPECT_EQ(count, 10);
+}
+
+namespace {
+/**
+ * Submit @p n_leaves independent tasks, each costing less than a chained task,
+ * followed by a chain of @p chain_length tasks to a single threaded graph,
+ * held back until all are submitted, and return the order in which they ran.
+ * Leaves are recorded as -1, and chain tasks by their index in the chain.
+ */
+std::vector<int> run_leaves_and_chain(acorn::TaskGraphScheduling scheduling,
+                                      int n_leaves, int chain_length) {
+  acorn::TaskGraph graph{1, scheduling};
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  auto gate = graph.submit([released] { released.wait(); });
+
+  std::mutex mutex;
+  std::vector<int> order;
+  auto record = [&](int value) {
+    std::lock_guard<std::mutex> lock{mutex};
+    order.push_back(value);
+  };
+  std::vector<acorn::TaskGraph::BaseTask> tasks;
+  for (int i = 0; i < n_leaves; ++i) {
+    tasks.push_back(
+        graph.submit(acorn::with_cost(0.5, [&] { record(-1); }), gate));
+  }
+  std::vector<acorn::TaskGraph::BaseTask> chain;
+  chain.push_back(graph.submit([&] { record(0); }, gate));
+  for (int i = 1; i < chain_length; ++i) {
+    chain.push_back(graph.submit([&, i] { record(i); }, chain.back()));
+  }
+  tasks.push_back(chain.back());
+
+  release.set_value();
+  graph.submit([] {}, absl::Span<acorn::TaskGraph::BaseTask const>{tasks})
+      .future.wait();
+  return order;
+}
+}  // namespace
+
+TEST(TaskGraph, CriticalPathRunsLongestChainFirst) {
+  auto order =
+      run_leaves_and_chain(acorn::TaskGraphScheduling::critical_path, 4, 3);
+  std::vector<int> expected{0, 1, 2, -1, -1, -1, -1};
+  EXPECT_EQ(order, expected);
+}
+
+TEST(TaskGraph, CriticalPathUsesCostHints) {
+  acorn::TaskGraph graph{1, acorn::TaskGraphScheduling::critical_path};
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  auto gate = graph.submit([released] { released.wait(); });
+
+  std::vector<char> order;
+  auto cheap = graph.submit([&] { order.push_back('a'); }, gate);
+  auto costly = graph.submit(
+      acorn::with_cost(10, [&] { order.push_back('b'); }), gate);
+  auto middle = graph.submit(
+      acorn::with_cost(5, [&] { order.push_back('c'); }), gate);
+  auto barrier = graph.join(
+      std::vector<acorn::TaskGraph::BaseTask>{cheap, costly, middle});
+  release.set_value();
+  graph.submit([] {}, barrier).future.wait();
+
+  std::vector<char> expected{'b', 'c', 'a'};
+  EXPECT_EQ(order, expected);
+}
+
+TEST(TaskGraph, CriticalPathReranksReadyTasks) {
+  acorn::TaskGraph graph{1, acorn::TaskGraphScheduling::critical_path};
+  std::promise<void> started;
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  auto blocker = graph.submit([&started, released] {
+    started.set_value();
+    released.wait();
+  });
+  started.get_future().wait();
+
+  // Both tasks are ready, and queued behind the blocker, before the chain
+  // depending on the second is submitted and raises its rank above the first.
+  std::vector<char> order;
+  auto first =
+      graph.submit(acorn::with_cost(1.5, [&] { order.push_back('a'); }));
+  auto second = graph.submit([&] { order.push_back('b'); });
+  auto chained = graph.submit([&] { order.push_back('c'); }, second);
+  auto barrier = graph.join(
+      std::vector<acorn::TaskGraph::BaseTask>{blocker, first, chained});
+  release.set_value();
+  graph.submit([] {}, barrier).future.wait();
+
+  std::vector<char> expected{'b', 'a', 'c'};
+  EXPECT_EQ(order, expected);
+}
+
+TEST(TaskGraph, CriticalPathRunsWideGraphs) {
+  constexpr int NumLayers = 16;
+  constexpr int Width = 64;
+  acorn::TaskGraph graph{4, acorn::TaskGraphScheduling::critical_path};
+
+  std::atomic<int> count{0};
+  std::vector<acorn::TaskGraph::BaseTask> previous;
+  std::vector<acorn::TaskGraph::BaseTask> layer;
+  for (int depth = 0; depth < NumLayers; ++depth) {
+    layer.clear();
+    for (int i = 0; i < Width; ++i) {
+      if (depth == 0) {
+        layer.push_back(graph.submit([&] { count++; }));
+      } else {
+        layer.push_back(graph.submit([&] { count++; }, previous[i],
+                                     previous[(i + 1) % Width]));
+      }
+    }
+    std::swap(previous, layer);
+  }
+  auto flow = graph.source([&] { return count.load(); });
+  auto last = graph.submit([](int value) { return value; }, std::move(flow));
+  graph.submit([] {}, previous).future.wait();
+  graph.get_future(std::move(last)).get();
+
+  EXPECT_EQ(count.load(), NumLayers * Width);
+}
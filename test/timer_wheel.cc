@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gtest/gtest.h"
+
+#include "acorn/threads/timer_wheel.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = acorn::TimerWheel::Clock;
+using std::chrono::hours;
+using std::chrono::milliseconds;
+using std::chrono::microseconds;
+using std::chrono::nanoseconds;
+
+/** Runs tasks straight away on the timer thread, recording when they ran. */
+struct InlineRunner {
+  void operator()(acorn::UniqueTask&& task) {
+    task();
+    std::lock_guard<std::mutex> lock{mutex};
+    ++n_runs;
+    ran.notify_all();
+  }
+
+  /** Wait until at least @p count tasks have run. */
+  bool wait_for_runs(int count) {
+    std::unique_lock<std::mutex> lock{mutex};
+    return ran.wait_for(lock, std::chrono::seconds{10},
+                        [&] { return n_runs >= count; });
+  }
+
+  std::mutex mutex;
+  std::condition_variable ran;
+  int n_runs = 0;
+};
+
+}  // namespace
+
+TEST(TimerWheel, RunsAfterDeadline) {
+  InlineRunner runner;
+  acorn::TimerWheel wheel{std::ref(runner)};
+  auto deadline = Clock::now() + milliseconds{20};
+  Clock::time_point ran_at;
+  wheel.schedule(deadline, [&ran_at] { ran_at = Clock::now(); });
+  ASSERT_TRUE(runner.wait_for_runs(1));
+  EXPECT_GE(ran_at, deadline);
+  EXPECT_EQ(0u, wheel.size());
+}
+
+TEST(TimerWheel, SizeCountsWaitingTimers) {
+  InlineRunner runner;
+  acorn::TimerWheel wheel{std::ref(runner)};
+  // Deadlines this far off keep the timers waiting however slow the test.
+  auto deadline = Clock::now() + hours{1};
+  auto handle = wheel.schedule(deadline, [] {});
+  wheel.schedule(deadline, [] {});
+  EXPECT_EQ(2u, wheel.size());
+  EXPECT_TRUE(handle.cancel());
+  EXPECT_EQ(1u, wheel.size());
+}
+
+TEST(TimerWheel, PastDeadlinesRunStraightAway) {
+  InlineRunner runner;
+  acorn::TimerWheel wheel{std::ref(runner)};
+  bool ran = false;
+  wheel.schedule(Clock::now() - milliseconds{5}, [&ran] { ran = true; });
+  ASSERT_TRUE(runner.wait_for_runs(1));
+  EXPECT_TRUE(ran);
+}
+
+TEST(TimerWheel, RunsInDeadlineOrder) {
+  InlineRunner runner;
+  acorn::TimerWheel wheel{std::ref(runner)};
+  std::vector<int> order;
+  auto now = Clock::now();
+  wheel.schedule(now + milliseconds{30}, [&order] { order.push_back(3); });
+  wheel.schedule(now + milliseconds{10}, [&order] { order.push_back(1); });
+  wheel.schedule(now + milliseconds{20}, [&order] { order.push_back(2); });
+  ASSERT_TRUE(runner.wait_for_runs(3));
+  EXPECT_EQ((std::vector<int>{1, 2, 3}), order);
+}
+
+TEST(TimerWheel, CancelledTimersDoNotRun) {
+  InlineRunner runner;
+  acorn::TimerWheel wheel{std::ref(runner)};
+  // Hold the timer thread in a task, so that the timer cannot fire before it
+  // is cancelled however slow the test.
+  std::promise<void> started;
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  wheel.schedule(Clock::now(), [&started, released] {
+    started.set_value();
+    released.wait();
+  });
+  started.get_future().wait();
+
+  bool cancelled_ran = false;
+  auto handle = wheel.schedule(Clock::now(),
+                               [&cancelled_ran] { cancelled_ran = true; });
+  wheel.schedule(Clock::now() + milliseconds{1}, [] {});
+  EXPECT_TRUE(handle.cancel());
+  EXPECT_FALSE(handle.cancel());
+  EXPECT_EQ(1u, wheel.size());
+  release.set_value();
+  ASSERT_TRUE(runner.wait_for_runs(2));
+  EXPECT_FALSE(cancelled_ran);
+  EXPECT_FALSE(handle.cancel());
+}
+
+TEST(TimerWheel, DefaultHandleCancelsNothing) {
+  acorn::TimerHandle handle;
+  EXPECT_FALSE(handle.cancel());
+}
+
+TEST(TimerWheel, PeriodicRunsUntilCancelled) {
+  InlineRunner runner;
+  acorn::TimerWheel wheel{std::ref(runner)};
+  std::atomic<int> n_calls{0};
+  auto handle = wheel.schedule_periodic(Clock::now(), milliseconds{2},
+                                        [&n_calls] { ++n_calls; });
+  ASSERT_TRUE(runner.wait_for_runs(3));
+  EXPECT_TRUE(handle.cancel());
+  auto calls = n_calls.load();
+  std::this_thread::sleep_for(milliseconds{20});
+  EXPECT_EQ(calls, n_calls.load());
+  EXPECT_EQ(0u, wheel.size());
+}
+
+TEST(TimerWheel, TimersOnUpperLevelsRunOnTime) {
+  // With microsecond ticks, these deadlines are held on the second, third and
+  // fourth levels of the wheel before moving down.
+  InlineRunner runner;
+  acorn::TimerWheel wheel{std::ref(runner), microseconds{1}};
+  auto now = Clock::now();
+  std::vector<Clock::time_point> deadlines = {
+      now + microseconds{500}, now + milliseconds{20}, now + milliseconds{300}};
+  std::vector<Clock::time_point> ran_at(deadlines.size());
+  for (size_t i = 0; i < deadlines.size(); ++i) {
+    wheel.schedule(deadlines[i], [&ran_at, i] { ran_at[i] = Clock::now(); });
+  }
+  ASSERT_TRUE(runner.wait_for_runs(3));
+  for (size_t i = 0; i < deadlines.size(); ++i) {
+    EXPECT_GE(ran_at[i], deadlines[i]);
+  }
+}
+
+TEST(TimerWheel, TimersBeyondTheWheelRunOnTime) {
+  // With nanosecond ticks the wheel only spans about 17ms.
+  InlineRunner runner;
+  acorn::TimerWheel wheel{std::ref(runner), nanoseconds{1}};
+  auto deadline = Clock::now() + milliseconds{40};
+  Clock::time_point ran_at;
+  wheel.schedule(deadline, [&ran_at] { ran_at = Clock::now(); });
+  ASSERT_TRUE(runner.wait_for_runs(1));
+  EXPECT_GE(ran_at, deadline);
+}
+
+TEST(TimerWheel, StopDropsTimers) {
+  InlineRunner runner;
+  acorn::TimerWheel wheel{std::ref(runner)};
+  auto handle = wheel.schedule(Clock::now() + hours{1}, [] {});
+  wheel.schedule(Clock::now() + hours{1}, [] {});
+  EXPECT_EQ(2u, wheel.size());
+  wheel.stop();
+  EXPECT_EQ(0u, wheel.size());
+  EXPECT_FALSE(handle.cancel());
+  auto late = wheel.schedule(Clock::now(), [] {});
+  EXPECT_FALSE(late.cancel());
+  std::this_thread::sleep_for(milliseconds{20});
+  std::lock_guard<std::mutex> lock{runner.mutex};
+  EXPECT_EQ(0, runner.n_runs);
+}
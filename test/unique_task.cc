@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2020, John Lawson
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gtest/gtest.h"
+
+#include "acorn/threads/unique_task.h"
+
+#include <array>
+#include <future>
+#include <memory>
+#include <type_traits>
+
+static_assert(!std::is_copy_constructible<acorn::UniqueTask>::value,
+              "UniqueTask should not be copiable, as it can hold move-only "
+              "callables.");
+
+static_assert(std::is_nothrow_move_constructible<acorn::UniqueTask>::value,
+              "UniqueTask should be nothrow move constructible.");
+
+static_assert(sizeof(acorn::UniqueTask) <= 64,
+              "UniqueTask should fit in a single cache line.");
+
+namespace {
+/** Callable which counts how many instances of it are alive. */
+struct Counted {
+  static int alive;
+  int* calls;
+
+  explicit Counted(int* c) : calls{c} { ++alive; }
+  Counted(Counted&& other) noexcept : calls{other.calls} { ++alive; }
+  Counted(Counted const&) = delete;
+  ~Counted() { --alive; }
+
+  void operator()() { ++*calls; }
+};
+int Counted::alive = 0;
+
+/** Callable which is too large to be stored inline. */
+struct Large {
+  std::array<char, 256> data;
+  int* calls;
+
+  void operator()() { ++*calls; }
+};
+}  // namespace
+
+TEST(UniqueTask, DefaultIsEmpty) {
+  acorn::UniqueTask task;
+  EXPECT_FALSE(task);
+}
+
+TEST(UniqueTask, CallsLambda) {
+  int calls = 0;
+  acorn::UniqueTask task{[&calls] { ++calls; }};
+  ASSERT_TRUE(task);
+  task();
+  task();
+  EXPECT_EQ(2, calls);
+}
+
+TEST(UniqueTask, HoldsMoveOnlyCallable) {
+  auto value = std::make_unique<int>(5);
+  int result = 0;
+  acorn::UniqueTask task{
+      [v = std::move(value), &result] { result = *v; }};
+  task();
+  EXPECT_EQ(5, result);
+}
+
+TEST(UniqueTask, HoldsPackagedTask) {
+  std::packaged_task<int()> packaged{[] { return 3; }};
+  auto future = packaged.get_future();
+  acorn::UniqueTask task{std::move(packaged)};
+  task();
+  EXPECT_EQ(3, future.get());
+}
+
+TEST(UniqueTask, MoveTransfersCallable) {
+  int calls = 0;
+  {
+    acorn::UniqueTask task{Counted{&calls}};
+    EXPECT_EQ(1, Counted::alive);
+
+    acorn::UniqueTask moved{std::move(task)};
+    EXPECT_FALSE(task);
+    ASSERT_TRUE(moved);
+    EXPECT_EQ(1, Counted::alive);
+    moved();
+
+    acorn::UniqueTask assigned;
+    assigned = std::move(moved);
+    EXPECT_FALSE(moved);
+    EXPECT_EQ(1, Counted::alive);
+    assigned();
+  }
+  EXPECT_EQ(2, calls);
+  EXPECT_EQ(0, Counted::alive);
+}
+
+TEST(UniqueTask, ResetDestroysCallable) {
+  int calls = 0;
+  acorn::UniqueTask task{Counted{&calls}};
+  EXPECT_EQ(1, Counted::alive);
+  task.reset();
+  EXPECT_FALSE(task);
+  EXPECT_EQ(0, Counted::alive);
+}
+
+TEST(UniqueTask, LargeCallableOnHeap) {
+  int calls = 0;
+  acorn::UniqueTask task{Large{{}, &calls}};
+  acorn::UniqueTask moved{std::move(task)};
+  moved();
+  EXPECT_EQ(1, calls);
+}
+
+TEST(UniqueFunction, ForwardsArgumentsAndReturn) {
+  acorn::UniqueFunction<int(int, std::unique_ptr<int>)> func{
+      [](int a, std::unique_ptr<int> b) { return a + *b; }};
+  EXPECT_EQ(7, func(3, std::make_unique<int>(4)));
+}
+
+TEST(UniqueFunction, DiscardsReturnForVoid) {
+  acorn::UniqueFunction<void()> func{[] { return 10; }};
+  func();
+}